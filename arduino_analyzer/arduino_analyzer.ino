@@ -25,7 +25,7 @@ const int pins[6] = {AMP_EN_1, AMP_EN_2, AMP_EN_3, AMP_MODE_1, AMP_MODE_2, AMP_M
 
 // Serial
 volatile uint8_t opcode;
-volatile uint8_t response[2] = {0x01, 0x01};
+volatile uint8_t response[3] = {0x01, 0x01, 0x01};
 volatile uint8_t response_index = 0;
 volatile uint8_t response_length = 0;
 volatile bool waiting_for_opcode = true; 
@@ -100,6 +100,12 @@ ISR (SPI_STC_vect){
       case 0x60: // erase
         response_length = 0;
         break;
+      case 0x9F: // JEDEC ID of an AT25DF512C
+        response[0] = 0x1F;
+        response[1] = 0x65;
+        response[2] = 0x01;
+        response_length = 3;
+        break;
         
       default:
         response[0] = 0xEA;
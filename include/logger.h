@@ -0,0 +1,127 @@
+/*! @file logger.h
+ *  @brief Low-overhead leveled logger with deferred formatting.
+ *
+ * Log calls on hot paths only capture the format string, the arguments and a
+ * timestamp into a lock-free ring. A background thread formats and writes the
+ * records to stderr, so console I/O never throttles the poll loops.
+ *
+ * @details
+ * Levels below `LOG_LEVEL` are removed at compile time, set it with the
+ * `AMPLINK_LOG_LEVEL` CMake cache variable (ERROR, WARN, INFO, DEBUG, TRACE).
+ *
+ * Formats support the usual integer, floating point, character, pointer and
+ * string conversions with up to @ref LOGGER_MAX_ARGS arguments. String
+ * arguments are copied when logged, truncated to fit the record.
+ * Records logged while the ring is full are dropped and counted.
+ *
+ * Before @ref logger_init, and after @ref logger_close, records are written
+ * immediately on the calling thread.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+//! Records held in the ring, must be a power of 2
+#define LOGGER_RING_SIZE 1024
+//! Maximum number of format arguments per record
+#define LOGGER_MAX_ARGS  8
+//! Bytes per record available for copied string arguments
+#define LOGGER_STRING_SPACE 96
+//! Interval of the background flush in milliseconds
+#define LOGGER_FLUSH_MS  50
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...) logger_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+  #define LOG_ERROR(...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_WARN(...)  logger_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+  #define LOG_WARN(...)  ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...)  logger_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+  #define LOG_INFO(...)  ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(...) logger_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+  #define LOG_DEBUG(...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+  #define LOG_TRACE(...) logger_write(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+  #define LOG_TRACE(...) ((void)0)
+#endif
+
+/*!
+ * @brief Logs at most once per interval from a single call site.
+ *
+ * Intended for progress messages inside poll loops.
+ *
+ * @param level One of the LOG_LEVEL_ constants
+ * @param interval_ms Minimum time between two records of this call site
+ * @param ... Format string and arguments
+ */
+#define LOG_EVERY_MS(level, interval_ms, ...)                              \
+    do {                                                                   \
+        static uint64_t logger_last_ms_;                                   \
+        if ((level) <= LOG_LEVEL && logger_due(&logger_last_ms_, (interval_ms))) \
+            logger_write((level), __VA_ARGS__);                            \
+    } while (0)
+
+/*!
+ * @brief Starts the background flush thread.
+ *
+ * Registers @ref logger_close to run at exit.
+ */
+void logger_init(void);
+
+/*!
+ * @brief Captures a log record. Use the LOG_ macros instead of calling this directly.
+ *
+ * @param[in] level Record level
+ * @param[in] fmt printf style format string, must remain valid until flushed (string literal)
+ */
+void logger_write(int level, const char *fmt, ...);
+
+/*!
+ * @brief Writes all captured records to stderr.
+ *
+ * Safe to call from any thread, records are written in capture order.
+ */
+void logger_flush(void);
+
+/*!
+ * @brief Flushes remaining records and stops the background thread.
+ */
+void logger_close(void);
+
+/*!
+ * @brief Rate limit check used by @ref LOG_EVERY_MS.
+ *
+ * @param[in,out] last_ms Time of the last accepted call
+ * @param[in] interval_ms Minimum interval
+ * @return int 1 if the interval elapsed since the last accepted call
+ */
+int logger_due(uint64_t *last_ms, uint32_t interval_ms);
+
+#endif
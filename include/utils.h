@@ -3,23 +3,17 @@
 
 #include <stdio.h>
 #include "ftd2xx.h"
+#include "logger.h"
 
-#define DEBUG // remove this for no debug print
-
-#ifdef DEBUG
-  #define DEBUG_PRINT(...) fprintf(stderr, __VA_ARGS__)
-#else
-  #define DEBUG_PRINT(...)
-#endif
-
+// a failure is logged at every level it passes on its way up, which traces its call path
 #define RETURN_IF_ERROR(call)                         \
     do {                                              \
         FT_STATUS status = (call);                    \
         if (status != FT_OK) {                        \
-            DEBUG_PRINT("[ERROR] %s failed: %d\n",     \
-                        #call, status);               \
+            LOG_WARN("%s failed: %d\n",               \
+                     #call, (int)status);             \
             return status;                            \
         }                                             \
     } while (0)
 
-#endif // UTILS_H
\ No newline at end of file
+#endif // UTILS_H
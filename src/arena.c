@@ -0,0 +1,40 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+FT_STATUS arena_init(Arena *arena, size_t size){
+    arena->base = malloc(size);
+    arena->size = arena->base ? size : 0;
+    arena->used = 0;
+    return arena->base ? FT_OK : FT_INSUFFICIENT_RESOURCES;
+}
+
+void arena_wrap(Arena *arena, void *buffer, size_t size){
+    arena->base = buffer;
+    arena->size = size;
+    arena->used = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size){
+    size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start)
+        return NULL;
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+size_t arena_mark(const Arena *arena){
+    return arena->used;
+}
+
+void arena_release(Arena *arena, size_t mark){
+    if (mark <= arena->used)
+        arena->used = mark;
+}
+
+void arena_free(Arena *arena){
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,97 @@
+/*! @file arena.h
+ *  @brief Fixed-size bump allocator for per-run buffers.
+ *
+ * An arena is one block allocated at init. Buffers are carved out of it by
+ * moving an offset, and released all at once by resetting the offset to a
+ * saved mark. Command and readback buffers of the bus drivers come from an
+ * arena, so the programming hot path never calls malloc or grows the stack.
+ *
+ * @details
+ * An arena is not thread safe. Give every thread, e.g. every bus channel,
+ * its own arena.
+ *
+ * **Example usage:**
+ * @code
+ * size_t mark = arena_mark(&arena);
+ * uint8_t *cmd = arena_alloc(&arena, 4 + FLASH_PAGE_SIZE);
+ * // build the command in place and send it
+ * arena_release(&arena, mark);
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ftd2xx.h"
+
+//! Alignment of every buffer returned by @ref arena_alloc
+#define ARENA_ALIGN 16
+
+/*!
+ * @struct Arena
+ * @brief A fixed block and the offset of its first free byte
+ */
+typedef struct {
+    uint8_t *base; /*!< Start of the block */
+    size_t size;   /*!< Size of the block in bytes */
+    size_t used;   /*!< Bytes handed out */
+} Arena;
+
+/*!
+ * @brief Allocates the block of an arena.
+ *
+ * @param[out] arena Arena to initialize
+ * @param[in] size Size of the block in bytes
+ * @return FT_STATUS FT_OK, FT_INSUFFICIENT_RESOURCES on allocation failure
+ */
+FT_STATUS arena_init(Arena *arena, size_t size);
+
+/*!
+ * @brief Builds an arena over caller owned memory, e.g. a small stack buffer.
+ *
+ * Never pass such an arena to @ref arena_free.
+ *
+ * @param[out] arena Arena to initialize
+ * @param[in] buffer Memory to carve buffers from
+ * @param[in] size Size of the memory in bytes
+ */
+void arena_wrap(Arena *arena, void *buffer, size_t size);
+
+/*!
+ * @brief Carves an aligned buffer out of an arena.
+ *
+ * @param[in,out] arena Arena to allocate from
+ * @param[in] size Size of the buffer in bytes
+ * @return void* Buffer, NULL if the arena is full
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/*!
+ * @brief Saves the current fill level of an arena.
+ *
+ * @param[in] arena Arena
+ * @return size_t Mark for @ref arena_release
+ */
+size_t arena_mark(const Arena *arena);
+
+/*!
+ * @brief Releases every buffer allocated after a mark.
+ *
+ * @param[in,out] arena Arena
+ * @param[in] mark Mark returned by @ref arena_mark
+ */
+void arena_release(Arena *arena, size_t mark);
+
+/*!
+ * @brief Frees the block of an arena, left empty.
+ *
+ * @param[in,out] arena Arena
+ */
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,275 @@
+#include "board.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "programmer.h"
+#include "job_queue.h"
+#include "flash_compiler.h"
+#include "metrics.h"
+#include "progress.h"
+#include "platform.h"
+#include "utils.h"
+#include "flash_timing.h"
+
+#define BOARD_FLASH_CHIPS 3
+
+static const spi_chip_select_t chipSelects[BOARD_FLASH_CHIPS] = {SPI_CS_2, SPI_CS_3, SPI_CS_4};
+static const char *laneLabels[BOARD_FLASH_CHIPS] = {"CS2", "CS3", "CS4"};
+
+//! Configuration given to board_init
+static BoardConfig config;
+//! Compiled program of every flash chip, kept across boards
+static FlashCompiled compiled[BOARD_FLASH_CHIPS];
+//! Part each program was compiled for, NULL if none
+static const FlashPart *compiled_part[BOARD_FLASH_CHIPS];
+//! Differential plan of every flash chip, rebuilt on each board
+static FlashDiff diffs[BOARD_FLASH_CHIPS];
+
+
+const char *board_chip_select_str(spi_chip_select_t cs){
+    switch(cs){
+        case SPI_CS_1:  return "1";
+        case SPI_CS_2:  return "2";
+        case SPI_CS_3:  return "3";
+        case SPI_CS_4:  return "4";
+        default:        return "?";
+    }
+}
+
+// first failure of a chip's phases, FT_OK if all passed
+static FT_STATUS first_failure(Job *const jobs[], int count){
+    for (int i = 0; i < count; i++){
+        if (jobs[i]->status != FT_OK) return jobs[i]->status;
+    }
+    return FT_OK;
+}
+
+static FT_STATUS record_metrics(time_t start, uint64_t startTime, Job *clockProgram, Job *clockBurn,
+                                Job flashJobs[BOARD_FLASH_CHIPS][3], const double lanePeakKbps[BOARD_FILES]){
+    RunMetrics run;
+    memset(&run, 0, sizeof(run));
+    run.start = start;
+    run.total_ms = platform_elapsed_ms(startTime);
+    run.serial = programmer_serial();
+    programmer_get_clock_rates(&run.spi_clock_hz, &run.i2c_clock_hz);
+    UsbSettings spiUsb, i2cUsb;
+    programmer_get_usb_settings(&spiUsb, &i2cUsb, NULL);
+
+    ChipMetrics *clk = &run.chips[run.chip_count++];
+    Job *clockJobs[] = {clockProgram, clockBurn};
+    clk->name = "CLK";
+    clk->file = config.files[0];
+    clk->status = first_failure(clockJobs, 2);
+    clk->program_ms = clockProgram->elapsed_ms;
+    clk->burn_ms = clockBurn->elapsed_ms;
+    clk->bytes_written = clockProgram->bytes_done;
+    clk->retries = clockProgram->retries + clockBurn->retries;
+    clk->clock_hz = run.i2c_clock_hz;
+    clk->peak_kbps = lanePeakKbps[0];
+    clk->latency_ms = i2cUsb.latency_ms;
+    clk->usb_in_size = i2cUsb.in_size;
+    clk->usb_out_size = i2cUsb.out_size;
+    run.status = clk->status;
+
+    for (int i = 0; i < BOARD_FLASH_CHIPS; i++){
+        ChipMetrics *c = &run.chips[run.chip_count++];
+        Job *jobs[] = {&flashJobs[i][0], &flashJobs[i][1], &flashJobs[i][2]};
+        c->name = laneLabels[i];
+        c->file = config.files[i + 1];
+        c->status = first_failure(jobs, 3);
+        c->erase_ms = jobs[0]->elapsed_ms;
+        c->program_ms = jobs[1]->elapsed_ms;
+        c->verify_ms = jobs[2]->elapsed_ms;
+        c->bytes_written = jobs[1]->bytes_done - jobs[1]->bytes_skipped;
+        c->bytes_skipped = jobs[1]->bytes_skipped;
+        c->pages_skipped = jobs[1]->pages_skipped;
+        c->retries = jobs[0]->retries + jobs[1]->retries + jobs[2]->retries;
+        c->clock_hz = run.spi_clock_hz;
+        c->peak_kbps = lanePeakKbps[i + 1];
+        c->latency_ms = spiUsb.latency_ms;
+        c->usb_in_size = spiUsb.in_size;
+        c->usb_out_size = spiUsb.out_size;
+        if (run.status == FT_OK) run.status = c->status;
+        printf("[%s]  erase %.0f ms, program %.0f ms (%.1f KB/s, %u pages skipped), verify %.0f ms\n", c->name,
+               c->erase_ms, c->program_ms, metrics_kbps(c), c->pages_skipped, c->verify_ms);
+    }
+
+    const char *path = config.metrics_file ? config.metrics_file : METRICS_DEFAULT_FILE;
+    if (metrics_append(path, &run) != FT_OK)
+        printf("Failed to write metrics to '%s'\n", path);
+    // the times polled on this board refine the next one
+    if (flash_timing_save(FLASH_TIMING_DEFAULT_FILE) != FT_OK)
+        printf("Failed to write flash timing to '%s'\n", FLASH_TIMING_DEFAULT_FILE);
+    return run.status;
+}
+
+static const char* job_type_to_str(job_type_t type){
+    switch(type){
+        case JOB_FLASH_ERASE:   return "Erasing flash...";
+        case JOB_FLASH_PROGRAM: return "Programming flash...";
+        case JOB_FLASH_VERIFY:  return "Verifying flash...";
+        case JOB_CLOCK_PROGRAM: return "Programming clock...";
+        case JOB_CLOCK_VERIFY:  return "Verifying clock...";
+        case JOB_CLOCK_BURN:    return "Burning clock...";
+        default:                return "?";
+    }
+}
+
+// runs on the job worker threads, print whole lines only and through progress so the status line stays intact
+static void print_job_event(Job *job, job_event_t event){
+    if (event != JOB_EVENT_COMPLETE) return;
+
+    char target[16];
+    if (job_channel(job->type) == JOB_CHANNEL_SPI)
+        snprintf(target, sizeof(target), "[CS %s]", board_chip_select_str(job->chipSelect));
+    else
+        snprintf(target, sizeof(target), "[CLK]");
+
+    if (job->status == FT_OK && job->type == JOB_FLASH_ERASE && job->diff)
+        progress_println("%-7s %-22s Success! (%u same, %u programmable, %u need erase, %u sectors erased)", target,
+               job_type_to_str(job->type), job->diff->same, job->diff->programmable, job->diff->erase, job->diff->sectors);
+    else if (job->status == FT_OK && job->type == JOB_FLASH_PROGRAM && !job->image)
+        progress_println("%-7s %-22s Success! (%u pages, ring avg %.1f/%d, parser stalls %u)", target, job_type_to_str(job->type),
+               job->pipeline.pages, pipeline_avg_occupancy(&job->pipeline), PIPELINE_RING_SLOTS, job->pipeline.producer_stalls);
+    else if (job->status == FT_OK)
+        progress_println("%-7s %-22s Success!", target, job_type_to_str(job->type));
+    else
+        progress_println("%-7s %-22s FAILED! (%d)", target, job_type_to_str(job->type), (int)job->status);
+}
+
+// compiles the image of a chip for its part, reusing the program of the previous board while the part is the same.
+// the learned program time delay is applied when the program is sent, it never forces a recompile
+static const FlashCompiled *board_compile(int chip, const FlashPart *part){
+    const char *cs = board_chip_select_str(chipSelects[chip]);
+    if (compiled_part[chip] == part)
+        return &compiled[chip];
+
+    flash_compiled_free(&compiled[chip]);
+    compiled_part[chip] = NULL;
+    int hit;
+    if (flash_compiled_load(&compiled[chip], config.images[chip + 1], part, chipSelects[chip], config.files[chip + 1],
+                            config.cache_dir, config.no_cache, &hit) != FT_OK){
+        printf("[CS %s]  Failed to compile '%s', programming from the image\n", cs, config.files[chip + 1]);
+        return NULL;
+    }
+    compiled_part[chip] = part;
+    printf("[CS %s]  Compiled '%s': %u pages%s\n", cs, config.files[chip + 1], compiled[chip].step_count, hit ? " (cached)" : "");
+    return &compiled[chip];
+}
+
+
+FT_STATUS board_init(const BoardConfig *boardConfig){
+    config = *boardConfig;
+    memset(compiled, 0, sizeof(compiled));
+    memset(compiled_part, 0, sizeof(compiled_part));
+    memset(diffs, 0, sizeof(diffs));
+    return job_queue_init();
+}
+
+void board_set_images(const Image *const images[BOARD_FILES]){
+    for (int i = 0; i < BOARD_FILES; i++)
+        config.images[i] = images[i];
+    for (int i = 0; i < BOARD_FLASH_CHIPS; i++){
+        flash_compiled_free(&compiled[i]);
+        compiled_part[i] = NULL;
+    }
+}
+
+FT_STATUS board_program(void){
+    time_t runStart = time(NULL);
+    uint64_t runStartTime = platform_time_us();
+
+    // clock and flash jobs run on separate workers and overlap, one progress lane per chip
+    Job clockProgram = { .type = JOB_CLOCK_PROGRAM, .filename = config.files[0], .image = config.images[0], .callback = print_job_event };
+    Job clockBurn    = { .type = JOB_CLOCK_BURN, .after = &clockProgram, .callback = print_job_event };
+    Job *clockJobs[] = {&clockProgram, &clockBurn};
+    progress_add_lane("CLK", clockJobs, 2);
+    job_submit(&clockProgram);
+    job_submit(&clockBurn);
+
+    Job flashJobs[BOARD_FLASH_CHIPS][3];
+    for (int i = 0; i < BOARD_FLASH_CHIPS; i++){
+        const char *file = config.files[i + 1];
+        const Image *image = config.images[i + 1];
+        Job *erase = &flashJobs[i][0];
+        Job *program = &flashJobs[i][1];
+        Job *verify = &flashJobs[i][2];
+        *erase   = (Job){ .type = JOB_FLASH_ERASE, .chipSelect = chipSelects[i], .callback = print_job_event };
+        *program = (Job){ .type = JOB_FLASH_PROGRAM, .chipSelect = chipSelects[i], .filename = file,
+                          .image = image, .after = erase, .callback = print_job_event };
+        *verify  = (Job){ .type = JOB_FLASH_VERIFY, .chipSelect = chipSelects[i], .filename = file,
+                          .image = image, .after = program, .callback = print_job_event };
+        if (config.differential){
+            // the erase reads the chip into the plan the program job then follows
+            erase->image = image;
+            erase->diff = program->diff = &diffs[i];
+        }
+        Job *lane[] = {erase, program, verify};
+        progress_add_lane(laneLabels[i], lane, 3);
+
+        const FlashPart *part;
+        const char *cs = board_chip_select_str(chipSelects[i]);
+        FT_STATUS chipStatus = programmer_flash_chip(chipSelects[i], &part);
+        if (chipStatus == FT_OK && image->size > part->capacity){
+            printf("[CS %s]  '%s' does not fit the %u KB %s, skipped\n", cs, file, part->capacity / 1024, part->name);
+            chipStatus = FT_INVALID_PARAMETER;
+        } else if (chipStatus == FT_EEPROM_NOT_PRESENT){
+            printf("[CS %s]  No flash found, skipped\n", cs);
+        } else if (chipStatus == FT_OK){
+            printf("[CS %s]  Found %s\n", cs, part->name);
+            // precompute the page buffers, the image path is the fallback
+            program->compiled = board_compile(i, part);
+        }
+        // FT_OTHER_ERROR: probe failed, the jobs detect the part themselves
+        if (chipStatus != FT_OK && chipStatus != FT_OTHER_ERROR){
+            job_skip(erase, chipStatus);
+            job_skip(program, chipStatus);
+            job_skip(verify, chipStatus);
+            continue;
+        }
+        job_submit(erase);
+        job_submit(program);
+        job_submit(verify);
+    }
+    if (progress_start(!config.quiet) != FT_OK)
+        printf("Failed to start progress reporting\n");
+
+    for (int i = 0; i < BOARD_FLASH_CHIPS; i++)
+        job_wait(&flashJobs[i][2]);
+    job_wait(&clockBurn);
+    progress_stop();
+
+    double lanePeakKbps[BOARD_FILES];
+    for (int i = 0; i < BOARD_FILES; i++){
+        ProgressSample sample;
+        progress_get(i, &sample);
+        lanePeakKbps[i] = sample.peak_bps / 1024.0;
+    }
+    return record_metrics(runStart, runStartTime, &clockProgram, &clockBurn, flashJobs, lanePeakKbps);
+}
+
+FT_STATUS board_wait(int present){
+    uint8_t last = 0;
+    int stable = 0;
+    for (;;){
+        RETURN_IF_ERROR(programmer_flash_probe());
+        uint8_t found = programmer_flash_found();
+        // count the probes that agree with the previous one and match the wanted state
+        int match = present ? found != 0 : found == 0;
+        stable = (match && found == last) ? stable + 1 : match;
+        last = found;
+        if (stable >= BOARD_POLL_STABLE)
+            return FT_OK;
+        platform_sleep_us(BOARD_POLL_MS * 1000);
+    }
+}
+
+void board_close(void){
+    job_queue_close();
+    for (int i = 0; i < BOARD_FLASH_CHIPS; i++){
+        flash_compiled_free(&compiled[i]);
+        compiled_part[i] = NULL;
+        flash_diff_free(&diffs[i]);
+    }
+}
@@ -0,0 +1,112 @@
+/*! @file board.h
+ *  @brief Programs one processor board with the loaded images.
+ *
+ * Runs the clock program and burn and the erase, program and verify of every
+ * flash chip on the job queue, reports progress and appends the run metrics.
+ * The AmPLink channels, the job queue and the compiled flash programs stay
+ * open between boards, so a fixture programming board after board only pays
+ * the programming time.
+ *
+ * @details
+ * Call @ref programmer_init, @ref programmer_clock_set_addr and
+ * @ref programmer_flash_probe before every @ref board_program. Compiled
+ * programs (see @ref flash_compiler.h) are kept per chip select and reused
+ * while the detected part stays the same.
+ *
+ * **Example usage:**
+ * @code
+ * BoardConfig config = { .files = {...}, .images = {...} };
+ * board_init(&config);
+ * while (next_board()){
+ *     programmer_flash_probe();
+ *     board_program();
+ * }
+ * board_close();
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdint.h>
+#include "config.h"
+#include "ftd2xx.h"
+#include "image.h"
+
+//! Input files of a board: clock, flash 2A, 3A and 4A
+#define BOARD_FILES 4
+//! Interval between presence probes while waiting for a board
+#define BOARD_POLL_MS 200
+//! Consecutive probes that must agree before a board counts as inserted or removed
+#define BOARD_POLL_STABLE 3
+
+/*!
+ * @struct BoardConfig
+ * @brief Inputs and options shared by every board
+ */
+typedef struct {
+    const char *files[BOARD_FILES];   /*!< Input files, clock first, then the flash chips on CS2, CS3 and CS4 */
+    const Image *images[BOARD_FILES]; /*!< Loaded images of the input files */
+    const char *cache_dir;            /*!< Directory for compiled program files, NULL to store them next to the inputs */
+    int no_cache;                     /*!< Set to compile flash programs in memory only */
+    int quiet;                        /*!< Set to hide the live progress line */
+    const char *metrics_file;         /*!< Metrics log, NULL for @ref METRICS_DEFAULT_FILE */
+    int differential;                 /*!< Set to read the flash chips and erase only the sectors that need it, see @ref flash_diff.h */
+} BoardConfig;
+
+/*!
+ * @brief Starts the job queue and stores the configuration.
+ *
+ * @param[in] config Configuration, copied. The images must stay loaded until @ref board_close
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS board_init(const BoardConfig *config);
+
+/*!
+ * @brief Replaces the images, e.g. after the input files changed.
+ *
+ * Drops the compiled flash programs of the old images.
+ *
+ * @param[in] images New images, in the order of BoardConfig::files
+ */
+void board_set_images(const Image *const images[BOARD_FILES]);
+
+/*!
+ * @brief Programs and verifies one board and appends its metrics.
+ *
+ * @return FT_STATUS FT_OK if every chip passed, otherwise the first failure
+ */
+FT_STATUS board_program(void);
+
+/*!
+ * @brief Waits until a board is inserted into or removed from the fixture.
+ *
+ * Probes the JEDEC ID of the flash chips every @ref BOARD_POLL_MS, about a
+ * millisecond of bus time per poll. A board counts as inserted once
+ * @ref BOARD_POLL_STABLE probes in a row find the same chips, which rides out
+ * contact bounce while the board is seated, and as removed once as many
+ * probes find none. After an insertion the probe results of the new board
+ * are in place, @ref board_program can start without probing again.
+ *
+ * @param[in] present Set to wait for an insertion, clear to wait for a removal
+ * @return FT_STATUS FT_OK once the board is in the requested state, otherwise the failed probe
+ */
+FT_STATUS board_wait(int present);
+
+/*!
+ * @brief Stops the job queue and releases the compiled programs.
+ */
+void board_close(void);
+
+/*!
+ * @brief Converts a chip select to its number.
+ *
+ * @param[in] cs Chip select
+ * @return const char* "1" to "4"
+ */
+const char *board_chip_select_str(spi_chip_select_t cs);
+
+#endif
@@ -9,7 +9,20 @@ void print_help() {
     printf("  -3=FILENAME    Path to flash_3A flash file (default: flash_3A.hex)\n");
     printf("  -4=FILENAME    Path to flash_4A file (default: flash_4A.hex)\n");
     printf("  -i=0xHH         Clock i2c address (default: 0x6A)\n");
-    printf("  -h              Show this help message\n");
+    printf("  -c=DIR          Directory for parsed image cache (default: next to input files)\n");
+    printf("  -n              Parse input files without the image cache\n");
+    printf("  -m=FILE         Append run metrics to FILE, CSV if it ends in .csv (default: amplink_metrics.jsonl)\n");
+    printf("  -q              Hide the live progress line\n");
+    printf("  -t=FILE         Write a Chrome trace of all USB calls (AMPLINK_TRACE builds only)\n");
+    printf("  -e=ENGINE       SPI engine, libmpsse or raw MPSSE commands (default: libmpsse)\n");
+    printf("  -b=N            Benchmark both SPI engines with N reads on the first flash chip and exit\n");
+    printf("  -d              Stay connected and program a board per 'program' line on stdin ('reload', 'quit'),\n"
+           "                  replies only on stdout, all other output on stderr, implies -q\n");
+    printf("  -l=N            Program boards as they are inserted, stop after N boards (0: until interrupted)\n");
+    printf("  -u              Sweep the USB latency timer and transfer sizes again instead of using the cached ones\n");
+    printf("  -r              Program in place: read the flash chips and erase only the sectors whose pages need it\n");
+    printf("  -h              Show this help message\n\n");
+    printf("Input files may be Intel HEX, S-record (.srec/.s19/.s28/.s37) or raw binary (.bin[@0xADDR])\n");
 }
 
 int parse_args(int argc, char *argv[], Args *args) {
@@ -22,9 +35,21 @@ int parse_args(int argc, char *argv[], Args *args) {
     args->file3_name = NULL;
     args->file4_name = NULL;
     args->i2c_addr = 0x00;
+    args->cache_dir = NULL;
+    args->no_cache = 0;
+    args->trace_file = NULL;
+    args->metrics_file = NULL;
+    args->quiet = 0;
+    args->spi_engine = SPI_ENGINE_LIBMPSSE;
+    args->bench_iterations = 0;
+    args->daemon = 0;
+    args->continuous = 0;
+    args->board_count = 0;
+    args->retune = 0;
+    args->differential = 0;
 
     // parse command line args
-    while ((opt = getopt(argc, argv, "1:2:3:4:i:h:")) != -1){
+    while ((opt = getopt(argc, argv, "1:2:3:4:i:c:nm:qt:e:b:dl:urh:")) != -1){
         switch (opt) {
             case '1':
                 args->file1_name = optarg;
@@ -49,6 +74,55 @@ int parse_args(int argc, char *argv[], Args *args) {
                     return 1;
                 } 
                 break;
+            case 'c':
+                args->cache_dir = optarg;
+                break;
+            case 'n':
+                args->no_cache = 1;
+                break;
+            case 'm':
+                args->metrics_file = optarg;
+                break;
+            case 'q':
+                args->quiet = 1;
+                break;
+            case 't':
+                args->trace_file = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, spi_engine_to_str(SPI_ENGINE_RAW)) == 0){
+                    args->spi_engine = SPI_ENGINE_RAW;
+                } else if (strcmp(optarg, spi_engine_to_str(SPI_ENGINE_LIBMPSSE)) == 0){
+                    args->spi_engine = SPI_ENGINE_LIBMPSSE;
+                } else {
+                    fprintf(stderr, "Invalid SPI engine: %s (must be libmpsse or raw)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'b':
+                args->bench_iterations = strtoul(optarg, &endptr, 10);
+                if (*endptr != '\0' || args->bench_iterations == 0){
+                    fprintf(stderr, "Invalid benchmark count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                args->daemon = 1;
+                break;
+            case 'l':
+                args->continuous = 1;
+                args->board_count = strtoul(optarg, &endptr, 10);
+                if (*endptr != '\0'){
+                    fprintf(stderr, "Invalid board count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                args->retune = 1;
+                break;
+            case 'r':
+                args->differential = 1;
+                break;
             case 'h':
                 print_help();
                 return 1;
@@ -57,5 +131,12 @@ int parse_args(int argc, char *argv[], Args *args) {
                 return 1;
         }
     }
+    if (args->daemon && args->continuous){
+        fprintf(stderr, "-d and -l cannot be combined\n");
+        return 1;
+    }
+    // nobody watches a daemon's progress line, it would only fill the log
+    if (args->daemon)
+        args->quiet = 1;
     return 0;
 }
\ No newline at end of file
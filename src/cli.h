@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "spi_driver.h"
 
 /*!
  * @struct Args
@@ -27,6 +28,18 @@ typedef struct {
     char *file3_name;       /*!< Input file for Flash 3A programming */
     char *file4_name;       /*!< Input file for Flash 4A programming */
     unsigned char i2c_addr; /*!< I2C address of the VersaClock device */
+    char *cache_dir;        /*!< Directory for parsed image cache files */
+    int no_cache;           /*!< Set to parse input files without the image cache */
+    char *trace_file;       /*!< Chrome trace output file, only used in AMPLINK_TRACE builds */
+    char *metrics_file;     /*!< Metrics log file, JSON Lines or CSV */
+    int quiet;              /*!< Set to hide the live progress line */
+    spi_engine_t spi_engine;      /*!< Engine driving the SPI channel */
+    unsigned long bench_iterations; /*!< Set to benchmark both SPI engines with this many reads and exit */
+    int daemon;             /*!< Set to keep the AmPLink open and program a board per command read from stdin */
+    int continuous;         /*!< Set to program boards as they are inserted into the fixture */
+    unsigned long board_count;    /*!< Boards to program in continuous mode, 0 until interrupted */
+    int retune;             /*!< Set to sweep the USB settings again instead of using the cached ones */
+    int differential;       /*!< Set to read the flash chips first and erase only the sectors that need it */
 } Args;
 
 
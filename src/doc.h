@@ -11,8 +11,25 @@
  * ### User Programming Files
  * These files contain the core functions that the user can access for the purpose of programming.
  * - @ref programmer.h
+ * - @ref job_queue.h
  * - @ref fileparser.h
+ * - @ref pipeline.h
+ * - @ref image.h
+ * - @ref image_cache.h
+ * - @ref image_loader.h
+ * - @ref image_parallel.h
  * - @ref cli.h
+ * - @ref metrics.h
+ * - @ref progress.h
+ * - @ref arena.h
+ * - @ref flash_compiler.h
+ * - @ref board.h
+ * - @ref usb_tuning.h
+ * - @ref flash_timing.h
+ * - @ref flash_diff.h
+ * - @ref platform.h
+ * - @ref logger.h
+ * - @ref trace.h
  *
  * ### FTDI Driver API's
  * These files provide a clean API for interacting with the ftd2xx and libmpsse libraries. These are internally accessed by `programmer.h`
@@ -29,6 +46,8 @@
  * - `cmake ..`
  * - `cmake --build && cd build` 
  *
+ * On Linux install `libftd2xx.so` and `libmpsse.so` first, see the README.
+ *
  *
  * @section depend_sec Dependencies
  * DLLS are included in `lib/` folder. Make sure they are copied to the same directory as the 
@@ -5,8 +5,19 @@
 
 #include "fileparser.h"
 
-#define MAX_LINE_LENGTH 512
+//! Longest S-record line: type, count, 255 bytes in hex, CR LF and NUL
+#define SREC_LINE_LENGTH (4 + MAX_DATA_BYTES * 2 + 3)
 #define MAX_DATA_BYTES 255
+#define BINARY_CHUNK 128
+#define HEX_READ_BLOCK 0x10000
+
+/*!
+ * @struct PlainCallback
+ * @brief Adapts a context-free programmer callback to the context callback interface
+ */
+typedef struct {
+    FT_STATUS (*callback)(uint32_t addr, const uint8_t *data, uint8_t len); /*!< Wrapped callback */
+} PlainCallback;
 
 uint8_t hex_to_byte(const unsigned char *hex){
     uint8_t val = 0;
@@ -23,63 +34,404 @@ uint8_t hex_to_byte(const unsigned char *hex){
     return val;
 }
 
+// value of every hex digit, 0xFF for any other character
+#define XX 0xFF
+static const uint8_t hex_value[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX
+};
+#undef XX
+
+static FT_STATUS hex_error(HexParser *p, const char *msg){
+    fprintf(stderr, "%s in file '%s' line %u\n", msg, p->filename ? p->filename : "", p->line);
+    p->state = HEX_STATE_ERROR;
+    p->status = FT_INVALID_PARAMETER;
+    return p->status;
+}
+
+// records arrive mostly in ascending order, so the common case only extends the last range
+static FT_STATUS hex_claim_range(HexParser *p, uint32_t addr, uint32_t len){
+    uint32_t end = addr + len;
+    uint32_t n = p->range_count;
+
+    if (n && addr >= p->ranges[n - 1].end){
+        if (addr == p->ranges[n - 1].end){
+            p->ranges[n - 1].end = end;
+            return FT_OK;
+        }
+    } else if (n){
+        // find the first range ending after addr
+        uint32_t lo = 0, hi = n;
+        while (lo < hi){
+            uint32_t mid = (lo + hi) / 2;
+            if (p->ranges[mid].end <= addr) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < n && p->ranges[lo].start < end){
+            hex_error(p, "overlapping data record");
+            fprintf(stderr, "address 0x%08X already written\n", p->ranges[lo].start > addr ? p->ranges[lo].start : addr);
+            return p->status;
+        }
+        // join a neighbour where possible, otherwise insert in order
+        if (lo > 0 && p->ranges[lo - 1].end == addr){
+            p->ranges[lo - 1].end = end;
+            if (lo < n && p->ranges[lo].start == end){
+                p->ranges[lo - 1].end = p->ranges[lo].end;
+                memmove(&p->ranges[lo], &p->ranges[lo + 1], (n - lo - 1) * sizeof(HexRange));
+                p->range_count--;
+            }
+            return FT_OK;
+        }
+        if (lo < n && p->ranges[lo].start == end){
+            p->ranges[lo].start = addr;
+            return FT_OK;
+        }
+        n = lo;
+    }
+
+    if (p->range_count == p->range_cap){
+        uint32_t cap = p->range_cap ? p->range_cap * 2 : 16;
+        HexRange *ranges = realloc(p->ranges, cap * sizeof(HexRange));
+        if (!ranges){
+            p->state = HEX_STATE_ERROR;
+            p->status = FT_INSUFFICIENT_RESOURCES;
+            return p->status;
+        }
+        p->ranges = ranges;
+        p->range_cap = cap;
+    }
+    memmove(&p->ranges[n + 1], &p->ranges[n], (p->range_count - n) * sizeof(HexRange));
+    p->ranges[n].start = addr;
+    p->ranges[n].end = end;
+    p->range_count++;
+    return FT_OK;
+}
+
+static FT_STATUS hex_process_record(HexParser *p){
+    const uint8_t *rec = p->record;
+    uint8_t byte_count = rec[0];
+    uint16_t address = (uint16_t)((rec[1] << 8) | rec[2]);
+    uint8_t data_type = rec[3];
+    const uint8_t *data = &rec[4];
+
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < p->record_len; i++)
+        sum += rec[i];
+    if (sum != 0){
+        hex_error(p, "checksum error");
+        fprintf(stderr, "calculated: %02X, expected: %02X\n", (uint8_t)(rec[p->record_len - 1] - sum), rec[p->record_len - 1]);
+        return p->status;
+    }
+
+    switch (data_type){
+        case 0x00: {
+            if (byte_count == 0) return FT_OK;
+            uint32_t full_addr = p->base + address;
+            if (full_addr > UINT32_MAX - byte_count)
+                return hex_error(p, "address out of range");
+            if (hex_claim_range(p, full_addr, byte_count) != FT_OK)
+                return p->status;
+            FT_STATUS ftStatus = p->callback(p->ctx, full_addr, data, byte_count);
+            if (ftStatus != FT_OK){
+                fprintf(stderr, "Failed to write to flash at address 0x%06X\n", full_addr);
+                p->state = HEX_STATE_ERROR;
+                p->status = ftStatus;
+            }
+            return ftStatus;
+        }
+        case 0x01:
+            if (byte_count != 0) return hex_error(p, "malformed end of file record");
+            p->state = HEX_STATE_DONE;
+            return FT_OK;
+        case 0x02:
+            if (byte_count != 2) return hex_error(p, "malformed extended segment address record");
+            p->base = (uint32_t)((data[0] << 8) | data[1]) << 4;
+            return FT_OK;
+        case 0x04:
+            if (byte_count != 2) return hex_error(p, "malformed extended linear address record");
+            p->base = (uint32_t)((data[0] << 8) | data[1]) << 16;
+            return FT_OK;
+        case 0x03:
+        case 0x05:
+            if (byte_count != 4) return hex_error(p, "malformed start address record");
+            // CS:IP for 03, EIP for 05, recorded but not needed for programming
+            p->start_addr = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+            p->has_start = 1;
+            return FT_OK;
+        default:
+            return hex_error(p, "invalid record type");
+    }
+}
+
+void fileparser_hex_init(HexParser *p, const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx){
+    memset(p, 0, sizeof(*p));
+    p->filename = filename;
+    p->callback = callback;
+    p->ctx = ctx;
+    p->line = 1;
+    p->state = HEX_STATE_START;
+    p->require_eof = 1;
+}
+
+FT_STATUS fileparser_hex_feed(HexParser *p, const char *buf, size_t len){
+    for (size_t i = 0; i < len; i++){
+        unsigned char c = (unsigned char)buf[i];
+
+        switch (p->state){
+            case HEX_STATE_START:
+                if (c == ':'){
+                    p->state = HEX_STATE_RECORD;
+                    p->record_len = 0;
+                    p->expected_len = 5;
+                    p->nibble = 0;
+                    p->have_nibble = 0;
+                } else if (c == '\n'){
+                    p->line++;
+                } else if (c != '\r' && c != ' ' && c != '\t'){
+                    return hex_error(p, "missing start code");
+                }
+                break;
+
+            case HEX_STATE_RECORD: {
+                uint8_t v = hex_value[c];
+                if (v == 0xFF)
+                    return hex_error(p, c == '\n' || c == '\r' ? "truncated record" : "invalid hex digit");
+                if (!p->have_nibble){
+                    p->nibble = v;
+                    p->have_nibble = 1;
+                    break;
+                }
+                p->have_nibble = 0;
+                p->record[p->record_len++] = (uint8_t)((p->nibble << 4) | v);
+                // count, address, type, data, checksum
+                if (p->record_len == 1)
+                    p->expected_len = 5 + p->record[0];
+                if (p->record_len == p->expected_len){
+                    p->state = HEX_STATE_END;
+                    if (hex_process_record(p) != FT_OK)
+                        return p->status;
+                    if (p->state == HEX_STATE_DONE)
+                        return FT_OK;
+                }
+                break;
+            }
+
+            case HEX_STATE_END:
+                if (c == '\n'){
+                    p->line++;
+                    p->state = HEX_STATE_START;
+                } else if (c != '\r' && c != ' ' && c != '\t'){
+                    return hex_error(p, "record longer than byte count");
+                }
+                break;
+
+            case HEX_STATE_DONE:
+                return FT_OK;
+
+            default:
+                return p->status;
+        }
+    }
+    return FT_OK;
+}
+
+FT_STATUS fileparser_hex_finish(HexParser *p){
+    FT_STATUS ftStatus = p->status;
+    if (ftStatus == FT_OK){
+        if (p->state == HEX_STATE_RECORD)
+            ftStatus = hex_error(p, "truncated record");
+        else if (p->state != HEX_STATE_DONE && p->require_eof)
+            ftStatus = hex_error(p, "missing end of file record");
+    }
+    return ftStatus;
+}
+
+void fileparser_hex_free(HexParser *p){
+    free(p->ranges);
+    p->ranges = NULL;
+    p->range_count = p->range_cap = 0;
+}
+
+FT_STATUS fileparser_stream_intel_hex_ctx(const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx){
+    FILE *file = fopen(filename, "rb");
+    if (!file){
+        printf("could not open file '%s': ", filename);
+        return FT_IO_ERROR;
+    }
+    char *block = malloc(HEX_READ_BLOCK);
+    if (!block){
+        fclose(file);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    HexParser parser;
+    fileparser_hex_init(&parser, filename, callback, ctx);
+    FT_STATUS ftStatus = FT_OK;
+    size_t n;
+    while (ftStatus == FT_OK && parser.state != HEX_STATE_DONE
+           && (n = fread(block, 1, HEX_READ_BLOCK, file)) > 0){
+        ftStatus = fileparser_hex_feed(&parser, block, n);
+    }
+    if (ftStatus == FT_OK && ferror(file)){
+        parser.status = FT_IO_ERROR;
+    }
+    ftStatus = fileparser_hex_finish(&parser);
+    fileparser_hex_free(&parser);
+
+    free(block);
+    fclose(file);
+    return ftStatus;
+}
+
+static FT_STATUS plain_callback(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    return ((PlainCallback *)ctx)->callback(addr, data, len);
+}
+
 FT_STATUS fileparser_stream_intel_hex(const char *filename, FT_STATUS (*programmer_callback)(uint32_t addr, const uint8_t *data, uint8_t len)){
+    PlainCallback plain = { programmer_callback };
+    return fileparser_stream_intel_hex_ctx(filename, plain_callback, &plain);
+}
+
+static int is_hex_digit(char c){
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+FT_STATUS fileparser_stream_srec_ctx(const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx){
     FILE *file = fopen(filename, "r");
     if (!file){
         printf("could not open file '%s': ", filename);
         return FT_IO_ERROR;
     }
 
-    char line[MAX_LINE_LENGTH];
-    uint32_t ext_addr = 0;
-
-    while (fgets(line, MAX_LINE_LENGTH, file)){
-        // remove newline
-        line[strcspn(line, "\n\r")] = '\0';
+    char line[SREC_LINE_LENGTH];
+    uint8_t data[MAX_DATA_BYTES];
+    uint32_t data_records = 0;
 
-        // start code
-        if (line[0] != ':') continue;
+    while (fgets(line, SREC_LINE_LENGTH, file)){
+        // a line without newline before the end of the file did not fit
+        size_t end = strcspn(line, "\n");
+        if (line[end] != '\n' && !feof(file)){
+            fprintf(stderr, "line too long in file '%s' line: %.16s...\n", filename, line);
+            fclose(file);
+            return FT_INVALID_PARAMETER;
+        }
+        // strip blanks around the record like the Intel HEX parser, skip blank lines
+        while (end > 0 && isspace((unsigned char)line[end - 1])) end--;
+        line[end] = '\0';
+        size_t lead = strspn(line, " \t");
+        memmove(line, line + lead, end - lead + 1);
+        if (line[0] == '\0') continue;
+        if (line[0] != 'S'){
+            fprintf(stderr, "missing start code in file '%s' line: %s\n", filename, line);
+            fclose(file);
+            return FT_INVALID_PARAMETER;
+        }
 
-        // header bytes
-        uint8_t byte_count = hex_to_byte(&line[1]);
-        uint16_t address = (hex_to_byte(&line[3]) << 8) | hex_to_byte(&line[5]);
-        uint8_t data_type = hex_to_byte(&line[7]);
-        uint8_t checksum = hex_to_byte(&line[0x09 + (byte_count << 1)]);
-        
-        uint8_t calc_checksum = byte_count + (address >> 8) + (address & 0xFF) + data_type;
+        // S<type><count><address><data><checksum>
+        char type = line[1];
+        int addr_len;
+        switch (type){
+            case '0': case '1': case '5': case '9': addr_len = 2; break;
+            case '2': case '6': case '8':           addr_len = 3; break;
+            case '3': case '7':                     addr_len = 4; break;
+            default:
+                fprintf(stderr, "invalid record type in file '%s' line: %s\n", filename, line);
+                fclose(file);
+                return FT_INVALID_PARAMETER;
+        }
 
-        // data bytes
-        uint8_t data[MAX_DATA_BYTES];
-        for (int i = 0; i < byte_count; i++){
-            uint8_t val = hex_to_byte(&line[9 + i * 2]);
-            data[i] = hex_to_byte(&line[9 + i * 2]);
-            calc_checksum += val;
+        size_t line_len = strlen(line);
+        for (size_t i = 2; i < line_len; i++){
+            if (!is_hex_digit(line[i])) line_len = 0;
+        }
+        uint8_t count = (line_len >= 4) ? hex_to_byte((unsigned char *)&line[2]) : 0;
+        if (line_len < 4 || line_len != 4 + (size_t)count * 2 || count < addr_len + 1){
+            fprintf(stderr, "malformed record in file '%s' line: %s\n", filename, line);
+            fclose(file);
+            return FT_INVALID_PARAMETER;
         }
 
-        // verify checksum
-        calc_checksum = (~calc_checksum + 1) & 0xFF; // two's complement
-        if (calc_checksum != checksum){
+        // count covers address, data and checksum bytes
+        uint8_t sum = count;
+        uint32_t address = 0;
+        for (int i = 0; i < addr_len; i++){
+            uint8_t val = hex_to_byte((unsigned char *)&line[4 + i * 2]);
+            address = (address << 8) | val;
+            sum += val;
+        }
+        uint8_t data_len = count - addr_len - 1;
+        for (int i = 0; i < data_len; i++){
+            data[i] = hex_to_byte((unsigned char *)&line[4 + (addr_len + i) * 2]);
+            sum += data[i];
+        }
+        uint8_t checksum = hex_to_byte((unsigned char *)&line[line_len - 2]);
+        uint8_t calculated = (uint8_t)(~sum);
+        if (calculated != checksum){
             fprintf(stderr, "checksum error in file '%s' line: %s\n", filename, line);
-            fprintf(stderr, "calculated: %02X, expected: %02X\n", calc_checksum, checksum);
+            fprintf(stderr, "calculated: %02X, expected: %02X\n", calculated, checksum);
             fclose(file);
             return FT_INVALID_PARAMETER;
         }
-        
-        // process data
-        if (data_type == 0x00){
-            uint32_t full_addr = (ext_addr << 16) | address;
-            FT_STATUS ftStatus = programmer_callback(full_addr, data, byte_count);
+
+        // process data, the S0 header is ignored
+        if (type >= '1' && type <= '3'){
+            data_records++;
+            if (data_len == 0) continue;
+            FT_STATUS ftStatus = callback(ctx, address, data, data_len);
             if (ftStatus != FT_OK){
-                fprintf(stderr, "Failed to write to flash at address 0x%04X\n", address);
+                fprintf(stderr, "Failed to write to flash at address 0x%06X\n", address);
                 fclose(file);
                 return ftStatus;
             }
+        } else if (type == '5' || type == '6'){
+            // count of the S1/S2/S3 records so far, 16 or 24 bits wide
+            uint32_t mask = type == '5' ? 0xFFFF : 0xFFFFFF;
+            if (address != (data_records & mask)){
+                fprintf(stderr, "record count mismatch in file '%s': %u records, S%c says %u\n",
+                        filename, data_records, type, address);
+                fclose(file);
+                return FT_INVALID_PARAMETER;
+            }
+        } else if (type >= '7'){
+            break; // termination record
+        }
+    }
+    fclose(file);
+    return FT_OK;
+}
 
-        } else if (data_type == 0x01){
-            break; // EOF
-        } else if (data_type == 0x04){
-            ext_addr = (data[0] << 8) | data[1];
-        } 
+FT_STATUS fileparser_stream_binary_ctx(const char *filename, uint32_t base_addr, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx){
+    FILE *file = fopen(filename, "rb");
+    if (!file){
+        printf("could not open file '%s': ", filename);
+        return FT_IO_ERROR;
+    }
+
+    uint8_t data[BINARY_CHUNK];
+    uint32_t address = base_addr;
+    size_t n;
+    while ((n = fread(data, 1, BINARY_CHUNK, file)) > 0){
+        FT_STATUS ftStatus = callback(ctx, address, data, (uint8_t)n);
+        if (ftStatus != FT_OK){
+            fprintf(stderr, "Failed to write to flash at address 0x%06X\n", address);
+            fclose(file);
+            return ftStatus;
+        }
+        address += (uint32_t)n;
     }
     fclose(file);
     return FT_OK;
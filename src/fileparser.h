@@ -1,8 +1,8 @@
 /*!
  * @file fileparser.h
- * @brief Intel HEX file parser interface for streaming data to a programmer function.
+ * @brief Intel HEX, Motorola S-record and raw binary file parsers for streaming data to a programmer function.
  *
- * Defines function for Intel HEX files and streaming the parsed data to a user-defined
+ * Defines functions for parsing input files and streaming the parsed data to a user-defined
  * callback function.
  *
  * The callback function provided by the caller is responsible for writing data to 
@@ -19,17 +19,74 @@
 #include <stdint.h>
 #include "ftd2xx.h"
 
+/*!
+ * @enum hex_state_t
+ * @brief States of the incremental Intel HEX parser
+ */
+typedef enum {
+    HEX_STATE_START,  /*!< Waiting for a ':' start code */
+    HEX_STATE_RECORD, /*!< Reading the hex digits of a record */
+    HEX_STATE_END,    /*!< Record complete, waiting for the end of the line */
+    HEX_STATE_DONE,   /*!< End of file record seen */
+    HEX_STATE_ERROR   /*!< Parsing failed, see HexParser::status */
+} hex_state_t;
+
+/*!
+ * @struct HexRange
+ * @brief Address range [start, end) written by data records
+ */
+typedef struct {
+    uint32_t start; /*!< First address */
+    uint32_t end;   /*!< One past the last address */
+} HexRange;
+
+/*!
+ * @struct HexParser
+ * @brief State of an incremental Intel HEX parser
+ *
+ * Input may be fed in blocks of any size, records split across blocks are
+ * handled. The record being decoded is held in the parser, not on the stack.
+ */
+typedef struct {
+    const char *filename; /*!< File name used in error messages */
+    FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len); /*!< Receives each data record */
+    void *ctx;            /*!< Passed through to the callback */
+
+    hex_state_t state;    /*!< Current state */
+    FT_STATUS status;     /*!< First error, FT_OK while parsing succeeds */
+    uint32_t line;        /*!< Current line number */
+    uint8_t record[260];  /*!< Decoded record: count, address, type, data and checksum */
+    uint32_t record_len;  /*!< Bytes decoded into record */
+    uint32_t expected_len;/*!< Record length given by the byte count */
+    uint8_t nibble;       /*!< High nibble of the byte being decoded */
+    uint8_t have_nibble;  /*!< Set while nibble holds a digit */
+
+    uint32_t base;        /*!< Base address from the last 02 or 04 record */
+    uint32_t start_addr;  /*!< Start address from a 03 or 05 record */
+    int has_start;        /*!< Set if a start address record was seen */
+    int require_eof;      /*!< Fail on finish without an end of file record, set by init */
+
+    HexRange *ranges;     /*!< Sorted, merged ranges written so far */
+    uint32_t range_count; /*!< Number of ranges */
+    uint32_t range_cap;   /*!< Allocated ranges */
+} HexParser;
+
 
 /*!
  * @brief Parses an Intel HEX file and streams data to a porgrammer callback.
  *
- * This function reads an Intel HEX file line by line, validates the checksum,
- * and processes the record type.
+ * This function reads an Intel HEX file in a single pass, validates the length,
+ * hex digits and checksum of every record, and processes the record type.
  *
  * Supports:
  * - **Data records (0x00)**: Calls programmer callback with 32-bit address and data bytes.
- * - **End of File Records (0x01)**: Terminates parsing.
- * - **Extended Address Records (0x04)**: Updates upper 16-bytes of address for extended addressing.
+ * - **End of File Records (0x01)**: Terminates parsing, required.
+ * - **Extended Segment Address Records (0x02)**: Sets the base address to segment * 16.
+ * - **Start Segment Address Records (0x03)**: Validated and recorded, not programmed.
+ * - **Extended Linear Address Records (0x04)**: Updates upper 16-bits of address for extended addressing.
+ * - **Start Linear Address Records (0x05)**: Validated and recorded, not programmed.
+ *
+ * Data records writing an address already written by an earlier record are rejected.
  *
  * **Example usage:**
  * @code
@@ -57,11 +114,110 @@
  * @return FT_STATUS Status of the operation
  * - **FT_OK** if the file was parsed and written successfully
  * - **FT_IO_ERROR** if the file could not be opened
- * - **FT_INVALID_PARAMETER** if a checksum error occurs
+ * - **FT_INVALID_PARAMETER** if a record is malformed, overlaps earlier data or a checksum error occurs
  * - Any error code returned by the programmer callback
  *
  * @see programmer.h for implementations of callback.
  */
 FT_STATUS fileparser_stream_intel_hex(const char *filename, FT_STATUS (*programmer_callback)(uint32_t addr, const uint8_t *data, uint8_t len));
 
+/*!
+ * @brief Parses an Intel HEX file and streams data to a callback with a user context.
+ *
+ * Identical to @ref fileparser_stream_intel_hex, but passes a caller supplied
+ * context pointer to every callback invocation. Used when the callback needs
+ * state, such as a ring buffer or an in-memory image.
+ *
+ * @param[in] filename Path to the Intel HEX file to parse.
+ * @param[in] callback Callback function receiving each data record.
+ * @param[in] ctx Context pointer passed through to the callback.
+ *
+ * @return FT_STATUS Status of the operation, see @ref fileparser_stream_intel_hex
+ */
+FT_STATUS fileparser_stream_intel_hex_ctx(const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx);
+
+/*!
+ * @brief Initializes an incremental Intel HEX parser.
+ *
+ * @param[out] p Parser to initialize
+ * @param[in] filename File name used in error messages, may be NULL
+ * @param[in] callback Callback function receiving each data record
+ * @param[in] ctx Context pointer passed through to the callback
+ */
+void fileparser_hex_init(HexParser *p, const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx);
+
+/*!
+ * @brief Feeds a block of Intel HEX text to a parser.
+ *
+ * Input after the end of file record is ignored.
+ *
+ * @param[in,out] p Parser
+ * @param[in] buf Text to parse
+ * @param[in] len Number of characters in buf
+ * @return FT_STATUS FT_OK, or the first error, see @ref fileparser_stream_intel_hex
+ */
+FT_STATUS fileparser_hex_feed(HexParser *p, const char *buf, size_t len);
+
+/*!
+ * @brief Completes parsing.
+ *
+ * The written address ranges stay available until @ref fileparser_hex_free.
+ *
+ * @param[in,out] p Parser
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if the last record is truncated or
+ *         the end of file record is missing, or the first error seen while parsing
+ */
+FT_STATUS fileparser_hex_finish(HexParser *p);
+
+/*!
+ * @brief Releases parser memory.
+ *
+ * @param[in,out] p Parser
+ */
+void fileparser_hex_free(HexParser *p);
+
+/*!
+ * @brief Parses a Motorola S-record file and streams data to a callback with a user context.
+ *
+ * Validates the byte count against the line length and the checksum of every record.
+ * Blank lines are skipped, any other line that is not a record is an error.
+ *
+ * Supports:
+ * - **S1/S2/S3 data records**: Calls callback with 16/24/32-bit address and data bytes.
+ * - **S7/S8/S9 termination records**: Terminates parsing.
+ * - **S5/S6 count records**: Checked against the number of S1/S2/S3 records before them.
+ * - **S0 header records**: Validated and ignored.
+ *
+ * Accepts S19, S28 and S37 files.
+ *
+ * @param[in] filename Path to the S-record file to parse.
+ * @param[in] callback Callback function receiving each data record.
+ * @param[in] ctx Context pointer passed through to the callback.
+ *
+ * @return FT_STATUS Status of the operation
+ * - **FT_OK** if the file was parsed and written successfully
+ * - **FT_IO_ERROR** if the file could not be opened
+ * - **FT_INVALID_PARAMETER** if a line is too long or not a record, a record is malformed,
+ *   a checksum error occurs or a record count does not match
+ * - Any error code returned by the callback
+ */
+FT_STATUS fileparser_stream_srec_ctx(const char *filename, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx);
+
+/*!
+ * @brief Streams a raw binary file to a callback with a user context.
+ *
+ * The file contents are delivered in order as consecutive blocks starting at base_addr.
+ *
+ * @param[in] filename Path to the binary file.
+ * @param[in] base_addr Address of the first byte of the file.
+ * @param[in] callback Callback function receiving each block.
+ * @param[in] ctx Context pointer passed through to the callback.
+ *
+ * @return FT_STATUS Status of the operation
+ * - **FT_OK** if the file was read and written successfully
+ * - **FT_IO_ERROR** if the file could not be opened
+ * - Any error code returned by the callback
+ */
+FT_STATUS fileparser_stream_binary_ctx(const char *filename, uint32_t base_addr, FT_STATUS (*callback)(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len), void *ctx);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "flash_compiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "platform.h"
+#include "image_cache.h"
+
+#define COMPILED_MAGIC   0x50504D41 // "AMPP"
+#define COMPILED_VERSION 4 // 2: pages carry their program time delay and are sent in batches, 3: learned delay, polled prefix,
+                           // 4: datasheet delay, the learned one is patched in when sent
+
+/*!
+ * @struct CompiledHeader
+ * @brief Header of a compiled program, in memory and on disk
+ *
+ * Followed by the steps and the MPSSE buffers in that order.
+ */
+typedef struct {
+    uint32_t magic;         /*!< COMPILED_MAGIC */
+    uint32_t version;       /*!< COMPILED_VERSION */
+    uint64_t image_hash;    /*!< FNV-1a of the image size, segments and page CRCs */
+    uint32_t jedec_id;      /*!< FlashPart::jedec_id of the target part */
+    uint32_t chip_select;   /*!< spi_chip_select_t of the target chip */
+    uint32_t delay_us;      /*!< Program time delay of every page, the datasheet maximum */
+    uint32_t step_count;    /*!< FlashCompiled::step_count */
+    uint32_t pages_skipped; /*!< FlashCompiled::pages_skipped */
+    uint32_t bytes_skipped; /*!< FlashCompiled::bytes_skipped */
+    uint32_t cmd_bytes;     /*!< Length of all MPSSE buffers */
+} CompiledHeader;
+
+
+static uint64_t compile_fnv(uint64_t h, const void *data, size_t len){
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++){
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// the page CRCs stand in for the data, hashing them is 256 times cheaper
+static uint64_t compile_hash(const Image *img){
+    uint64_t h = 0xCBF29CE484222325ull;
+    h = compile_fnv(h, &img->size, sizeof(img->size));
+    h = compile_fnv(h, img->segments, (size_t)img->segment_count * sizeof(ImageSegment));
+    return compile_fnv(h, img->page_crc, (size_t)img->page_count * sizeof(uint32_t));
+}
+
+// the datasheet program time only changes with the part, the shorter learned delay is patched in by flash_compiled_batch
+static uint32_t compile_delay_us(const FlashPart *part){
+    return part->program_max_ms * 1000;
+}
+
+static size_t compiled_size(const CompiledHeader *hdr){
+    return sizeof(CompiledHeader) + (size_t)hdr->step_count * sizeof(FlashStep) + hdr->cmd_bytes;
+}
+
+// programming 0xFF never changes flash contents, such pages are left out
+static int compile_erased(const uint8_t *data, uint32_t len){
+    for (uint32_t i = 0; i < len; i++){
+        if (data[i] != 0xFF) return 0;
+    }
+    return 1;
+}
+
+// splits the image into pages, counts them when steps is NULL, compiles them otherwise
+static void compile_walk(const Image *img, const FlashPart *part, spi_chip_select_t chipSelect,
+                         CompiledHeader *hdr, FlashStep *steps, uint8_t *cmd){
+    uint32_t page = part->page_size;
+    // a page split between two segments is counted once
+    uint32_t skip_page = 0;
+    for (uint32_t i = 0; i < img->segment_count; i++){
+        uint32_t addr = img->segments[i].addr;
+        uint32_t end = addr + img->segments[i].len;
+        while (addr < end){
+            uint32_t chunk = page - (addr % page);
+            if (chunk > end - addr) chunk = end - addr;
+            const uint8_t *data = img->data + addr;
+
+            if (compile_erased(data, chunk)){
+                if (addr / page + 1 != skip_page){
+                    skip_page = addr / page + 1;
+                    hdr->pages_skipped++;
+                }
+                hdr->bytes_skipped += chunk;
+            } else {
+                size_t len;
+                if (steps){
+                    uint32_t poll_len;
+                    len = flash_compile_page(part, chipSelect, addr, data, chunk, hdr->delay_us, cmd + hdr->cmd_bytes, &poll_len);
+                    steps[hdr->step_count] = (FlashStep){addr, chunk, hdr->cmd_bytes, (uint32_t)len, poll_len};
+                } else {
+                    len = flash_compile_page_len(part, chunk, hdr->delay_us);
+                }
+                hdr->step_count++;
+                hdr->cmd_bytes += (uint32_t)len;
+            }
+            addr += chunk;
+        }
+    }
+}
+
+static void compiled_attach(FlashCompiled *program, const uint8_t *base){
+    const CompiledHeader *hdr = (const CompiledHeader *)base;
+    program->step_count = hdr->step_count;
+    program->pages_skipped = hdr->pages_skipped;
+    program->bytes_skipped = hdr->bytes_skipped;
+    program->delay_us = hdr->delay_us;
+    program->steps = (const FlashStep *)(base + sizeof(CompiledHeader));
+    program->cmd = base + sizeof(CompiledHeader) + (size_t)hdr->step_count * sizeof(FlashStep);
+}
+
+static FT_STATUS compiled_map(FlashCompiled *program, const char *path, uint64_t hash,
+                              const FlashPart *part, spi_chip_select_t chipSelect){
+    PlatformMapping *m = calloc(1, sizeof(PlatformMapping));
+    if (!m) return FT_INSUFFICIENT_RESOURCES;
+    if (platform_map_file(path, m) != FT_OK){
+        free(m);
+        return FT_IO_ERROR;
+    }
+
+    const CompiledHeader *hdr = (const CompiledHeader *)m->view;
+    if (m->size < sizeof(CompiledHeader) || hdr->magic != COMPILED_MAGIC || hdr->version != COMPILED_VERSION
+        || hdr->image_hash != hash || hdr->jedec_id != part->jedec_id || hdr->chip_select != (uint32_t)chipSelect
+        || hdr->delay_us != compile_delay_us(part) || m->size != compiled_size(hdr)){
+        platform_unmap_file(m);
+        free(m);
+        return FT_IO_ERROR;
+    }
+    compiled_attach(program, (const uint8_t *)m->view);
+    program->backing = m;
+    return FT_OK;
+}
+
+// writes to a temporary file so readers never see a partial entry
+static FT_STATUS compiled_save(const FlashCompiled *program, const char *path){
+    char tmp_path[IMAGE_CACHE_PATH_LEN + 4];
+    const CompiledHeader *hdr = (const CompiledHeader *)program->block;
+    size_t size = compiled_size(hdr);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) return FT_IO_ERROR;
+    int ok = fwrite(program->block, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    if (ok){
+        remove(path);
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok){
+        remove(tmp_path);
+        return FT_IO_ERROR;
+    }
+    return FT_OK;
+}
+
+
+FT_STATUS flash_compile(FlashCompiled *program, const Image *img, const FlashPart *part, spi_chip_select_t chipSelect){
+    CompiledHeader hdr;
+
+    memset(program, 0, sizeof(*program));
+    if (img->size > part->capacity || part->page_size == 0)
+        return FT_INVALID_PARAMETER;
+
+    // size pass, then compile into one block laid out like the cache file
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.delay_us = compile_delay_us(part);
+    compile_walk(img, part, chipSelect, &hdr, NULL, NULL);
+    uint8_t *block = malloc(compiled_size(&hdr));
+    if (!block) return FT_INSUFFICIENT_RESOURCES;
+
+    CompiledHeader *out = (CompiledHeader *)block;
+    memset(out, 0, sizeof(*out));
+    out->magic = COMPILED_MAGIC;
+    out->version = COMPILED_VERSION;
+    out->image_hash = compile_hash(img);
+    out->jedec_id = part->jedec_id;
+    out->chip_select = (uint32_t)chipSelect;
+    out->delay_us = hdr.delay_us;
+    FlashStep *steps = (FlashStep *)(block + sizeof(CompiledHeader));
+    compile_walk(img, part, chipSelect, out, steps, (uint8_t *)(steps + hdr.step_count));
+
+    program->block = block;
+    compiled_attach(program, block);
+    return FT_OK;
+}
+
+FT_STATUS flash_compiled_load(FlashCompiled *program, const Image *img, const FlashPart *part, spi_chip_select_t chipSelect,
+                              const char *filename, const char *cache_dir, int no_cache, int *hit){
+    char path[IMAGE_CACHE_PATH_LEN];
+    // ".cs" and the chip select number before the extension
+    char ext[sizeof(".cs") + 11 + sizeof(FLASH_COMPILED_EXT)];
+
+    if (hit) *hit = 0;
+    memset(program, 0, sizeof(*program));
+    if (no_cache)
+        return flash_compile(program, img, part, chipSelect);
+
+    snprintf(ext, sizeof(ext), ".cs%d%s", (int)(chipSelect >> 2) + 1, FLASH_COMPILED_EXT);
+    RETURN_IF_ERROR(image_cache_path(path, filename, cache_dir, ext));
+    if (compiled_map(program, path, compile_hash(img), part, chipSelect) == FT_OK){
+        if (hit) *hit = 1;
+        return FT_OK;
+    }
+
+    // miss, compile and refresh the entry
+    RETURN_IF_ERROR(flash_compile(program, img, part, chipSelect));
+    if (compiled_save(program, path) != FT_OK)
+        LOG_WARN("could not write compiled program '%s'\n", path);
+    return FT_OK;
+}
+
+uint32_t flash_compiled_batch(const FlashCompiled *program, uint32_t first, uint32_t pages, uint32_t delay_us, uint8_t *cmd){
+    const FlashStep *batch = &program->steps[first];
+    // the buffers of consecutive steps are stored back to back
+    uint32_t len = batch[pages - 1].offset + batch[pages - 1].cmd_len - batch[0].offset;
+    memcpy(cmd, program->cmd + batch[0].offset, len);
+    if (delay_us >= program->delay_us)
+        return len;
+    for (uint32_t k = 0; k < pages; k++)
+        flash_page_set_delay(cmd + batch[k].offset - batch[0].offset, batch[k].poll_len, delay_us);
+    return len;
+}
+
+void flash_compiled_free(FlashCompiled *program){
+    PlatformMapping *m = (PlatformMapping *)program->backing;
+    if (m){
+        platform_unmap_file(m);
+        free(m);
+    }
+    free(program->block);
+    memset(program, 0, sizeof(*program));
+}
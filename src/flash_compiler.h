@@ -0,0 +1,125 @@
+/*! @file flash_compiler.h
+ *  @brief Ahead of time compilation of flash images into MPSSE command streams.
+ *
+ * The SPI bytes that program an image are the same for every board: per page
+ * a write enable, a status read, the page program header and data, a delay
+ * for the program time and a status read. The compiler builds these MPSSE
+ * buffers once per image, part and chip select. Program jobs then send them
+ * as they are, @ref FLASH_BATCH_PAGES pages per round trip, with no per page
+ * formatting on the programming hot path.
+ *
+ * @details
+ * Compiled programs are cached as `<source>.cs<N>.ampp` next to the image
+ * cache entry (see @ref image_cache.h) and mapped read-only on later runs.
+ * An entry is keyed by a hash of the image segments and page CRCs, the
+ * JEDEC ID of the part and the chip select, and is rebuilt when any of them
+ * changes. Pages are compiled with the datasheet program time as their
+ * delay. The learned delay of @ref flash_program_delay_us, which shifts as
+ * program times are recorded, is written into a copy of each batch by
+ * @ref flash_compiled_batch when it is sent, so it never invalidates the
+ * entry. Erased (all 0xFF) pages are left out of the program.
+ *
+ * **Example usage:**
+ * @code
+ * FlashCompiled program;
+ * if (flash_compiled_load(&program, &image, part, SPI_CS_2, "flash_2A.hex", NULL, 0, NULL) == FT_OK){
+ *     for (uint32_t i = 0; i < program.step_count; i++)
+ *         programmer_flash_run_polled(program.steps[i].address, program.cmd + program.steps[i].offset, program.steps[i].poll_len);
+ *     flash_compiled_free(&program);
+ * }
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef FLASH_COMPILER_H
+#define FLASH_COMPILER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "ftd2xx.h"
+#include "image.h"
+#include "spi_flash.h"
+
+//! File extension of compiled programs, after the chip select tag
+#define FLASH_COMPILED_EXT ".ampp"
+
+/*!
+ * @struct FlashStep
+ * @brief One compiled page program
+ */
+typedef struct {
+    uint32_t address;  /*!< First flash address written */
+    uint32_t length;   /*!< Data bytes written */
+    uint32_t offset;   /*!< Offset of the MPSSE buffer in FlashCompiled::cmd */
+    uint32_t cmd_len;  /*!< Length of the MPSSE buffer */
+    uint32_t poll_len; /*!< Length of the MPSSE buffer up to the program time delay, see @ref flash_run_polled */
+} FlashStep;
+
+/*!
+ * @struct FlashCompiled
+ * @brief A compiled image, in memory or mapped from its cache file
+ */
+typedef struct {
+    uint32_t step_count;      /*!< Number of steps */
+    const FlashStep *steps;   /*!< Steps in address order */
+    const uint8_t *cmd;       /*!< MPSSE buffers of all steps */
+    uint32_t pages_skipped;   /*!< Erased pages left out */
+    uint32_t bytes_skipped;   /*!< Data bytes of the pages left out */
+    uint32_t delay_us;        /*!< Program time delay the pages were compiled with, the datasheet maximum of the part */
+    void *block;              /*!< Allocated block of a program compiled in memory */
+    void *backing;            /*!< Mapping of a program loaded from its cache file */
+} FlashCompiled;
+
+/*!
+ * @brief Compiles an image for a part on a chip select.
+ *
+ * @param[out] program Compiled program, release with @ref flash_compiled_free
+ * @param[in] img Finalized image
+ * @param[in] part Descriptor of the target part
+ * @param[in] chipSelect Chip select of the target chip
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if the image does not fit the part,
+ *         FT_INSUFFICIENT_RESOURCES on allocation failure
+ */
+FT_STATUS flash_compile(FlashCompiled *program, const Image *img, const FlashPart *part, spi_chip_select_t chipSelect);
+
+/*!
+ * @brief Loads a compiled program from the cache, compiling and caching it on a miss.
+ *
+ * Failing to write the cache file is not an error, the compiled program is still returned.
+ *
+ * @param[out] program Compiled program, release with @ref flash_compiled_free
+ * @param[in] img Finalized image of filename
+ * @param[in] part Descriptor of the target part
+ * @param[in] chipSelect Chip select of the target chip
+ * @param[in] filename Path to the source file of the image
+ * @param[in] cache_dir Directory for cache files, NULL to store them next to the source
+ * @param[in] no_cache Set to compile in memory without reading or writing the cache
+ * @param[out] hit Optional, set to 1 if the program was served from the cache
+ * @return FT_STATUS Status of the operation, see @ref flash_compile
+ */
+FT_STATUS flash_compiled_load(FlashCompiled *program, const Image *img, const FlashPart *part, spi_chip_select_t chipSelect,
+                              const char *filename, const char *cache_dir, int no_cache, int *hit);
+
+/*!
+ * @brief Copies the buffers of consecutive steps into one batch with a shorter program time delay.
+ *
+ * @param[in] program Compiled program
+ * @param[in] first Index of the first step
+ * @param[in] pages Number of steps, at most @ref FLASH_BATCH_PAGES
+ * @param[in] delay_us Program time delay of every page, usually @ref flash_program_delay_us,
+ *            longer delays than the compiled one are cut to it
+ * @param[out] cmd Buffer of at least @ref FLASH_CMD_MAX_LEN bytes
+ * @return uint32_t Length of the batch in cmd
+ */
+uint32_t flash_compiled_batch(const FlashCompiled *program, uint32_t first, uint32_t pages, uint32_t delay_us, uint8_t *cmd);
+
+/*!
+ * @brief Releases a compiled program. Safe on a zeroed or already released program.
+ *
+ * @param[in,out] program Program to release
+ */
+void flash_compiled_free(FlashCompiled *program);
+
+#endif
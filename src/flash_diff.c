@@ -0,0 +1,84 @@
+#include "flash_diff.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+flash_diff_t flash_diff_classify(const uint8_t *current, const uint8_t *target, uint32_t len){
+    // changed collects every differing bit, raised the bits that would have to go from 0 back to 1
+    uint64_t changed = 0;
+    uint64_t raised = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= len; i += 8){
+        uint64_t c, t;
+        memcpy(&c, current + i, 8);
+        memcpy(&t, target + i, 8);
+        changed |= c ^ t;
+        raised |= t & ~c;
+    }
+    for (; i < len; i++){
+        changed |= (uint64_t)(current[i] ^ target[i]);
+        raised |= (uint64_t)(target[i] & (uint8_t)~current[i]);
+    }
+    if (raised) return FLASH_DIFF_ERASE;
+    return changed ? FLASH_DIFF_PROGRAM : FLASH_DIFF_SAME;
+}
+
+FT_STATUS flash_diff_init(FlashDiff *diff, uint32_t size, uint32_t page_size){
+    flash_diff_free(diff);
+    if (page_size == 0) return FT_INVALID_PARAMETER;
+    diff->page_size = page_size;
+    diff->page_count = (size + page_size - 1) / page_size;
+    diff->page_class = calloc(diff->page_count ? diff->page_count : 1, 1);
+    return diff->page_class ? FT_OK : FT_INSUFFICIENT_RESOURCES;
+}
+
+void flash_diff_mark(FlashDiff *diff, uint32_t address, flash_diff_t cls){
+    uint32_t page = address / diff->page_size;
+    if (page < diff->page_count && diff->page_class[page] < cls)
+        diff->page_class[page] = (uint8_t)cls;
+}
+
+void flash_diff_count(FlashDiff *diff){
+    diff->same = diff->programmable = diff->erase = 0;
+    for (uint32_t i = 0; i < diff->page_count; i++){
+        switch (diff->page_class[i]){
+            case FLASH_DIFF_SAME:    diff->same++; break;
+            case FLASH_DIFF_PROGRAM: diff->programmable++; break;
+            case FLASH_DIFF_ERASE:   diff->erase++; break;
+            default: break;
+        }
+    }
+}
+
+int flash_diff_sector_needs_erase(const FlashDiff *diff, uint32_t address, uint32_t size){
+    uint32_t first = address / diff->page_size;
+    uint32_t end = first + size / diff->page_size;
+    for (uint32_t i = first; i < end && i < diff->page_count; i++){
+        if (diff->page_class[i] == FLASH_DIFF_ERASE) return 1;
+    }
+    return 0;
+}
+
+void flash_diff_erased(FlashDiff *diff, uint32_t address, uint32_t size){
+    uint32_t first = address / diff->page_size;
+    uint32_t end = first + size / diff->page_size;
+    // pages the image does not set stay erased
+    for (uint32_t i = first; i < end && i < diff->page_count; i++){
+        if (diff->page_class[i] != FLASH_DIFF_NONE)
+            diff->page_class[i] = FLASH_DIFF_ERASE;
+    }
+    diff->sectors++;
+}
+
+int flash_diff_needs_program(const FlashDiff *diff, uint32_t address){
+    uint32_t page = address / diff->page_size;
+    // pages outside the plan were never read, program them to be safe
+    if (page >= diff->page_count) return 1;
+    return diff->page_class[page] >= FLASH_DIFF_PROGRAM;
+}
+
+void flash_diff_free(FlashDiff *diff){
+    free(diff->page_class);
+    memset(diff, 0, sizeof(*diff));
+}
@@ -0,0 +1,142 @@
+/*! @file flash_diff.h
+ *  @brief Plans erase-free reprogramming from the current flash contents.
+ *
+ * A NOR page program can only clear bits. A page whose current contents
+ * already have a 1 wherever the new data has one can be programmed over
+ * without an erase, and a page that already holds the new data needs
+ * nothing at all. Boards that are reprogrammed with a small change, or
+ * whose flash is still blank, mostly consist of such pages.
+ *
+ * @details
+ * The plan keeps one class per program page of the image, the worst class
+ * of all image data in the page. A sector holding any page that needs an
+ * erase is erased as a whole, which makes every image page in it a page
+ * to program. Only the image data is compared, bytes the image does not
+ * set are left as they are unless their sector is erased.
+ *
+ * **Example usage:**
+ * @code
+ * FlashDiff diff = {0};
+ * flash_diff_init(&diff, image.size, part->page_size);
+ * flash_read(handle, part, addr, current, len);
+ * flash_diff_mark(&diff, addr, flash_diff_classify(current, image.data + addr, len));
+ * ...
+ * if (flash_diff_sector_needs_erase(&diff, sector, 0x1000)){
+ *     flash_erase(handle, part, sector, 0x1000);
+ *     flash_diff_erased(&diff, sector, 0x1000);
+ * }
+ * if (flash_diff_needs_program(&diff, addr))
+ *     flash_program(handle, part, arena, addr, image.data + addr, len);
+ * flash_diff_free(&diff);
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef FLASH_DIFF_H
+#define FLASH_DIFF_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+
+/*!
+ * @enum flash_diff_t
+ * @brief Class of a page, in increasing order of work
+ */
+typedef enum {
+    FLASH_DIFF_NONE,    /*!< The image sets no byte of the page */
+    FLASH_DIFF_SAME,    /*!< The page already holds the image data */
+    FLASH_DIFF_PROGRAM, /*!< The image data only clears bits, programmed without an erase */
+    FLASH_DIFF_ERASE    /*!< The image data sets a cleared bit, the sector is erased first */
+} flash_diff_t;
+
+/*!
+ * @struct FlashDiff
+ * @brief Class of every page of an image on one chip
+ */
+typedef struct {
+    uint8_t *page_class;   /*!< flash_diff_t of every page */
+    uint32_t page_count;   /*!< Pages covered */
+    uint32_t page_size;    /*!< Program page size of the part */
+    uint32_t same;         /*!< Pages classified FLASH_DIFF_SAME */
+    uint32_t programmable; /*!< Pages classified FLASH_DIFF_PROGRAM */
+    uint32_t erase;        /*!< Pages classified FLASH_DIFF_ERASE */
+    uint32_t sectors;      /*!< Sectors erased */
+} FlashDiff;
+
+/*!
+ * @brief Classifies new data against the current flash contents.
+ *
+ * Compares eight bytes at a time without branching on the data, so the
+ * compiler can vectorize the loop.
+ *
+ * @param[in] current Bytes read from the flash
+ * @param[in] target Bytes to program
+ * @param[in] len Number of bytes
+ * @return flash_diff_t FLASH_DIFF_SAME, FLASH_DIFF_PROGRAM or FLASH_DIFF_ERASE
+ */
+flash_diff_t flash_diff_classify(const uint8_t *current, const uint8_t *target, uint32_t len);
+
+/*!
+ * @brief Starts an empty plan, releasing a previous one.
+ *
+ * @param[in,out] diff Plan, zeroed before its first use
+ * @param[in] size Bytes covered, the image size
+ * @param[in] page_size Program page size of the part
+ * @return FT_STATUS FT_OK, FT_INSUFFICIENT_RESOURCES on allocation failure
+ */
+FT_STATUS flash_diff_init(FlashDiff *diff, uint32_t size, uint32_t page_size);
+
+/*!
+ * @brief Records the class of data within one page, keeping the worst class of the page.
+ *
+ * @param[in,out] diff Plan
+ * @param[in] address Address of the data
+ * @param[in] cls Class from @ref flash_diff_classify
+ */
+void flash_diff_mark(FlashDiff *diff, uint32_t address, flash_diff_t cls);
+
+/*!
+ * @brief Counts the pages of every class into the plan, call once all pages are marked.
+ *
+ * @param[in,out] diff Plan
+ */
+void flash_diff_count(FlashDiff *diff);
+
+/*!
+ * @brief Checks whether a sector holds a page that needs an erase.
+ *
+ * @param[in] diff Plan
+ * @param[in] address Start of the sector
+ * @param[in] size Sector size, a multiple of the page size
+ * @return int 1 if the sector must be erased, 0 otherwise
+ */
+int flash_diff_sector_needs_erase(const FlashDiff *diff, uint32_t address, uint32_t size);
+
+/*!
+ * @brief Records an erased sector, its image pages are programmed afterwards.
+ *
+ * @param[in,out] diff Plan
+ * @param[in] address Start of the sector
+ * @param[in] size Sector size
+ */
+void flash_diff_erased(FlashDiff *diff, uint32_t address, uint32_t size);
+
+/*!
+ * @brief Checks whether the page holding an address must be programmed.
+ *
+ * @param[in] diff Plan
+ * @param[in] address Any address in the page
+ * @return int 1 if the page is programmed, 0 if it already holds its data
+ */
+int flash_diff_needs_program(const FlashDiff *diff, uint32_t address);
+
+/*!
+ * @brief Releases a plan. Safe on a zeroed or already released plan.
+ *
+ * @param[in,out] diff Plan
+ */
+void flash_diff_free(FlashDiff *diff);
+
+#endif
@@ -0,0 +1,201 @@
+#include "flash_timing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "platform.h"
+
+#define FLASH_TIMING_NAME_LEN 24
+#define FLASH_TIMING_LINE_LEN (96 + FLASH_TIMING_SAMPLES * 11)
+
+/*!
+ * @struct TimingModel
+ * @brief Ring of the recent times of one part and operation
+ */
+typedef struct {
+    char part[FLASH_TIMING_NAME_LEN]; /*!< Part name */
+    char op[FLASH_TIMING_NAME_LEN];   /*!< Operation name */
+    uint32_t samples[FLASH_TIMING_SAMPLES]; /*!< Times in microseconds */
+    uint32_t count;                   /*!< Valid samples */
+    uint32_t next;                    /*!< Slot the next time is written to */
+} TimingModel;
+
+static TimingModel models[FLASH_TIMING_MODELS];
+static uint32_t model_count;
+//! Serial number the models are saved under
+static char fixture_id[32];
+static PlatformMutex lock;
+static int lock_ready;
+
+
+// model of a part and operation, created if missing and create is set, NULL if the table is full
+static TimingModel *timing_find(const char *part, const char *op, int create){
+    for (uint32_t i = 0; i < model_count; i++){
+        if (strcmp(models[i].part, part) == 0 && strcmp(models[i].op, op) == 0)
+            return &models[i];
+    }
+    if (!create || model_count == FLASH_TIMING_MODELS)
+        return NULL;
+    TimingModel *m = &models[model_count++];
+    memset(m, 0, sizeof(*m));
+    snprintf(m->part, sizeof(m->part), "%s", part);
+    snprintf(m->op, sizeof(m->op), "%s", op);
+    return m;
+}
+
+static void timing_add(TimingModel *m, uint32_t us){
+    m->samples[m->next] = us;
+    m->next = (m->next + 1) % FLASH_TIMING_SAMPLES;
+    if (m->count < FLASH_TIMING_SAMPLES) m->count++;
+}
+
+// nearest rank percentile of sorted samples
+static uint32_t timing_rank(const uint32_t *sorted, uint32_t count, uint32_t percent){
+    uint32_t rank = (percent * count + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static void timing_percentiles(const TimingModel *m, FlashTimingEstimate *est){
+    uint32_t sorted[FLASH_TIMING_SAMPLES];
+    memset(est, 0, sizeof(*est));
+    if (m->count == 0) return;
+
+    // insertion sort, a model holds a few dozen times only
+    for (uint32_t i = 0; i < m->count; i++){
+        uint32_t v = m->samples[i];
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    est->count = m->count;
+    est->p10_us = timing_rank(sorted, m->count, 10);
+    est->p50_us = timing_rank(sorted, m->count, 50);
+    est->p90_us = timing_rank(sorted, m->count, 90);
+    est->p99_us = timing_rank(sorted, m->count, 99);
+    est->max_us = sorted[m->count - 1];
+}
+
+// parses "<serial> <part> <op> <count> <us>..." into a model of the fixture, 0 for other fixtures and bad lines
+static int timing_parse(const char *line, TimingModel *m){
+    char serial[32];
+    unsigned count, us;
+    int used;
+    memset(m, 0, sizeof(*m));
+    if (sscanf(line, "%31s %23s %23s %u%n", serial, m->part, m->op, &count, &used) != 4
+        || strcmp(serial, fixture_id) != 0)
+        return 0;
+    line += used;
+    for (unsigned i = 0; i < count && i < FLASH_TIMING_SAMPLES; i++){
+        if (sscanf(line, "%u%n", &us, &used) != 1)
+            return 0;
+        line += used;
+        timing_add(m, us);
+    }
+    return m->count > 0;
+}
+
+
+FT_STATUS flash_timing_load(const char *path, const char *fixture){
+    char line[FLASH_TIMING_LINE_LEN];
+    if (!lock_ready){
+        platform_mutex_init(&lock);
+        lock_ready = 1;
+    }
+
+    platform_mutex_lock(&lock);
+    model_count = 0;
+    snprintf(fixture_id, sizeof(fixture_id), "%s", fixture[0] ? fixture : "-");
+    FILE *file = fopen(path, "r");
+    if (!file){
+        platform_mutex_unlock(&lock);
+        return FT_IO_ERROR;
+    }
+    while (fgets(line, sizeof(line), file) && model_count < FLASH_TIMING_MODELS){
+        TimingModel parsed;
+        if (!timing_parse(line, &parsed))
+            continue;
+        // a later line of the same model replaces an earlier one
+        TimingModel *m = timing_find(parsed.part, parsed.op, 1);
+        *m = parsed;
+    }
+    fclose(file);
+    platform_mutex_unlock(&lock);
+    return FT_OK;
+}
+
+// copies the entries of other fixtures to a temporary file so readers never see a partial cache
+FT_STATUS flash_timing_save(const char *path){
+    char tmp_path[256];
+    char line[FLASH_TIMING_LINE_LEN];
+    if (!lock_ready) return FT_OTHER_ERROR;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+        return FT_INVALID_PARAMETER;
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return FT_IO_ERROR;
+
+    FILE *in = fopen(path, "r");
+    if (in){
+        while (fgets(line, sizeof(line), in)){
+            char lineSerial[32];
+            if (sscanf(line, "%31s", lineSerial) == 1 && strcmp(lineSerial, fixture_id) == 0)
+                continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+
+    platform_mutex_lock(&lock);
+    for (uint32_t i = 0; i < model_count; i++){
+        const TimingModel *m = &models[i];
+        fprintf(out, "%s %s %s %u", fixture_id, m->part, m->op, m->count);
+        // oldest first, so a reload keeps the order the ring drops them in
+        for (uint32_t k = 0; k < m->count; k++)
+            fprintf(out, " %u", m->samples[(m->next + FLASH_TIMING_SAMPLES - m->count + k) % FLASH_TIMING_SAMPLES]);
+        fputc('\n', out);
+    }
+    platform_mutex_unlock(&lock);
+
+    int ok = fclose(out) == 0;
+    if (ok){
+        remove(path);
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok){
+        remove(tmp_path);
+        return FT_IO_ERROR;
+    }
+    return FT_OK;
+}
+
+void flash_timing_record(const char *part, const char *op, uint32_t us){
+    if (!lock_ready) return;
+    platform_mutex_lock(&lock);
+    TimingModel *m = timing_find(part, op, 1);
+    if (m) timing_add(m, us);
+    platform_mutex_unlock(&lock);
+}
+
+int flash_timing_estimate(const char *part, const char *op, FlashTimingEstimate *est){
+    memset(est, 0, sizeof(*est));
+    if (!lock_ready) return 0;
+    platform_mutex_lock(&lock);
+    const TimingModel *m = timing_find(part, op, 0);
+    if (m) timing_percentiles(m, est);
+    platform_mutex_unlock(&lock);
+    return est->count >= FLASH_TIMING_MIN_SAMPLES;
+}
+
+int flash_timing_get(uint32_t index, const char **part, const char **op, FlashTimingEstimate *est){
+    if (!lock_ready) return 0;
+    platform_mutex_lock(&lock);
+    int found = index < model_count;
+    if (found){
+        *part = models[index].part;
+        *op = models[index].op;
+        timing_percentiles(&models[index], est);
+    }
+    platform_mutex_unlock(&lock);
+    return found;
+}
@@ -0,0 +1,118 @@
+/*! @file flash_timing.h
+ *  @brief Learns how long page programs and erases take on a fixture.
+ *
+ * Datasheet maximums are several times what a part takes in practice, and
+ * the real times depend on the part, its lot and the supply of the fixture.
+ * Every completed program or erase that was polled is recorded here, and the
+ * recent times of each part and operation give percentile estimates that
+ * decide when the first status poll is sent and how long a batched page
+ * program is given before the next page follows.
+ *
+ * @details
+ * Each model keeps the last @ref FLASH_TIMING_SAMPLES times of one part and
+ * operation, so it follows slow drift such as a warming fixture. Estimates
+ * are only given once @ref FLASH_TIMING_MIN_SAMPLES times are known, until
+ * then callers fall back to the datasheet maximums.
+ *
+ * Models are cached per AmPLink serial number in a text file, one line per
+ * part and operation: `<serial> <part> <operation> <count> <us>...`, the
+ * times oldest first. The functions are thread safe once
+ * @ref flash_timing_load has run.
+ *
+ * **Example usage:**
+ * @code
+ * flash_timing_load(FLASH_TIMING_DEFAULT_FILE, serial);
+ * FlashTimingEstimate est;
+ * if (flash_timing_estimate("AT25DF512C", FLASH_TIMING_PROGRAM, &est))
+ *     first_poll_us = est.p10_us;
+ * ...
+ * flash_timing_record("AT25DF512C", FLASH_TIMING_PROGRAM, elapsed_us);
+ * flash_timing_save(FLASH_TIMING_DEFAULT_FILE);
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef FLASH_TIMING_H
+#define FLASH_TIMING_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+
+//! Default file of the timing cache
+#define FLASH_TIMING_DEFAULT_FILE "amplink_timing.txt"
+//! Recent times kept per part and operation
+#define FLASH_TIMING_SAMPLES 64
+//! Times needed before a model gives estimates
+#define FLASH_TIMING_MIN_SAMPLES 8
+//! Parts and operations tracked at once
+#define FLASH_TIMING_MODELS 32
+
+//! Operation name of a page program
+#define FLASH_TIMING_PROGRAM    "program"
+//! Operation name of a chip erase
+#define FLASH_TIMING_CHIP_ERASE "chip_erase"
+
+/*!
+ * @struct FlashTimingEstimate
+ * @brief Percentiles of the recent times of one part and operation
+ */
+typedef struct {
+    uint32_t count;  /*!< Times the estimate is based on */
+    uint32_t p10_us; /*!< 10th percentile */
+    uint32_t p50_us; /*!< Median */
+    uint32_t p90_us; /*!< 90th percentile */
+    uint32_t p99_us; /*!< 99th percentile */
+    uint32_t max_us; /*!< Slowest recent time */
+} FlashTimingEstimate;
+
+/*!
+ * @brief Loads the models of a fixture, dropping the ones in memory.
+ *
+ * @param[in] path Cache file
+ * @param[in] fixture AmPLink serial number, models are saved under it
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file does not exist yet
+ */
+FT_STATUS flash_timing_load(const char *path, const char *fixture);
+
+/*!
+ * @brief Stores the models of the fixture, replacing its previous entries.
+ *
+ * @param[in] path Cache file
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file could not be written
+ */
+FT_STATUS flash_timing_save(const char *path);
+
+/*!
+ * @brief Adds the time of a completed operation to its model.
+ *
+ * @param[in] part Part name, see FlashPart::name
+ * @param[in] op Operation name, e.g. @ref FLASH_TIMING_PROGRAM
+ * @param[in] us Time from the chip select rising on the command to the first status read showing the part ready,
+ *               USB latency taken out
+ */
+void flash_timing_record(const char *part, const char *op, uint32_t us);
+
+/*!
+ * @brief Estimates the time of an operation from its recent times.
+ *
+ * @param[in] part Part name
+ * @param[in] op Operation name
+ * @param[out] est Percentiles, count 0 if no times are known
+ * @return int 1 if at least @ref FLASH_TIMING_MIN_SAMPLES times are known, 0 otherwise
+ */
+int flash_timing_estimate(const char *part, const char *op, FlashTimingEstimate *est);
+
+/*!
+ * @brief Gets a model by index, to report all of them.
+ *
+ * @param[in] index Model index, from 0
+ * @param[out] part Part name of the model
+ * @param[out] op Operation name of the model
+ * @param[out] est Percentiles of the model
+ * @return int 1 if the model exists, 0 past the last one
+ */
+int flash_timing_get(uint32_t index, const char **part, const char **op, FlashTimingEstimate *est);
+
+#endif
@@ -1,51 +1,53 @@
 #include "gpio_driver.h"
 #include "utils.h"
+#include "trace.h"
+#include "platform.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#define GPIO_READ_TIMEOUT_US 100000 // give up on a port read after 100ms
+#define GPIO_READ_POLL_US    50     // queue status poll interval
+
 FT_STATUS gpio_driver_init(ftd_channel_t deviceChannel, FT_HANDLE *pHandle){
     FT_STATUS ftStatus;
-    RETURN_IF_ERROR(FT_Open(deviceChannel, pHandle));
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_Open, deviceChannel, pHandle));
     // all pins output in sync mode
-    RETURN_IF_ERROR(FT_SetBitMode(*pHandle, 0xFF, FT_BITMODE_ASYNC_BITBANG));
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_SetBitMode, *pHandle, 0xFF, FT_BITMODE_ASYNC_BITBANG));
 
-    RETURN_IF_ERROR(FT_SetLatencyTimer(*pHandle, 1)); // 1ms latency
-    RETURN_IF_ERROR(FT_SetTimeouts(*pHandle, 200, 200)); // 200ms timouts
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_SetLatencyTimer, *pHandle, 1)); // 1ms latency
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_SetTimeouts, *pHandle, 200, 200)); // 200ms timouts
     //FT_SetUSBParameters(ftHandle, 64,64); // small usb transfer size
     //FT_SetFlowControl(ftHandle, FT_FLOW_NONE, 0, 0);
-    RETURN_IF_ERROR(FT_SetDataCharacteristics(*pHandle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE));
-    return FT_Purge(*pHandle, FT_PURGE_RX | FT_PURGE_TX);
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_SetDataCharacteristics, *pHandle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE));
+    return TRACE_CALL("GPIO", 0, FT_Purge, *pHandle, FT_PURGE_RX | FT_PURGE_TX);
 }
 
 
 FT_STATUS gpio_driver_read_port(FT_HANDLE ftHandle, unsigned char *value){
     DWORD bytesRead, bytesAvailable;
     FT_STATUS ftStatus;
-    DWORD waitTime = 0;
-    const DWORD maxWaitTime = 100; // max wait of 100ms
 
     // purge rx buffer
-    RETURN_IF_ERROR(FT_Purge(ftHandle, FT_PURGE_RX));
-    do{
-        RETURN_IF_ERROR(FT_GetQueueStatus(ftHandle, &bytesAvailable));
-        if (bytesAvailable >= 1){
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_Purge, ftHandle, FT_PURGE_RX));
+    uint64_t deadline = platform_deadline(GPIO_READ_TIMEOUT_US);
+    for (;;){
+        RETURN_IF_ERROR(TRACE_CALL("GPIO", 0, FT_GetQueueStatus, ftHandle, &bytesAvailable));
+        if (bytesAvailable >= 1 || platform_deadline_passed(deadline))
             break;
-        }
-        Sleep(1); 
-        waitTime += 1;
-    } while (waitTime < maxWaitTime);
-    
+        platform_sleep_until(deadline, GPIO_READ_POLL_US);
+    }
+
     if (bytesAvailable == 0){
-        printf("No data after %dms", maxWaitTime);
+        LOG_ERROR("gpio read: no data after %lums\n", (unsigned long)(GPIO_READ_TIMEOUT_US / 1000));
         *value = 0;
         return FT_OTHER_ERROR;
     }
 
     // read one byte from port
-    RETURN_IF_ERROR(FT_Read(ftHandle, value, 1, &bytesRead));
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 1, FT_Read, ftHandle, value, 1, &bytesRead));
     if (bytesRead != 1){
-        printf("Failed to read 1 byte, read %d\n", bytesRead);
+        LOG_ERROR("gpio read: expected 1 byte, read %lu\n", (unsigned long)bytesRead);
         return FT_OTHER_ERROR;
     }
     return FT_OK;
@@ -56,7 +58,7 @@ uint8_t gpio_driver_read_pin(FT_HANDLE ftHandle, uint8_t pin){
     unsigned char state;
     FT_STATUS ftStatus = gpio_driver_read_port(ftHandle, &state);
     if (ftStatus != FT_OK){
-        printf("gpio_read_port failed: %d", ftStatus);
+        LOG_ERROR("gpio_read_port failed: %d\n", (int)ftStatus);
         return 0;
     }
     return ((state & pin) != 0);
@@ -68,15 +70,15 @@ FT_STATUS gpio_driver_write_port(FT_HANDLE ftHandle, unsigned char value){
     DWORD bytesWritten;
 
     // write byte
-    RETURN_IF_ERROR(FT_Write(ftHandle, &value, 1, &bytesWritten));
+    RETURN_IF_ERROR(TRACE_CALL("GPIO", 1, FT_Write, ftHandle, &value, 1, &bytesWritten));
 
     if (bytesWritten != 1){
-        printf("Failed to write 1 byte, wrote %d\n", bytesWritten);
+        LOG_ERROR("gpio write: expected 1 byte, wrote %lu\n", (unsigned long)bytesWritten);
         return FT_OTHER_ERROR;
     }
 
     // flush tx buffer
-    return FT_Purge(ftHandle, FT_PURGE_TX);
+    return TRACE_CALL("GPIO", 0, FT_Purge, ftHandle, FT_PURGE_TX);
 }
 
 
@@ -92,10 +94,10 @@ FT_STATUS gpio_driver_write_pin(FT_HANDLE ftHandle, uint8_t pin, uint8_t value){
 
 
 FT_STATUS gpio_driver_set_port_direction(FT_HANDLE ftHandle, uint8_t dir){
-    return FT_SetBitMode(ftHandle, dir, FT_BITMODE_SYNC_BITBANG);
+    return TRACE_CALL("GPIO", 0, FT_SetBitMode, ftHandle, dir, FT_BITMODE_SYNC_BITBANG);
 }
 
 
 FT_STATUS gpio_driver_close(FT_HANDLE ftHandle){
-    return FT_Close(ftHandle);
+    return TRACE_CALL("GPIO", 0, FT_Close, ftHandle);
 }
\ No newline at end of file
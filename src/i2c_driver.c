@@ -1,20 +1,26 @@
 #include "i2c_driver.h"
 #include "utils.h"
+#include "trace.h"
+#include "platform.h"
+#include <string.h>
 
-#define I2C_DEVICE_BUFFER_SIZE  256
+// a busy device NACKs reads, retries back off from the first to the last interval until the timeout
+#define I2C_READ_TIMEOUT_US     2000000
+#define I2C_READ_RETRY_FIRST_US 100
+#define I2C_READ_RETRY_MAX_US   10000
 
 FT_STATUS i2c_driver_init(ftd_channel_t deviceNumber, FT_HANDLE *pHandle){
     FT_STATUS ftStatus;
     ChannelConfigI2C channelConfI2C;
 
-    RETURN_IF_ERROR(I2C_OpenChannel(deviceNumber, pHandle));
+    RETURN_IF_ERROR(TRACE_CALL("I2C", 0, I2C_OpenChannel, deviceNumber, pHandle));
 
     memset(&channelConfI2C, 0, sizeof(channelConfI2C));
-    channelConfI2C.ClockRate = I2C_CLOCK_STANDARD_MODE;
+    channelConfI2C.ClockRate = I2C_CLOCK_RATE;
     channelConfI2C.LatencyTimer = 255;
     channelConfI2C.Options = 0;
 
-    return I2C_InitChannel(*pHandle, &channelConfI2C);
+    return TRACE_CALL("I2C", 0, I2C_InitChannel, *pHandle, &channelConfI2C);
 }
 
 
@@ -25,7 +31,7 @@ FT_STATUS i2c_driver_write(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t *d
 
     options = I2C_TRANSFER_OPTIONS_START_BIT|I2C_TRANSFER_OPTIONS_STOP_BIT;
 
-    ftStatus = I2C_DeviceWrite(ftHandle, deviceAddress, numBytes, data, &bytesTransfered, options);
+    ftStatus = TRACE_CALL("I2C", numBytes, I2C_DeviceWrite, ftHandle, deviceAddress, numBytes, data, &bytesTransfered, options);
     if (bytesTransfered != numBytes){
         return FT_OTHER_ERROR;
     }
@@ -35,27 +41,40 @@ FT_STATUS i2c_driver_write(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t *d
 
 FT_STATUS i2c_driver_read(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t registerAddress, uint8_t *data, uint32_t numBytes){
     FT_STATUS ftStatus;
-    uint8_t buffer[I2C_DEVICE_BUFFER_SIZE];
-    uint32_t bytesToTransfer = 0;
     DWORD bytesTransfered = 0;
     DWORD options;
-    uint32_t trials;
+    uint32_t retry_us = I2C_READ_RETRY_FIRST_US;
 
     options = I2C_TRANSFER_OPTIONS_START_BIT | I2C_TRANSFER_OPTIONS_STOP_BIT;
-    buffer[bytesToTransfer++] = registerAddress;
-    RETURN_IF_ERROR(I2C_DeviceWrite(ftHandle, deviceAddress, bytesToTransfer, buffer, &bytesTransfered, options));
-
-    trials = 0;
-    while (trials < 20){
-        ftStatus = I2C_DeviceRead(ftHandle, deviceAddress, numBytes, data, &bytesTransfered, options);
-        if (ftStatus == FT_OK) break;
-        Sleep(100);
-        trials++;
+    RETURN_IF_ERROR(TRACE_CALL("I2C", 1, I2C_DeviceWrite, ftHandle, deviceAddress, 1, &registerAddress, &bytesTransfered, options));
+
+    uint64_t deadline = platform_deadline(I2C_READ_TIMEOUT_US);
+    for (;;){
+        ftStatus = TRACE_CALL("I2C", numBytes, I2C_DeviceRead, ftHandle, deviceAddress, numBytes, data, &bytesTransfered, options);
+        if (ftStatus == FT_OK || platform_deadline_passed(deadline)) break;
+        platform_sleep_until(deadline, retry_us);
+        if (retry_us < I2C_READ_RETRY_MAX_US) retry_us *= 2;
     }
     return ftStatus;
 }
 
 
+FT_STATUS i2c_driver_transfer(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t *tx_buff, uint32_t num_write, uint8_t *rx_buff, uint32_t num_read){
+    DWORD bytesTransfered = 0;
+
+    // no stop bit so the read follows as a repeated start
+    RETURN_IF_ERROR(TRACE_CALL("I2C", num_write, I2C_DeviceWrite, ftHandle, deviceAddress, num_write, tx_buff, &bytesTransfered, I2C_TRANSFER_OPTIONS_START_BIT));
+    if (bytesTransfered != num_write)
+        return FT_OTHER_ERROR;
+
+    bytesTransfered = 0;
+    RETURN_IF_ERROR(TRACE_CALL("I2C", num_read, I2C_DeviceRead, ftHandle, deviceAddress, num_read, rx_buff, &bytesTransfered, I2C_TRANSFER_OPTIONS_START_BIT | I2C_TRANSFER_OPTIONS_STOP_BIT | I2C_TRANSFER_OPTIONS_NACK_LAST_BYTE));
+    if (bytesTransfered != num_read)
+        return FT_OTHER_ERROR;
+    return FT_OK;
+}
+
+
 FT_STATUS i2c_driver_close(FT_HANDLE ftHandle){
-    return I2C_CloseChannel(ftHandle);
+    return TRACE_CALL("I2C", 0, I2C_CloseChannel, ftHandle);
 }
\ No newline at end of file
@@ -22,6 +22,9 @@
 #include "ftd2xx.h"
 #include "libmpsse_i2c.h"
 
+//! I2C clock rate in Hz
+#define I2C_CLOCK_RATE I2C_CLOCK_STANDARD_MODE
+
 /*!
  * @brief Initializes the FTDI channel for i2C
  *
@@ -57,6 +60,23 @@ FT_STATUS i2c_driver_write(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t *d
 FT_STATUS i2c_driver_read(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t registerAddress, uint8_t *data, uint32_t numBytes);
 
 
+/*!
+ * @brief Writes bytes to a specified i2c address and then reads a number of bytes back
+ *
+ * Used for devices with multi-byte register addresses where the address must be
+ * written before the read.
+ *
+ * @param[in] ftHandle Handle of the i2c channel
+ * @param[in] deviceAddress Address of the I2C slave
+ * @param[in] tx_buff Bytes to be written
+ * @param[in] num_write Number of bytes to write
+ * @param[out] rx_buff Pointer to buffer to read data to
+ * @param[in] num_read Number of bytes to read
+ * @return FT_STATUS
+ */
+FT_STATUS i2c_driver_transfer(FT_HANDLE ftHandle, uint8_t deviceAddress, uint8_t *tx_buff, uint32_t num_write, uint8_t *rx_buff, uint32_t num_read);
+
+
 /*!
  * @brief Handles clean closing of I2C port
  *
@@ -0,0 +1,252 @@
+#include "image.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "utils.h"
+#include "platform.h"
+#include "fileparser.h"
+#include "image_cache.h"
+#include "image_parallel.h"
+
+#define IMAGE_MIN_ALLOC 0x1000
+
+
+// nibble table, small enough to keep const and thread safe
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t image_crc32(const uint8_t *data, size_t len){
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++){
+        crc = crc_table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = crc_table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+
+void image_init(Image *img){
+    memset(img, 0, sizeof(*img));
+}
+
+static FT_STATUS image_grow(Image *img, uint32_t end){
+    uint32_t new_size = img->size ? img->size : IMAGE_MIN_ALLOC;
+    while (new_size < end)
+        new_size *= 2;
+    if (new_size > IMAGE_MAX_SIZE)
+        new_size = IMAGE_MAX_SIZE;
+
+    uint8_t *data = realloc(img->data, new_size);
+    if (!data) return FT_INSUFFICIENT_RESOURCES;
+    img->data = data;
+    uint8_t *used = realloc(img->used, new_size / 8);
+    if (!used) return FT_INSUFFICIENT_RESOURCES;
+    img->used = used;
+
+    memset(img->data + img->size, 0xFF, new_size - img->size);
+    memset(img->used + img->size / 8, 0, (new_size - img->size) / 8);
+    img->size = new_size;
+    return FT_OK;
+}
+
+FT_STATUS image_reserve(Image *img, uint32_t size){
+    if (size > IMAGE_MAX_SIZE)
+        return FT_INVALID_PARAMETER;
+    if (size > img->size)
+        RETURN_IF_ERROR(image_grow(img, size));
+    return FT_OK;
+}
+
+// sets the used bits of [addr, addr + len), partial bytes may be shared with other writers
+static void image_mark_used(Image *img, uint32_t addr, uint32_t len, int shared){
+    uint32_t end = addr + len;
+    while (addr < end){
+        uint32_t bit = addr & 7;
+        uint32_t n = 8 - bit;
+        if (n > end - addr) n = end - addr;
+        uint8_t mask = (uint8_t)(((1u << n) - 1) << bit);
+        if (shared && mask != 0xFF)
+            platform_atomic_or8(&img->used[addr >> 3], mask);
+        else
+            img->used[addr >> 3] |= mask;
+        addr += n;
+    }
+}
+
+FT_STATUS image_write(Image *img, uint32_t addr, const uint8_t *data, uint32_t len){
+    if (addr >= IMAGE_MAX_SIZE || len > IMAGE_MAX_SIZE - addr)
+        return FT_INVALID_PARAMETER;
+    if (addr + len > img->size)
+        RETURN_IF_ERROR(image_grow(img, addr + len));
+
+    memcpy(img->data + addr, data, len);
+    image_mark_used(img, addr, len, 0);
+    return FT_OK;
+}
+
+FT_STATUS image_write_shared(Image *img, uint32_t addr, const uint8_t *data, uint32_t len){
+    if (addr >= img->size || len > img->size - addr)
+        return FT_INVALID_PARAMETER;
+
+    memcpy(img->data + addr, data, len);
+    image_mark_used(img, addr, len, 1);
+    return FT_OK;
+}
+
+// first address in [pos, end) whose used bit equals want, whole bytes are skipped at once
+static uint32_t image_find_used(const Image *img, uint32_t pos, uint32_t end, int want){
+    uint8_t skip = want ? 0x00 : 0xFF;
+    while (pos < end){
+        if ((pos & 7) == 0 && end - pos >= 8 && img->used[pos >> 3] == skip){
+            pos += 8;
+            continue;
+        }
+        if (((img->used[pos >> 3] >> (pos & 7)) & 1) == want)
+            return pos;
+        pos++;
+    }
+    return end;
+}
+
+FT_STATUS image_finalize_layout(Image *img){
+    uint32_t end = 0;
+    uint32_t segments = 0;
+    uint32_t pos, start;
+
+    // count segments and find the last used byte
+    img->data_bytes = 0;
+    for (pos = 0; (start = image_find_used(img, pos, img->size, 1)) < img->size; ){
+        pos = image_find_used(img, start, img->size, 0);
+        segments++;
+        img->data_bytes += pos - start;
+        end = pos;
+    }
+
+    img->size = (end + IMAGE_PAGE_SIZE - 1) / IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE;
+    img->page_count = img->size / IMAGE_PAGE_SIZE;
+    img->segment_count = segments;
+    img->segments = calloc(segments ? segments : 1, sizeof(ImageSegment));
+    img->page_map = calloc((img->page_count + 7) / 8 + 1, 1);
+    img->page_crc = calloc(img->page_count ? img->page_count : 1, sizeof(uint32_t));
+    if (!img->segments || !img->page_map || !img->page_crc)
+        return FT_INSUFFICIENT_RESOURCES;
+
+    // segments and page bitmap
+    segments = 0;
+    for (pos = 0; (start = image_find_used(img, pos, end, 1)) < end; ){
+        pos = image_find_used(img, start, end, 0);
+        img->segments[segments].addr = start;
+        img->segments[segments].len = pos - start;
+        segments++;
+        for (uint32_t page = start / IMAGE_PAGE_SIZE; page <= (pos - 1) / IMAGE_PAGE_SIZE; page++)
+            img->page_map[page >> 3] |= (uint8_t)(1 << (page & 7));
+    }
+
+    free(img->used);
+    img->used = NULL;
+    return FT_OK;
+}
+
+void image_finalize_crc(Image *img, uint32_t first_page, uint32_t page_count){
+    for (uint32_t page = first_page; page < first_page + page_count && page < img->page_count; page++)
+        img->page_crc[page] = image_crc32(img->data + page * IMAGE_PAGE_SIZE, IMAGE_PAGE_SIZE);
+}
+
+FT_STATUS image_finalize(Image *img){
+    RETURN_IF_ERROR(image_finalize_layout(img));
+    image_finalize_crc(img, 0, img->page_count);
+    return FT_OK;
+}
+
+int image_page_used(const Image *img, uint32_t page){
+    if (page >= img->page_count) return 0;
+    return (img->page_map[page >> 3] >> (page & 7)) & 1;
+}
+
+static FT_STATUS image_file_cb(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    return image_write((Image *)ctx, addr, data, len);
+}
+
+static int ext_equals(const char *ext, const char *want){
+    for (; *ext && *want; ext++, want++){
+        if (tolower((unsigned char)*ext) != *want) return 0;
+    }
+    return *ext == *want;
+}
+
+FT_STATUS image_parse_source(const char *spec, ImageSource *src){
+    const char *base = spec;
+    for (const char *c = spec; *c; c++){
+        if (*c == '/' || *c == '\\') base = c + 1;
+    }
+
+    // optional @addr suffix on the file name
+    const char *at = strrchr(base, '@');
+    size_t path_len = at ? (size_t)(at - spec) : strlen(spec);
+    if (path_len >= IMAGE_PATH_LEN)
+        return FT_INVALID_PARAMETER;
+    memcpy(src->path, spec, path_len);
+    src->path[path_len] = '\0';
+    src->base_addr = 0;
+    if (at){
+        char *endptr;
+        unsigned long addr = strtoul(at + 1, &endptr, 0);
+        if (at[1] == '\0' || *endptr != '\0' || addr >= IMAGE_MAX_SIZE)
+            return FT_INVALID_PARAMETER;
+        src->base_addr = (uint32_t)addr;
+    }
+
+    const char *ext = strrchr(src->path + (base - spec), '.');
+    src->format = IMAGE_FORMAT_INTEL_HEX;
+    if (ext){
+        if (ext_equals(ext, ".bin"))
+            src->format = IMAGE_FORMAT_BINARY;
+        else if (ext_equals(ext, ".srec") || ext_equals(ext, ".s19") || ext_equals(ext, ".s28")
+              || ext_equals(ext, ".s37") || ext_equals(ext, ".mot"))
+            src->format = IMAGE_FORMAT_SREC;
+    }
+    return FT_OK;
+}
+
+FT_STATUS image_load(Image *img, const char *filename){
+    FT_STATUS ftStatus;
+    ImageSource src;
+
+    image_init(img);
+    RETURN_IF_ERROR(image_parse_source(filename, &src));
+    switch (src.format){
+        case IMAGE_FORMAT_SREC:
+            ftStatus = fileparser_stream_srec_ctx(src.path, image_file_cb, img);
+            break;
+        case IMAGE_FORMAT_BINARY:
+            ftStatus = fileparser_stream_binary_ctx(src.path, src.base_addr, image_file_cb, img);
+            break;
+        default:
+            // the parallel loader finalizes the image itself, spreading the page CRCs over its threads
+            if (image_parallel_worthwhile(src.path))
+                return image_load_intel_hex_parallel(img, src.path);
+            ftStatus = fileparser_stream_intel_hex_ctx(src.path, image_file_cb, img);
+            break;
+    }
+    if (ftStatus == FT_OK)
+        ftStatus = image_finalize(img);
+    if (ftStatus != FT_OK)
+        image_free(img);
+    return ftStatus;
+}
+
+void image_free(Image *img){
+    if (img->backing){
+        image_cache_release(img);
+    } else {
+        free(img->data);
+        free(img->page_map);
+        free(img->page_crc);
+        free(img->segments);
+        free(img->used);
+    }
+    image_init(img);
+}
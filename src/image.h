@@ -0,0 +1,201 @@
+/*! @file image.h
+ *  @brief In-memory representation of a parsed programming file.
+ *
+ * An image holds the complete contents of an input file as a flat byte array
+ * starting at address 0, together with the list of contiguous data segments,
+ * a bitmap of pages containing data and a CRC32 of every page.
+ *
+ * @details
+ * Bytes not set by the input file read as 0xFF, the erased state of flash.
+ * Images are either built by a loader (see @ref image_load) or mapped read-only
+ * from the binary cache (see @ref image_cache.h). Both are released with
+ * @ref image_free.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ftd2xx.h"
+
+//! Page granularity of the page bitmap and CRCs
+#define IMAGE_PAGE_SIZE 256
+//! Largest address space an image may cover (3-byte SPI flash addressing)
+#define IMAGE_MAX_SIZE  0x01000000
+//! Maximum length of an input file path
+#define IMAGE_PATH_LEN  512
+
+/*!
+ * @enum image_format_t
+ * @brief Supported input file formats
+ */
+typedef enum {
+    IMAGE_FORMAT_INTEL_HEX, /*!< Intel HEX, any other extension */
+    IMAGE_FORMAT_SREC,      /*!< Motorola S-record (.srec, .s19, .s28, .s37, .mot) */
+    IMAGE_FORMAT_BINARY     /*!< Raw binary (.bin) */
+} image_format_t;
+
+/*!
+ * @struct ImageSource
+ * @brief Input file specification split into path, format and base address
+ *
+ * Raw binaries take their base address from an `@addr` suffix,
+ * e.g. `flash_2A.bin@0x1000`. Without a suffix the base address is 0.
+ */
+typedef struct {
+    char path[IMAGE_PATH_LEN]; /*!< Path of the file on disk */
+    image_format_t format;     /*!< Format, chosen by file extension */
+    uint32_t base_addr;        /*!< Load address of raw binaries */
+} ImageSource;
+
+/*!
+ * @struct ImageSegment
+ * @brief A contiguous run of bytes set by the input file
+ */
+typedef struct {
+    uint32_t addr; /*!< Start address */
+    uint32_t len;  /*!< Length in bytes */
+} ImageSegment;
+
+/*!
+ * @struct Image
+ * @brief Parsed contents of a programming file
+ */
+typedef struct Image {
+    uint8_t *data;          /*!< Image bytes from address 0, unset bytes are 0xFF */
+    uint32_t size;          /*!< Bytes covered by data, multiple of IMAGE_PAGE_SIZE */
+    uint32_t page_count;    /*!< Number of pages covered by data */
+    uint8_t *page_map;      /*!< Bitmap with a bit set for every page containing data */
+    uint32_t *page_crc;     /*!< CRC32 of every page */
+    ImageSegment *segments; /*!< Contiguous data runs in ascending address order */
+    uint32_t segment_count; /*!< Number of segments */
+    uint32_t data_bytes;    /*!< Number of bytes set by the input file */
+
+    uint8_t *used;          /*!< Per-byte bitmap of set bytes while building, NULL once finalized */
+    void *backing;          /*!< Cache mapping when loaded from cache, NULL for heap images */
+} Image;
+
+/*!
+ * @brief Initializes an empty image.
+ *
+ * @param[out] img Image to initialize
+ */
+void image_init(Image *img);
+
+/*!
+ * @brief Copies data into an image under construction, growing it as needed.
+ *
+ * @param[in,out] img Image being built
+ * @param[in] addr Start address of the data
+ * @param[in] data Bytes to store
+ * @param[in] len Number of bytes
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if beyond IMAGE_MAX_SIZE,
+ *         FT_INSUFFICIENT_RESOURCES on allocation failure
+ */
+FT_STATUS image_write(Image *img, uint32_t addr, const uint8_t *data, uint32_t len);
+
+/*!
+ * @brief Grows an image under construction to cover at least size bytes.
+ *
+ * Used before @ref image_write_shared, which never grows the image.
+ *
+ * @param[in,out] img Image being built
+ * @param[in] size Bytes to cover, at most IMAGE_MAX_SIZE
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if beyond IMAGE_MAX_SIZE,
+ *         FT_INSUFFICIENT_RESOURCES on allocation failure
+ */
+FT_STATUS image_reserve(Image *img, uint32_t size);
+
+/*!
+ * @brief Copies data into a reserved image, safe to call from several threads at once.
+ *
+ * Threads must write disjoint address ranges. The image is never grown, see @ref image_reserve.
+ *
+ * @param[in,out] img Image being built
+ * @param[in] addr Start address of the data
+ * @param[in] data Bytes to store
+ * @param[in] len Number of bytes
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if beyond the reserved size
+ */
+FT_STATUS image_write_shared(Image *img, uint32_t addr, const uint8_t *data, uint32_t len);
+
+/*!
+ * @brief Builds segments, page bitmap and page CRCs once all data is written.
+ *
+ * @param[in,out] img Image being built
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS image_finalize(Image *img);
+
+/*!
+ * @brief First step of @ref image_finalize, builds segments and the page bitmap without CRCs.
+ *
+ * Lets a caller compute page CRCs itself, e.g. split across threads.
+ *
+ * @param[in,out] img Image being built
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS image_finalize_layout(Image *img);
+
+/*!
+ * @brief Second step of @ref image_finalize, computes the CRCs of a range of pages.
+ *
+ * Calls for disjoint page ranges may run concurrently.
+ *
+ * @param[in,out] img Image after @ref image_finalize_layout
+ * @param[in] first_page First page to checksum
+ * @param[in] page_count Number of pages
+ */
+void image_finalize_crc(Image *img, uint32_t first_page, uint32_t page_count);
+
+/*!
+ * @brief Splits an input file specification into path, format and base address.
+ *
+ * @param[in] spec File name as given on the command line
+ * @param[out] src Parsed specification
+ * @return FT_STATUS FT_OK, FT_INVALID_PARAMETER if the path is too long or the base address is invalid
+ */
+FT_STATUS image_parse_source(const char *spec, ImageSource *src);
+
+/*!
+ * @brief Loads a programming file into a new image.
+ *
+ * The loader is chosen by file extension, see @ref image_format_t.
+ * Large Intel HEX files are parsed on all cores, see @ref image_parallel.h.
+ *
+ * @param[out] img Image to build
+ * @param[in] filename Path to an Intel HEX, S-record or raw binary file
+ * @return FT_STATUS Status of the operation, see @ref fileparser.h
+ */
+FT_STATUS image_load(Image *img, const char *filename);
+
+/*!
+ * @brief Checks whether a page contains any data.
+ *
+ * @param[in] img Finalized image
+ * @param[in] page Page index
+ * @return int 1 if the page contains data, 0 otherwise
+ */
+int image_page_used(const Image *img, uint32_t page);
+
+/*!
+ * @brief Calculates a CRC32 (IEEE 802.3) over a buffer.
+ *
+ * @param[in] data Bytes to checksum
+ * @param[in] len Number of bytes
+ * @return uint32_t CRC of the buffer
+ */
+uint32_t image_crc32(const uint8_t *data, size_t len);
+
+/*!
+ * @brief Releases all memory or cache mappings owned by an image.
+ *
+ * @param[in,out] img Image to release, left empty
+ */
+void image_free(Image *img);
+
+#endif
@@ -0,0 +1,230 @@
+#include "image_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "platform.h"
+
+#define CACHE_MAGIC       0x49504D41 // "AMPI"
+#define CACHE_VERSION     3
+#define CACHE_HASH_BLOCK  0x10000
+#define CACHE_FNV_OFFSET  0xCBF29CE484222325ull
+
+/*!
+ * @struct CacheHeader
+ * @brief On-disk header of a cache entry
+ *
+ * Followed by segments, page CRCs, page bitmap and image data in that order.
+ */
+typedef struct {
+    uint32_t magic;         /*!< CACHE_MAGIC */
+    uint32_t version;       /*!< CACHE_VERSION */
+    uint64_t source_size;   /*!< Size of the source file in bytes */
+    uint64_t source_hash;   /*!< FNV-1a hash of the source file contents */
+    uint32_t source_format; /*!< ImageSource::format */
+    uint32_t source_base;   /*!< ImageSource::base_addr */
+    uint32_t size;          /*!< Image::size */
+    uint32_t page_count;    /*!< Image::page_count */
+    uint32_t segment_count; /*!< Image::segment_count */
+    uint32_t data_bytes;    /*!< Image::data_bytes */
+} CacheHeader;
+
+
+// FNV-1a 64, continued from h
+static uint64_t cache_hash(uint64_t h, const uint8_t *data, size_t len){
+    for (size_t i = 0; i < len; i++){
+        h ^= data[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// entries in a shared directory carry a hash of the full source path, sources with the same basename differ
+static void cache_path(char *path, const char *filename, const char *cache_dir, const char *ext){
+    if (!cache_dir){
+        snprintf(path, IMAGE_CACHE_PATH_LEN, "%s%s", filename, ext);
+        return;
+    }
+    const char *base = filename;
+    for (const char *c = filename; *c; c++){
+        if (*c == '/' || *c == '\\') base = c + 1;
+    }
+    uint64_t h = cache_hash(CACHE_FNV_OFFSET, (const uint8_t *)filename, strlen(filename));
+    snprintf(path, IMAGE_CACHE_PATH_LEN, "%s/%s.%016llx%s", cache_dir, base, (unsigned long long)h, ext);
+}
+
+static size_t cache_file_size(const CacheHeader *hdr){
+    return sizeof(CacheHeader)
+         + (size_t)hdr->segment_count * sizeof(ImageSegment)
+         + (size_t)hdr->page_count * sizeof(uint32_t)
+         + (hdr->page_count + 7) / 8
+         + hdr->size;
+}
+
+// FNV-1a 64 of the file contents
+static FT_STATUS cache_hash_file(const char *filename, uint64_t *hash){
+    FILE *file = fopen(filename, "rb");
+    if (!file) return FT_IO_ERROR;
+
+    uint8_t *block = malloc(CACHE_HASH_BLOCK);
+    if (!block){
+        fclose(file);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    uint64_t h = CACHE_FNV_OFFSET;
+    size_t n;
+    while ((n = fread(block, 1, CACHE_HASH_BLOCK, file)) > 0)
+        h = cache_hash(h, block, n);
+    free(block);
+    fclose(file);
+    *hash = h;
+    return FT_OK;
+}
+
+// checks the cache header against the source, the content hash decides as mtimes only have one second resolution
+static int cache_entry_valid(const char *path, const ImageSource *src, const struct stat *st){
+    CacheHeader hdr;
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    size_t n = fread(&hdr, sizeof(hdr), 1, file);
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fclose(file);
+
+    if (n != 1 || hdr.magic != CACHE_MAGIC || hdr.version != CACHE_VERSION)
+        return 0;
+    if ((size_t)file_size != cache_file_size(&hdr) || hdr.source_size != (uint64_t)st->st_size)
+        return 0;
+    if (hdr.source_format != (uint32_t)src->format || hdr.source_base != src->base_addr)
+        return 0;
+    uint64_t hash;
+    return cache_hash_file(src->path, &hash) == FT_OK && hash == hdr.source_hash;
+}
+
+// checks the stored page CRCs against the mapped data
+static int cache_pages_valid(const Image *img){
+    for (uint32_t page = 0; page < img->page_count; page++){
+        if (image_crc32(img->data + (size_t)page * IMAGE_PAGE_SIZE, IMAGE_PAGE_SIZE) != img->page_crc[page])
+            return 0;
+    }
+    return 1;
+}
+
+static FT_STATUS cache_map(Image *img, const char *path){
+    PlatformMapping *m = calloc(1, sizeof(PlatformMapping));
+    if (!m) return FT_INSUFFICIENT_RESOURCES;
+    if (platform_map_file(path, m) != FT_OK){
+        free(m);
+        return FT_IO_ERROR;
+    }
+
+    // images are read-only once finalized, point straight into the mapping
+    uint8_t *p = (uint8_t *)m->view;
+    const CacheHeader *hdr = (const CacheHeader *)p;
+    image_init(img);
+    img->size = hdr->size;
+    img->page_count = hdr->page_count;
+    img->segment_count = hdr->segment_count;
+    img->data_bytes = hdr->data_bytes;
+    p += sizeof(CacheHeader);
+    img->segments = (ImageSegment *)p;
+    p += (size_t)hdr->segment_count * sizeof(ImageSegment);
+    img->page_crc = (uint32_t *)p;
+    p += (size_t)hdr->page_count * sizeof(uint32_t);
+    img->page_map = p;
+    p += (hdr->page_count + 7) / 8;
+    img->data = p;
+    img->backing = m;
+    return FT_OK;
+}
+
+
+FT_STATUS image_cache_save(const Image *img, const char *filename, const char *cache_dir){
+    char path[IMAGE_CACHE_PATH_LEN];
+    char tmp_path[IMAGE_CACHE_PATH_LEN + 4];
+    struct stat st;
+    ImageSource src;
+    CacheHeader hdr;
+
+    RETURN_IF_ERROR(image_parse_source(filename, &src));
+    if (stat(src.path, &st) != 0)
+        return FT_IO_ERROR;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CACHE_MAGIC;
+    hdr.version = CACHE_VERSION;
+    hdr.source_size = (uint64_t)st.st_size;
+    hdr.source_format = (uint32_t)src.format;
+    hdr.source_base = src.base_addr;
+    RETURN_IF_ERROR(cache_hash_file(src.path, &hdr.source_hash));
+    hdr.size = img->size;
+    hdr.page_count = img->page_count;
+    hdr.segment_count = img->segment_count;
+    hdr.data_bytes = img->data_bytes;
+
+    // write to a temporary file so readers never see a partial entry
+    cache_path(path, src.path, cache_dir, IMAGE_CACHE_EXT);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) return FT_IO_ERROR;
+    int ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1
+          && fwrite(img->segments, sizeof(ImageSegment), img->segment_count, file) == img->segment_count
+          && fwrite(img->page_crc, sizeof(uint32_t), img->page_count, file) == img->page_count
+          && fwrite(img->page_map, 1, (img->page_count + 7) / 8, file) == (img->page_count + 7) / 8
+          && fwrite(img->data, 1, img->size, file) == img->size;
+    ok = (fclose(file) == 0) && ok;
+    if (ok){
+        remove(path);
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok){
+        remove(tmp_path);
+        return FT_IO_ERROR;
+    }
+    return FT_OK;
+}
+
+FT_STATUS image_cache_path(char *path, const char *filename, const char *cache_dir, const char *ext){
+    ImageSource src;
+    RETURN_IF_ERROR(image_parse_source(filename, &src));
+    cache_path(path, src.path, cache_dir, ext);
+    return FT_OK;
+}
+
+FT_STATUS image_cache_load(Image *img, const char *filename, const char *cache_dir, int *hit){
+    char path[IMAGE_CACHE_PATH_LEN];
+    struct stat st;
+    ImageSource src;
+
+    if (hit) *hit = 0;
+    RETURN_IF_ERROR(image_parse_source(filename, &src));
+    if (stat(src.path, &st) != 0){
+        printf("could not open file '%s': ", src.path);
+        return FT_IO_ERROR;
+    }
+
+    cache_path(path, src.path, cache_dir, IMAGE_CACHE_EXT);
+    if (cache_entry_valid(path, &src, &st) && cache_map(img, path) == FT_OK){
+        if (cache_pages_valid(img)){
+            if (hit) *hit = 1;
+            return FT_OK;
+        }
+        LOG_WARN("image cache '%s' is corrupt, rebuilding\n", path);
+        image_free(img);
+    }
+
+    // miss, parse the source and refresh the entry
+    RETURN_IF_ERROR(image_load(img, filename));
+    if (image_cache_save(img, filename, cache_dir) != FT_OK)
+        LOG_WARN("could not write image cache '%s'\n", path);
+    return FT_OK;
+}
+
+void image_cache_release(Image *img){
+    PlatformMapping *m = (PlatformMapping *)img->backing;
+    if (!m) return;
+    platform_unmap_file(m);
+    free(m);
+    img->backing = NULL;
+}
@@ -0,0 +1,79 @@
+/*! @file image_cache.h
+ *  @brief Binary cache of parsed images keyed by source file path and content hash.
+ *
+ * Parsing text HEX files on every run is avoided by storing each parsed image
+ * in a compact binary file: segments, page CRCs, page bitmap and data. Cache
+ * files are mapped read-only into memory instead of being parsed.
+ *
+ * @details
+ * A cache entry is valid while the source file has the same size and content
+ * hash. A hit is therefore not free: the whole source file is read and hashed,
+ * and the CRC of every page of the entry is checked, two linear passes that
+ * cost far less than parsing but grow with the image. Hashing catches rebuilds
+ * within the same second that an mtime check would miss, and a corrupt entry
+ * is rebuilt like a stale one.
+ *
+ * Cache files are named `<source>.ampi` next to the source file, or
+ * `<cache_dir>/<source basename>.<path hash>.ampi` when a cache directory is
+ * given, so sources with the same name in different directories never share
+ * an entry. The input format and raw binary base address are part of the key.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "image.h"
+#include "ftd2xx.h"
+
+//! File extension of cache entries
+#define IMAGE_CACHE_EXT ".ampi"
+//! Buffer length of a cache entry path
+#define IMAGE_CACHE_PATH_LEN (IMAGE_PATH_LEN + 40)
+
+/*!
+ * @brief Loads an image from the cache, parsing the source and updating the cache on a miss.
+ *
+ * Failing to write the cache entry is not an error, the parsed image is still returned.
+ *
+ * @param[out] img Image to load
+ * @param[in] filename Path to the source file
+ * @param[in] cache_dir Directory for cache entries, NULL to store them next to the source
+ * @param[out] hit Optional, set to 1 if the image was served from the cache
+ * @return FT_STATUS Status of the operation, see @ref image_load
+ */
+FT_STATUS image_cache_load(Image *img, const char *filename, const char *cache_dir, int *hit);
+
+/*!
+ * @brief Writes a finalized image to a cache entry for its source file.
+ *
+ * @param[in] img Finalized image
+ * @param[in] filename Path to the source file the image was built from
+ * @param[in] cache_dir Directory for cache entries, NULL to store them next to the source
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the entry could not be written
+ */
+FT_STATUS image_cache_save(const Image *img, const char *filename, const char *cache_dir);
+
+/*!
+ * @brief Path of a cache file derived from a source file, e.g. for data compiled from its image.
+ *
+ * @param[out] path Buffer of @ref IMAGE_CACHE_PATH_LEN bytes
+ * @param[in] filename Path to the source file, may carry a raw binary `@addr` suffix
+ * @param[in] cache_dir Directory for cache entries, NULL to store them next to the source
+ * @param[in] ext Extension appended to the source name, at most 15 characters
+ * @return FT_STATUS Status of the operation, see @ref image_parse_source
+ */
+FT_STATUS image_cache_path(char *path, const char *filename, const char *cache_dir, const char *ext);
+
+/*!
+ * @brief Unmaps an image loaded from the cache.
+ *
+ * @note Called by @ref image_free, not intended to be called directly.
+ *
+ * @param[in,out] img Cached image
+ */
+void image_cache_release(Image *img);
+
+#endif
@@ -0,0 +1,75 @@
+#include "image_loader.h"
+
+#include "image_cache.h"
+#include "platform.h"
+
+#define IMAGE_LOADER_MAX_THREADS 8
+
+/*!
+ * @struct ImageLoader
+ * @brief Shared state of the loader pool
+ */
+typedef struct {
+    ImageLoad *loads;       /*!< Files to load */
+    long count;             /*!< Number of files */
+    volatile long next;     /*!< Index of the next unclaimed file */
+    const char *cache_dir;  /*!< Cache directory, may be NULL */
+    int no_cache;           /*!< Bypass the cache */
+    PlatformThread threads[IMAGE_LOADER_MAX_THREADS];
+    int thread_count;       /*!< Threads started */
+} ImageLoader;
+
+static ImageLoader loader;
+
+
+static void image_loader_run(ImageLoad *load){
+    load->cache_hit = 0;
+    if (loader.no_cache)
+        load->status = image_load(&load->image, load->filename);
+    else
+        load->status = image_cache_load(&load->image, load->filename, loader.cache_dir, &load->cache_hit);
+}
+
+static void image_loader_thread(void *param){
+    (void)param;
+    long i;
+    while ((i = platform_atomic_inc(&loader.next) - 1) < loader.count)
+        image_loader_run(&loader.loads[i]);
+}
+
+
+FT_STATUS image_loader_start(ImageLoad *loads, int count, const char *cache_dir, int no_cache){
+    int threads = count;
+    if (threads > platform_cpu_count()) threads = platform_cpu_count();
+    if (threads > IMAGE_LOADER_MAX_THREADS) threads = IMAGE_LOADER_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    loader.loads = loads;
+    loader.count = count;
+    loader.next = 0;
+    loader.cache_dir = cache_dir;
+    loader.no_cache = no_cache;
+    loader.thread_count = 0;
+    for (int i = 0; i < count; i++){
+        image_init(&loads[i].image);
+        loads[i].status = FT_OTHER_ERROR;
+    }
+
+    for (int i = 0; i < threads; i++){
+        if (platform_thread_start(&loader.threads[loader.thread_count], image_loader_thread, NULL) != FT_OK) break;
+        loader.thread_count++;
+    }
+    return loader.thread_count ? FT_OK : FT_OTHER_ERROR;
+}
+
+FT_STATUS image_loader_wait(ImageLoad *loads, int count){
+    for (int i = 0; i < loader.thread_count; i++)
+        platform_thread_join(&loader.threads[i]);
+    loader.thread_count = 0;
+
+    for (int i = 0; i < count; i++){
+        if (loads[i].status != FT_OK)
+            return loads[i].status;
+    }
+    return FT_OK;
+}
@@ -0,0 +1,69 @@
+/*! @file image_loader.h
+ *  @brief Loads several programming files concurrently on a small thread pool.
+ *
+ * All input images are parsed and validated in the background while the
+ * programmer connects to the device, so startup takes the longer of the two
+ * instead of their sum.
+ *
+ * @details
+ * The pool has one thread per file, limited to the number of processors.
+ * Each thread claims the next unloaded file until none are left. Every image
+ * is loaded through the image cache unless caching is disabled.
+ *
+ * **Example usage:**
+ * @code
+ * ImageLoad loads[2] = {{ .filename = "clock.hex" }, { .filename = "flash_2A.hex" }};
+ * image_loader_start(loads, 2, NULL, 0);
+ * programmer_init();
+ * if (image_loader_wait(loads, 2) != FT_OK) {
+ *     // abort before touching any chip
+ * }
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include "image.h"
+#include "ftd2xx.h"
+
+/*!
+ * @struct ImageLoad
+ * @brief A single file to load and its result
+ *
+ * Only filename is set by the caller, all other fields are written by the loader.
+ */
+typedef struct {
+    const char *filename; /*!< Input file specification, see @ref image_parse_source */
+    Image image;          /*!< Loaded image, valid if status is FT_OK */
+    FT_STATUS status;     /*!< Result of the load */
+    int cache_hit;        /*!< Set if the image was served from the cache */
+} ImageLoad;
+
+/*!
+ * @brief Starts loading a set of files in the background.
+ *
+ * The loads array must stay valid until @ref image_loader_wait returns.
+ * Only one set of loads can be in flight at a time.
+ *
+ * @param[in,out] loads Files to load
+ * @param[in] count Number of files
+ * @param[in] cache_dir Directory for cache entries, NULL to store them next to the source
+ * @param[in] no_cache Non-zero to parse every file without the image cache
+ * @return FT_STATUS FT_OK, FT_OTHER_ERROR if no loader thread could be started
+ */
+FT_STATUS image_loader_start(ImageLoad *loads, int count, const char *cache_dir, int no_cache);
+
+/*!
+ * @brief Waits for all loads started by @ref image_loader_start to finish.
+ *
+ * @param[in,out] loads Files passed to @ref image_loader_start
+ * @param[in] count Number of files
+ * @return FT_STATUS FT_OK if every file loaded, otherwise the status of the first failed file
+ */
+FT_STATUS image_loader_wait(ImageLoad *loads, int count);
+
+#endif
@@ -0,0 +1,250 @@
+#include "image_parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "fileparser.h"
+#include "platform.h"
+
+/*!
+ * @struct HexChunk
+ * @brief Slice of whole lines decoded by one thread
+ */
+typedef struct {
+    const char *text;   /*!< First character of the chunk */
+    size_t len;         /*!< Characters in the chunk */
+    uint32_t line;      /*!< Line number of the first line */
+    uint32_t base;      /*!< Base address in effect at the first line */
+    int last;           /*!< Set for the chunk holding the end of file record */
+    Image *img;         /*!< Shared image */
+    const char *filename;
+    HexParser parser;   /*!< Parser state, ranges are kept for the overlap check */
+    FT_STATUS status;   /*!< Result of the chunk */
+} HexChunk;
+
+
+int image_parallel_worthwhile(const char *filename){
+    struct stat st;
+    if (platform_cpu_count() < 2 || stat(filename, &st) != 0)
+        return 0;
+    return st.st_size >= IMAGE_PARALLEL_MIN_SIZE;
+}
+
+static FT_STATUS chunk_write_cb(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    return image_write_shared((Image *)ctx, addr, data, len);
+}
+
+static void chunk_thread(void *param){
+    HexChunk *c = (HexChunk *)param;
+    fileparser_hex_init(&c->parser, c->filename, chunk_write_cb, c->img);
+    c->parser.base = c->base;
+    c->parser.line = c->line;
+    c->parser.require_eof = c->last;
+    fileparser_hex_feed(&c->parser, c->text, c->len);
+    c->status = fileparser_hex_finish(&c->parser);
+}
+
+/*!
+ * @struct CrcSlice
+ * @brief Range of pages checksummed by one thread
+ */
+typedef struct {
+    Image *img;          /*!< Image after layout */
+    uint32_t first_page; /*!< First page */
+    uint32_t page_count; /*!< Number of pages */
+} CrcSlice;
+
+static void crc_thread(void *param){
+    CrcSlice *s = (CrcSlice *)param;
+    image_finalize_crc(s->img, s->first_page, s->page_count);
+}
+
+static void image_crc_parallel(Image *img, int count){
+    CrcSlice slices[IMAGE_PARALLEL_MAX_THREADS];
+    PlatformThread threads[IMAGE_PARALLEL_MAX_THREADS];
+    uint32_t per = (img->page_count + count - 1) / count;
+
+    for (int i = 0; i < count; i++){
+        slices[i].img = img;
+        slices[i].first_page = per * i;
+        slices[i].page_count = per;
+        memset(&threads[i], 0, sizeof(threads[i]));
+        if (i == 0 || platform_thread_start(&threads[i], crc_thread, &slices[i]) != FT_OK)
+            crc_thread(&slices[i]);
+    }
+    for (int i = 1; i < count; i++)
+        platform_thread_join(&threads[i]);
+}
+
+static int range_compare(const void *a, const void *b){
+    uint32_t sa = ((const HexRange *)a)->start;
+    uint32_t sb = ((const HexRange *)b)->start;
+    return (sa > sb) - (sa < sb);
+}
+
+// overlaps inside a chunk are caught by its parser, this catches those across chunks
+static FT_STATUS check_chunk_overlap(const char *filename, HexChunk *chunks, int count){
+    uint32_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += chunks[i].parser.range_count;
+    HexRange *ranges = malloc((total ? total : 1) * sizeof(HexRange));
+    if (!ranges) return FT_INSUFFICIENT_RESOURCES;
+
+    uint32_t n = 0;
+    for (int i = 0; i < count; i++){
+        memcpy(&ranges[n], chunks[i].parser.ranges, chunks[i].parser.range_count * sizeof(HexRange));
+        n += chunks[i].parser.range_count;
+    }
+    qsort(ranges, n, sizeof(HexRange), range_compare);
+
+    FT_STATUS ftStatus = FT_OK;
+    for (uint32_t i = 1; i < n; i++){
+        if (ranges[i].start < ranges[i - 1].end){
+            fprintf(stderr, "overlapping data record in file '%s'\n", filename);
+            fprintf(stderr, "address 0x%08X already written\n", ranges[i].start);
+            ftStatus = FT_INVALID_PARAMETER;
+            break;
+        }
+    }
+    free(ranges);
+    return ftStatus;
+}
+
+static FT_STATUS read_file(const char *filename, char **text, size_t *len){
+    FILE *file = fopen(filename, "rb");
+    if (!file){
+        printf("could not open file '%s': ", filename);
+        return FT_IO_ERROR;
+    }
+    // ftell fails on streams without a size, e.g. pipes
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0){
+        printf("could not get the size of file '%s': ", filename);
+        fclose(file);
+        return FT_IO_ERROR;
+    }
+    *text = malloc(size > 0 ? (size_t)size : 1);
+    if (!*text){
+        fclose(file);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    *len = fread(*text, 1, (size_t)size, file);
+    fclose(file);
+    return FT_OK;
+}
+
+static uint32_t scan_hex_field(const char *p, int digits){
+    uint32_t val = 0;
+    for (int i = 0; i < digits; i++){
+        char c = p[i];
+        val <<= 4;
+        if (c >= '0' && c <= '9')      val |= (uint32_t)(c - '0');
+        else if (c >= 'A' && c <= 'F') val |= (uint32_t)(c - 'A' + 10);
+        else if (c >= 'a' && c <= 'f') val |= (uint32_t)(c - 'a' + 10);
+    }
+    return val;
+}
+
+FT_STATUS image_load_intel_hex_parallel(Image *img, const char *filename){
+    HexChunk *chunks = NULL;
+    PlatformThread threads[IMAGE_PARALLEL_MAX_THREADS];
+    char *text;
+    size_t len;
+    FT_STATUS ftStatus;
+
+    image_init(img);
+    RETURN_IF_ERROR(read_file(filename, &text, &len));
+
+    int count = (int)(len / IMAGE_PARALLEL_MIN_CHUNK);
+    if (count > platform_cpu_count()) count = platform_cpu_count();
+    if (count > IMAGE_PARALLEL_MAX_THREADS) count = IMAGE_PARALLEL_MAX_THREADS;
+    if (count < 1) count = 1;
+    chunks = calloc(count, sizeof(HexChunk));
+    if (!chunks){
+        free(text);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    // pass one: walk line starts, track the base address and cut chunks at line boundaries
+    size_t target = len / count;
+    int chunk = 0;
+    size_t pos = 0;
+    uint32_t line = 1;
+    uint32_t base = 0;
+    uint32_t max_base = 0;
+    chunks[0].text = text;
+    chunks[0].line = 1;
+    while (pos < len){
+        if (chunk + 1 < count && pos >= target * (chunk + 1)){
+            chunk++;
+            chunks[chunk].text = text + pos;
+            chunks[chunk].line = line;
+            chunks[chunk].base = base;
+        }
+        // ':' count(2) address(4) type(2) data..., leading blanks are allowed by the parser
+        size_t rec = pos;
+        while (rec < len && (text[rec] == ' ' || text[rec] == '\t' || text[rec] == '\r'))
+            rec++;
+        if (rec < len && text[rec] == ':' && len - rec >= 9){
+            uint32_t type = scan_hex_field(&text[rec + 7], 2);
+            if ((type == 0x02 || type == 0x04) && len - rec >= 13){
+                uint32_t value = scan_hex_field(&text[rec + 9], 4);
+                base = (type == 0x02) ? value << 4 : value << 16;
+                if (base > max_base) max_base = base;
+            } else if (type == 0x01){
+                // anything after the end of file record is ignored
+                const char *nl = memchr(text + rec, '\n', len - rec);
+                len = nl ? (size_t)(nl - text) + 1 : len;
+                break;
+            }
+        }
+        const char *nl = memchr(text + pos, '\n', len - pos);
+        pos = nl ? (size_t)(nl - text) + 1 : len;
+        line++;
+    }
+    count = chunk + 1;
+    for (int i = 0; i < count; i++){
+        const char *end = (i + 1 < count) ? chunks[i + 1].text : text + len;
+        chunks[i].len = (size_t)(end - chunks[i].text);
+        chunks[i].last = (i + 1 == count);
+        chunks[i].img = img;
+        chunks[i].filename = filename;
+    }
+
+    // the shared image is sized up front, every record lies below the highest base plus one segment
+    uint64_t bound = (uint64_t)max_base + 0x10000 + 0xFF;
+    ftStatus = image_reserve(img, bound < IMAGE_MAX_SIZE ? (uint32_t)bound : IMAGE_MAX_SIZE);
+
+    // pass two: decode the chunks in parallel
+    int started = 0;
+    if (ftStatus == FT_OK){
+        for (; started < count; started++){
+            if (platform_thread_start(&threads[started], chunk_thread, &chunks[started]) != FT_OK) break;
+        }
+        // run whatever could not get a thread here
+        for (int i = started; i < count; i++)
+            chunk_thread(&chunks[i]);
+        for (int i = 0; i < started; i++)
+            platform_thread_join(&threads[i]);
+        for (int i = 0; i < count && ftStatus == FT_OK; i++)
+            ftStatus = chunks[i].status;
+        if (ftStatus == FT_OK)
+            ftStatus = check_chunk_overlap(filename, chunks, count);
+    }
+
+    for (int i = 0; i < count; i++)
+        fileparser_hex_free(&chunks[i].parser);
+    free(chunks);
+    free(text);
+
+    // page CRCs are as costly as parsing, split them across the same number of threads
+    if (ftStatus == FT_OK)
+        ftStatus = image_finalize_layout(img);
+    if (ftStatus == FT_OK)
+        image_crc_parallel(img, count);
+    if (ftStatus != FT_OK)
+        image_free(img);
+    return ftStatus;
+}
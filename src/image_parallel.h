@@ -0,0 +1,51 @@
+/*! @file image_parallel.h
+ *  @brief Parallel Intel HEX loader for very large files.
+ *
+ * Extended address records (02/04) carry state from line to line, so a plain
+ * Intel HEX parser is strictly sequential. This loader parses in two passes:
+ *
+ * 1. A fast scan finds line boundaries, the position of every 02/04 record and
+ *    the end of file record, and splits the file into chunks of whole lines.
+ * 2. Each chunk gets the base address in effect at its first line and is decoded
+ *    by its own @ref HexParser on a separate thread, straight into a shared image.
+ *
+ * @details
+ * Every record is fully validated in the second pass, so error reporting and
+ * overlap detection match @ref fileparser_stream_intel_hex. Overlaps between
+ * chunks are found by merging the address ranges of all chunks afterwards.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef IMAGE_PARALLEL_H
+#define IMAGE_PARALLEL_H
+
+#include "image.h"
+#include "ftd2xx.h"
+
+//! Files smaller than this are parsed sequentially
+#define IMAGE_PARALLEL_MIN_SIZE  0x100000
+//! Smallest chunk given to a single thread
+#define IMAGE_PARALLEL_MIN_CHUNK 0x40000
+//! Upper limit on parser threads
+#define IMAGE_PARALLEL_MAX_THREADS 32
+
+/*!
+ * @brief Checks whether a file is large enough to benefit from parallel parsing.
+ *
+ * @param[in] filename Path to the Intel HEX file
+ * @return int 1 if the file should be parsed in parallel, 0 otherwise
+ */
+int image_parallel_worthwhile(const char *filename);
+
+/*!
+ * @brief Loads an Intel HEX file into a new image using all processors.
+ *
+ * @param[out] img Image to build, finalized on success
+ * @param[in] filename Path to the Intel HEX file
+ * @return FT_STATUS Status of the operation, see @ref fileparser_stream_intel_hex
+ */
+FT_STATUS image_load_intel_hex_parallel(Image *img, const char *filename);
+
+#endif
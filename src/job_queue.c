@@ -0,0 +1,447 @@
+#include "job_queue.h"
+
+#include "utils.h"
+#include "platform.h"
+#include "programmer.h"
+#include "pipeline.h"
+#include "image.h"
+
+/*!
+ * @struct JobWorker
+ * @brief Queue and thread state of a single channel worker
+ */
+typedef struct {
+    PlatformThread thread; /*!< Worker thread */
+    Job *head;             /*!< Next job to run */
+    Job *tail;             /*!< Last queued job */
+    Job *active;           /*!< Job currently executing */
+    PlatformCond cv;       /*!< Signalled when a job is queued */
+} JobWorker;
+
+static JobWorker workers[JOB_CHANNEL_NUM];
+//! Protects the worker queues and job states
+static PlatformMutex lock;
+//! Signalled whenever a job completes
+static PlatformCond done_cv;
+static int running;
+//! Batch of a compiled program with the learned program time delay, only the SPI worker sends them
+static uint8_t batch_cmd[FLASH_CMD_MAX_LEN];
+
+
+static void job_notify(Job *job, job_event_t event){
+    if (job->callback)
+        job->callback(job, event);
+}
+
+static void job_progress(job_channel_t channel, uint32_t length){
+    Job *job = workers[channel].active;
+    job->bytes_done += length;
+    job_notify(job, JOB_EVENT_PROGRESS);
+}
+
+// data not sent to flash counts as progress but not as written, pages are counted once however they are split.
+// bytes_skipped never runs ahead of bytes_done, the progress display reads it first
+static void job_progress_skipped(job_channel_t channel, uint32_t addr, uint32_t len, uint32_t page_size){
+    Job *job = workers[channel].active;
+    uint32_t page = addr / page_size + 1;
+    if (page != job->skip_page){
+        job->skip_page = page;
+        job->pages_skipped++;
+    }
+    job_progress(channel, len);
+    job->bytes_skipped += len;
+}
+
+// programming 0xFF never changes flash contents, like a compiled program such blocks are not sent
+static int job_block_erased(const uint8_t *data, uint32_t len){
+    for (uint32_t i = 0; i < len; i++){
+        if (data[i] != 0xFF) return 0;
+    }
+    return 1;
+}
+
+// pipeline/fileparser callbacks, report progress on the job active on their channel
+static FT_STATUS flash_program_cb(uint32_t addr, const uint8_t *data, uint32_t len){
+    const FlashDiff *diff = workers[JOB_CHANNEL_SPI].active->diff;
+    if (job_block_erased(data, len) || (diff && !flash_diff_needs_program(diff, addr))){
+        job_progress_skipped(JOB_CHANNEL_SPI, addr, len, programmer_flash_part()->page_size);
+        return FT_OK;
+    }
+    FT_STATUS ftStatus = programmer_flash_write(addr, data, len);
+    if (ftStatus == FT_OK) job_progress(JOB_CHANNEL_SPI, len);
+    return ftStatus;
+}
+
+static FT_STATUS flash_verify_cb(uint32_t addr, const uint8_t *data, uint32_t len){
+    FT_STATUS ftStatus = programmer_flash_verify(addr, data, len);
+    if (ftStatus == FT_OK) job_progress(JOB_CHANNEL_SPI, len);
+    return ftStatus;
+}
+
+static FT_STATUS clock_program_cb(uint32_t addr, const uint8_t *data, uint32_t len){
+    FT_STATUS ftStatus = programmer_clock_write_page(addr, data, (uint8_t)len);
+    if (ftStatus == FT_OK) job_progress(JOB_CHANNEL_I2C, len);
+    return ftStatus;
+}
+
+static FT_STATUS clock_verify_cb(uint32_t addr, const uint8_t *data, uint32_t len){
+    FT_STATUS ftStatus = programmer_clock_verify_page(addr, data, (uint8_t)len);
+    if (ftStatus == FT_OK) job_progress(JOB_CHANNEL_I2C, len);
+    return ftStatus;
+}
+
+// feeds every segment of an image to a callback in blocks that never cross a block boundary
+static FT_STATUS job_stream_image(const Image *img, FT_STATUS (*callback)(uint32_t addr, const uint8_t *data, uint32_t len),
+                                  uint32_t block, uint32_t max_len){
+    for (uint32_t i = 0; i < img->segment_count; i++){
+        uint32_t addr = img->segments[i].addr;
+        uint32_t end = addr + img->segments[i].len;
+        while (addr < end){
+            uint32_t chunk = block - (addr % block);
+            if (chunk > end - addr) chunk = end - addr;
+            if (chunk > max_len) chunk = max_len;
+            RETURN_IF_ERROR(callback(addr, img->data + addr, chunk));
+            addr += chunk;
+        }
+    }
+    return FT_OK;
+}
+
+// steps whose page already holds its data, by the plan of a differential erase, are not sent
+static int job_step_needed(const Job *job, const FlashStep *step){
+    return !job->diff || flash_diff_needs_program(job->diff, step->address);
+}
+
+// sends the precompiled page buffers a batch per round trip, erased pages were left out at compile time
+static FT_STATUS job_run_compiled(Job *job){
+    const FlashCompiled *compiled = job->compiled;
+    job->pages_skipped = compiled->pages_skipped;
+    if (compiled->bytes_skipped)
+        job_progress(JOB_CHANNEL_SPI, compiled->bytes_skipped);
+    job->bytes_skipped = compiled->bytes_skipped;
+
+    int polled = 0;
+    uint32_t delay_us = 0;
+    for (uint32_t i = 0; i < compiled->step_count; ){
+        const FlashStep *batch = &compiled->steps[i];
+        if (!job_step_needed(job, batch)){
+            job_progress_skipped(JOB_CHANNEL_SPI, batch->address, batch->length, job->diff->page_size);
+            i++;
+            continue;
+        }
+        // the first page sent is polled on its own, its program time keeps the timing model of the part current
+        if (!polled){
+            RETURN_IF_ERROR(programmer_flash_run_polled(batch->address, compiled->cmd + batch->offset, batch->poll_len));
+            job_progress(JOB_CHANNEL_SPI, batch->length);
+            polled = 1;
+            i++;
+            continue;
+        }
+        // pages are compiled with the datasheet delay, the learned one includes the time just polled
+        if (!delay_us)
+            delay_us = flash_program_delay_us(programmer_flash_part());
+
+        // a skipped step ends the batch
+        uint32_t pages = 1;
+        while (pages < FLASH_BATCH_PAGES && i + pages < compiled->step_count && job_step_needed(job, &batch[pages]))
+            pages++;
+        uint32_t cmd_len = flash_compiled_batch(compiled, i, pages, delay_us, batch_cmd);
+        uint32_t bytes = 0;
+        for (uint32_t k = 0; k < pages; k++)
+            bytes += batch[k].length;
+
+        uint32_t done;
+        if (programmer_flash_run_batch(batch[0].address, batch_cmd, cmd_len, pages, &done) != FT_OK){
+            // the pages before the failed one are programmed, replay from it with a round trip per page, each polled until done
+            LOG_WARN("flash batch at 0x%06X failed at 0x%06X, replaying page by page\n", batch[0].address, batch[done].address);
+            job->retries++;
+            for (uint32_t k = done; k < pages; k++)
+                RETURN_IF_ERROR(programmer_flash_run_polled(batch[k].address, compiled->cmd + batch[k].offset, batch[k].poll_len));
+            // the polled pages taught the timing model, the next batch gets the new delay
+            delay_us = flash_program_delay_us(programmer_flash_part());
+        }
+        job_progress(JOB_CHANNEL_SPI, bytes);
+        i += pages;
+    }
+    return FT_OK;
+}
+
+// erases the sectors of a differential plan that hold a page needing it, the whole chip if the part has no sector erase
+static FT_STATUS job_erase_sectors(FlashDiff *diff, const FlashPart *part){
+    FT_STATUS ftStatus = FT_OK;
+    uint32_t sector = part->erase[0].size;
+    uint32_t end = diff->page_count * diff->page_size;
+    int whole_chip = sector == 0 || sector % diff->page_size != 0;
+    if (whole_chip)
+        sector = end;
+
+    for (uint32_t addr = 0; addr < end && ftStatus == FT_OK; addr += sector){
+        if (!flash_diff_sector_needs_erase(diff, addr, sector))
+            continue;
+        RETURN_IF_ERROR(programmer_flash_set_write_state(1));
+        ftStatus = whole_chip ? programmer_flash_erase_chip() : programmer_flash_erase(addr, sector);
+        if (ftStatus == FT_OK)
+            flash_diff_erased(diff, addr, sector);
+    }
+    if (ftStatus != FT_OK)
+        programmer_flash_set_write_state(0);
+    return ftStatus;
+}
+
+// reads back the image range of the chip, classifies every page against the image and erases only where bits must be set
+static FT_STATUS job_erase_differential(Job *job){
+    const Image *img = job->image;
+    const FlashPart *part = programmer_flash_part();
+    uint8_t current[FLASH_VERIFY_BLOCK];
+    RETURN_IF_ERROR(flash_diff_init(job->diff, img->size, part->page_size));
+
+    for (uint32_t i = 0; i < img->segment_count; i++){
+        uint32_t addr = img->segments[i].addr;
+        uint32_t end = addr + img->segments[i].len;
+        while (addr < end){
+            uint32_t chunk = FLASH_VERIFY_BLOCK - (addr % FLASH_VERIFY_BLOCK);
+            if (chunk > end - addr) chunk = end - addr;
+            RETURN_IF_ERROR(programmer_flash_read(addr, current, chunk));
+            for (uint32_t off = 0; off < chunk; ){
+                uint32_t len = part->page_size - ((addr + off) % part->page_size);
+                if (len > chunk - off) len = chunk - off;
+                flash_diff_mark(job->diff, addr + off, flash_diff_classify(current + off, img->data + addr + off, len));
+                off += len;
+            }
+            job_progress(JOB_CHANNEL_SPI, chunk);
+            addr += chunk;
+        }
+    }
+    flash_diff_count(job->diff);
+    return job_erase_sectors(job->diff, part);
+}
+
+// uses the preloaded image in blocks of up to block bytes, or streams the file through the parse pipeline
+static FT_STATUS job_flash_stream(Job *job, FT_STATUS (*callback)(uint32_t addr, const uint8_t *data, uint32_t len), uint32_t block){
+    if (job->image)
+        return job_stream_image(job->image, callback, block, block);
+    return pipeline_stream_intel_hex(job->filename, callback, &job->pipeline);
+}
+
+// clock files are tiny, load them whole when no image was preloaded
+static FT_STATUS job_clock_stream(Job *job, FT_STATUS (*callback)(uint32_t addr, const uint8_t *data, uint32_t len)){
+    // programmer clock functions take at most 255 bytes
+    const uint32_t max_len = 255;
+    if (job->image)
+        return job_stream_image(job->image, callback, IMAGE_PAGE_SIZE, max_len);
+
+    Image img;
+    RETURN_IF_ERROR(image_load(&img, job->filename));
+    FT_STATUS ftStatus = job_stream_image(&img, callback, IMAGE_PAGE_SIZE, max_len);
+    image_free(&img);
+    return ftStatus;
+}
+
+static FT_STATUS job_execute(Job *job){
+    FT_STATUS ftStatus;
+
+    switch (job->type){
+        case JOB_FLASH_ERASE:
+            RETURN_IF_ERROR(programmer_flash_select_chip(job->chipSelect));
+            if (job->diff && job->image)
+                return job_erase_differential(job);
+            RETURN_IF_ERROR(programmer_flash_set_write_state(1));
+            ftStatus = programmer_flash_erase_chip();
+            if (ftStatus != FT_OK)
+                programmer_flash_set_write_state(0);
+            return ftStatus;
+
+        case JOB_FLASH_PROGRAM:
+            RETURN_IF_ERROR(programmer_flash_select_chip(job->chipSelect));
+            if (job->compiled)
+                ftStatus = job_run_compiled(job);
+            else
+                ftStatus = job_flash_stream(job, flash_program_cb, IMAGE_PAGE_SIZE);
+            // always leave the chip write protected
+            if (programmer_flash_set_write_state(0) != FT_OK && ftStatus == FT_OK)
+                ftStatus = FT_OTHER_ERROR;
+            return ftStatus;
+
+        case JOB_FLASH_VERIFY:
+            RETURN_IF_ERROR(programmer_flash_select_chip(job->chipSelect));
+            // verify reads back whole blocks per transfer
+            return job_flash_stream(job, flash_verify_cb, FLASH_VERIFY_BLOCK);
+
+        case JOB_CLOCK_PROGRAM:
+            return job_clock_stream(job, clock_program_cb);
+
+        case JOB_CLOCK_VERIFY:
+            return job_clock_stream(job, clock_verify_cb);
+
+        case JOB_CLOCK_BURN:
+            return programmer_clock_burn();
+
+        default:
+            return FT_INVALID_PARAMETER;
+    }
+}
+
+static void job_worker_thread(void *param){
+    JobWorker *worker = (JobWorker *)param;
+
+    platform_mutex_lock(&lock);
+    for (;;){
+        while (!worker->head && running)
+            platform_cond_wait(&worker->cv, &lock);
+        if (!worker->head)
+            break; // closing and queue drained
+
+        // pop next job
+        Job *job = worker->head;
+        worker->head = job->next;
+        if (!worker->head) worker->tail = NULL;
+
+        // dependencies on other channels may still be running, the job stays pending until they finish.
+        // job_submit only accepts dependencies already queued, so they always finish
+        while (job->after && job->after->state != JOB_DONE)
+            platform_cond_wait(&done_cv, &lock);
+        worker->active = job;
+        job->state = JOB_RUNNING;
+        platform_mutex_unlock(&lock);
+
+        FT_STATUS ftStatus;
+        if (job->after && job->after->status != FT_OK){
+            ftStatus = job->after->status; // skipped
+        } else {
+            job_notify(job, JOB_EVENT_STARTED);
+            uint64_t start = platform_time_us();
+            ftStatus = job_execute(job);
+            job->elapsed_ms = platform_elapsed_ms(start);
+        }
+
+        // notify before marking done, a waiter may release the job afterwards
+        job->status = ftStatus;
+        job_notify(job, JOB_EVENT_COMPLETE);
+
+        platform_mutex_lock(&lock);
+        job->state = JOB_DONE;
+        worker->active = NULL;
+        platform_cond_wake_all(&done_cv);
+    }
+    platform_mutex_unlock(&lock);
+}
+
+
+job_channel_t job_channel(job_type_t type){
+    switch (type){
+        case JOB_CLOCK_PROGRAM:
+        case JOB_CLOCK_VERIFY:
+        case JOB_CLOCK_BURN:
+            return JOB_CHANNEL_I2C;
+        default:
+            return JOB_CHANNEL_SPI;
+    }
+}
+
+FT_STATUS job_queue_init(void){
+    platform_mutex_init(&lock);
+    platform_cond_init(&done_cv);
+    running = 1;
+
+    for (int i = 0; i < JOB_CHANNEL_NUM; i++){
+        workers[i].head = NULL;
+        workers[i].tail = NULL;
+        workers[i].active = NULL;
+        platform_cond_init(&workers[i].cv);
+        if (platform_thread_start(&workers[i].thread, job_worker_thread, &workers[i]) != FT_OK){
+            job_queue_close();
+            return FT_OTHER_ERROR;
+        }
+    }
+    return FT_OK;
+}
+
+FT_STATUS job_submit(Job *job){
+    if (!job || job->type > JOB_CLOCK_BURN)
+        return FT_INVALID_PARAMETER;
+    if (!job->filename && !job->image && job->type != JOB_FLASH_ERASE && job->type != JOB_CLOCK_BURN)
+        return FT_INVALID_PARAMETER;
+
+    JobWorker *worker = &workers[job_channel(job->type)];
+    job->state = JOB_PENDING;
+    job->status = FT_OK;
+    job->bytes_done = 0;
+    // a differential erase reads and compares the image range first
+    job->bytes_total = (job->image && (job->type != JOB_FLASH_ERASE || job->diff) && job->type != JOB_CLOCK_BURN) ? job->image->data_bytes : 0;
+    job->bytes_skipped = 0;
+    job->pages_skipped = 0;
+    job->skip_page = 0;
+    job->retries = 0;
+    job->elapsed_ms = 0;
+    job->next = NULL;
+
+    platform_mutex_lock(&lock);
+    if (!running){
+        platform_mutex_unlock(&lock);
+        return FT_OTHER_ERROR;
+    }
+    // a dependency never submitted would be waited for forever
+    if (job->after && job->after->state == JOB_IDLE){
+        platform_mutex_unlock(&lock);
+        job->state = JOB_IDLE;
+        return FT_INVALID_PARAMETER;
+    }
+    // a failed dependency skips the job without queueing it behind the work of its channel
+    if (job->after && job->after->state == JOB_DONE && job->after->status != FT_OK){
+        job->status = job->after->status;
+        platform_mutex_unlock(&lock);
+        job_notify(job, JOB_EVENT_COMPLETE);
+        platform_mutex_lock(&lock);
+        job->state = JOB_DONE;
+        platform_cond_wake_all(&done_cv);
+        platform_mutex_unlock(&lock);
+        return FT_OK;
+    }
+    if (worker->tail)
+        worker->tail->next = job;
+    else
+        worker->head = job;
+    worker->tail = job;
+    platform_cond_wake_one(&worker->cv);
+    platform_mutex_unlock(&lock);
+    return FT_OK;
+}
+
+void job_skip(Job *job, FT_STATUS status){
+    job->status = status;
+    job->bytes_done = 0;
+    job->bytes_total = 0;
+    job->bytes_skipped = 0;
+    job->pages_skipped = 0;
+    job->retries = 0;
+    job->elapsed_ms = 0;
+    job->next = NULL;
+    job->state = JOB_DONE;
+}
+
+int job_is_done(Job *job){
+    return job->state == JOB_DONE;
+}
+
+FT_STATUS job_wait(Job *job){
+    platform_mutex_lock(&lock);
+    while (job->state != JOB_DONE)
+        platform_cond_wait(&done_cv, &lock);
+    platform_mutex_unlock(&lock);
+    return job->status;
+}
+
+void job_queue_close(void){
+    platform_mutex_lock(&lock);
+    running = 0;
+    for (int i = 0; i < JOB_CHANNEL_NUM; i++)
+        platform_cond_wake_one(&workers[i].cv);
+    platform_mutex_unlock(&lock);
+
+    for (int i = 0; i < JOB_CHANNEL_NUM; i++){
+        platform_thread_join(&workers[i].thread);
+        platform_cond_destroy(&workers[i].cv);
+    }
+    platform_cond_destroy(&done_cv);
+    platform_mutex_destroy(&lock);
+}
@@ -0,0 +1,180 @@
+/*! @file job_queue.h
+ *  @brief Asynchronous job queue for programming operations.
+ *
+ * Provides a worker thread for each AmPLink communication channel that executes
+ * erase/program/verify/burn jobs in the background. Jobs submitted to different
+ * channels run concurrently, jobs on the same channel run in submission order.
+ *
+ * @details
+ * Jobs are allocated and owned by the caller and must stay valid until
+ * @ref job_wait has returned. Completion can be observed through the job
+ * callback, by polling @ref job_is_done, or by blocking in @ref job_wait.
+ *
+ * **Example usage:**
+ * @code
+ * Job erase = { .type = JOB_FLASH_ERASE, .chipSelect = SPI_CS_2 };
+ * Job program = { .type = JOB_FLASH_PROGRAM, .chipSelect = SPI_CS_2,
+ *                 .filename = "flash_2A.hex", .after = &erase };
+ * job_submit(&erase);
+ * job_submit(&program);
+ * FT_STATUS status = job_wait(&program);
+ * @endcode
+ *
+ * @note @ref programmer_init must be called before @ref job_queue_init.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "ftd2xx.h"
+#include "pipeline.h"
+#include "image.h"
+#include "flash_compiler.h"
+#include "flash_diff.h"
+
+/*!
+ * @enum job_type_t
+ * @brief Operations that can be submitted to the job queue
+ */
+typedef enum {
+    JOB_FLASH_ERASE,   /*!< Select flash chip, enable writes and erase it. With an image and a diff, read it and erase only the sectors that need it */
+    JOB_FLASH_PROGRAM, /*!< Write an image, or stream a HEX file through the parse pipeline, into the selected flash chip */
+    JOB_FLASH_VERIFY,  /*!< Read back the flash chip and compare it to an image or HEX file */
+    JOB_CLOCK_PROGRAM, /*!< Write an image or HEX file into the versaClock */
+    JOB_CLOCK_VERIFY,  /*!< Read back the versaClock and compare it to an image or HEX file */
+    JOB_CLOCK_BURN     /*!< Perform the versaClock OTP burn sequence */
+} job_type_t;
+
+/*!
+ * @enum job_channel_t
+ * @brief Worker channels, each backed by its own thread
+ */
+typedef enum {
+    JOB_CHANNEL_SPI, /*!< Flash jobs, executed on the SPI channel */
+    JOB_CHANNEL_I2C, /*!< Clock jobs, executed on the I2C channel */
+    JOB_CHANNEL_NUM  /*!< Number of worker channels */
+} job_channel_t;
+
+/*!
+ * @enum job_state_t
+ * @brief Lifecycle of a submitted job
+ */
+typedef enum {
+    JOB_IDLE,    /*!< Not submitted, the state of a zero initialized job */
+    JOB_PENDING, /*!< Queued, waiting for its worker or for the job it runs after */
+    JOB_RUNNING, /*!< Currently executing */
+    JOB_DONE     /*!< Finished, status is valid */
+} job_state_t;
+
+/*!
+ * @enum job_event_t
+ * @brief Events reported to the job callback
+ */
+typedef enum {
+    JOB_EVENT_STARTED,  /*!< Worker has started the job */
+    JOB_EVENT_PROGRESS, /*!< A block of data was written or verified, see Job::bytes_done */
+    JOB_EVENT_COMPLETE  /*!< Job finished, see Job::status */
+} job_event_t;
+
+struct Job;
+
+/*!
+ * @brief Job event callback.
+ *
+ * Called from the worker thread executing the job. Callbacks of jobs on
+ * different channels may run at the same time.
+ */
+typedef void (*job_callback_t)(struct Job *job, job_event_t event);
+
+/*!
+ * @struct Job
+ * @brief A single programming operation and its result
+ */
+typedef struct Job {
+    job_type_t type;              /*!< Operation to perform */
+    spi_chip_select_t chipSelect; /*!< Flash chip for flash jobs */
+    const char *filename;         /*!< Input file for program/verify jobs, used when image is NULL */
+    const Image *image;           /*!< Optional preloaded image for program/verify jobs */
+    const FlashCompiled *compiled; /*!< Optional image compiled for the chip, sent as is by program jobs instead of image */
+    FlashDiff *diff;              /*!< Optional plan shared by a differential erase and its program job, see @ref flash_diff.h */
+    struct Job *after;            /*!< Optional job, submitted or skipped earlier, that must succeed first. The job is skipped otherwise */
+    job_callback_t callback;      /*!< Optional event callback */
+    void *user;                   /*!< User data for the callback */
+
+    volatile job_state_t state;   /*!< Set by the queue */
+    volatile FT_STATUS status;    /*!< Set by the queue, valid once state is JOB_DONE */
+    volatile uint32_t bytes_done; /*!< Set by the queue, bytes written or verified so far */
+    uint32_t bytes_total;         /*!< Set by the queue, bytes to write, verify or compare, 0 if unknown (streamed files, chip erase, burn) */
+    volatile uint32_t bytes_skipped; /*!< Set by the queue, bytes of bytes_done not sent to flash by program jobs */
+    volatile uint32_t pages_skipped; /*!< Set by the queue, erased (all 0xFF) pages and pages already in place not sent to flash by program jobs */
+    uint32_t retries;             /*!< Set by the queue, operations repeated after an error */
+    double elapsed_ms;            /*!< Set by the queue, execution time, 0 if skipped */
+    PipelineStats pipeline;       /*!< Set by the queue, parser ring statistics of streamed flash program/verify jobs */
+    uint32_t skip_page;           /*!< Internal, one past the last page counted in pages_skipped */
+    struct Job *next;             /*!< Internal queue link */
+} Job;
+
+/*!
+ * @brief Starts a worker thread for each channel.
+ *
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS job_queue_init(void);
+
+/*!
+ * @brief Queues a job on the worker of its channel.
+ *
+ * A job whose Job::after has already failed is completed at once with its
+ * status, the complete event is sent from the calling thread.
+ *
+ * @param[in,out] job Job to run, must remain valid until @ref job_wait returns
+ * @return FT_STATUS FT_OK if queued or completed, FT_INVALID_PARAMETER if the job is invalid
+ *         or Job::after was neither submitted nor skipped
+ */
+FT_STATUS job_submit(Job *job);
+
+/*!
+ * @brief Completes a job with a status without running it, e.g. for an absent chip.
+ *
+ * The job must not be submitted. No callback is called.
+ *
+ * @param[in,out] job Job to complete
+ * @param[in] status Status to report
+ */
+void job_skip(Job *job, FT_STATUS status);
+
+/*!
+ * @brief Checks whether a job has finished without blocking.
+ *
+ * @param[in] job Submitted job
+ * @return int 1 if the job is done, 0 otherwise
+ */
+int job_is_done(Job *job);
+
+/*!
+ * @brief Blocks until a job has finished.
+ *
+ * @param[in] job Submitted job
+ * @return FT_STATUS Final status of the job
+ */
+FT_STATUS job_wait(Job *job);
+
+/*!
+ * @brief Returns the worker channel a job type runs on.
+ *
+ * @param[in] type Job type
+ * @return job_channel_t Channel of the job
+ */
+job_channel_t job_channel(job_type_t type);
+
+/*!
+ * @brief Finishes all queued jobs and stops the worker threads.
+ */
+void job_queue_close(void);
+
+#endif
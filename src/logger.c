@@ -0,0 +1,375 @@
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "platform.h"
+
+#define LOGGER_LINE_LEN 512
+
+/*!
+ * @union LogArg
+ * @brief A captured format argument
+ */
+typedef union {
+    int64_t i;     /*!< Integer and character arguments, string offsets (-1 for NULL) */
+    double d;      /*!< Floating point arguments */
+    const void *p; /*!< Pointer arguments */
+} LogArg;
+
+/*!
+ * @struct LogRecord
+ * @brief A captured, not yet formatted, log call
+ */
+typedef struct {
+    volatile long seq;       /*!< Ring sequence, see logger_enqueue */
+    int level;               /*!< Record level */
+    uint64_t time_ms;        /*!< Capture time since logger start */
+    const char *fmt;         /*!< Format string */
+    int arg_count;           /*!< Captured arguments */
+    LogArg args[LOGGER_MAX_ARGS];
+    char strings[LOGGER_STRING_SPACE]; /*!< Copied string arguments */
+} LogRecord;
+
+/*!
+ * @struct LogSpec
+ * @brief A parsed printf conversion specification
+ */
+typedef struct {
+    const char *flags;  /*!< Flag characters */
+    int flags_len;      /*!< Number of flag characters */
+    int width_star;     /*!< Width taken from an argument */
+    const char *width;  /*!< Width digits */
+    int width_len;      /*!< Number of width digits */
+    int has_prec;       /*!< Precision present */
+    int prec_star;      /*!< Precision taken from an argument */
+    const char *prec;   /*!< Precision digits */
+    int prec_len;       /*!< Number of precision digits */
+    char length;        /*!< 0, 'h', 'l' (long), 'q' (long long), 'z', 'j', 't' or 'L' */
+    char conv;          /*!< Conversion character */
+} LogSpec;
+
+static LogRecord ring[LOGGER_RING_SIZE];
+static volatile long head;
+static long tail;
+static volatile long dropped;
+static long dropped_reported;
+static volatile long running;
+static PlatformMutex flush_lock;
+static PlatformThread flush_thread;
+static PlatformEvent wake;
+static uint64_t start_ms;
+
+static const char *level_names[] = {"", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+
+
+// parses the specification after a '%', returns the character after the conversion
+static const char *logger_parse_spec(const char *p, LogSpec *s){
+    memset(s, 0, sizeof(*s));
+    s->flags = p;
+    while (*p && strchr("-+ #0", *p)) p++;
+    s->flags_len = (int)(p - s->flags);
+    if (*p == '*'){
+        s->width_star = 1;
+        p++;
+    } else {
+        s->width = p;
+        while (*p >= '0' && *p <= '9') p++;
+        s->width_len = (int)(p - s->width);
+    }
+    if (*p == '.'){
+        s->has_prec = 1;
+        p++;
+        if (*p == '*'){
+            s->prec_star = 1;
+            p++;
+        } else {
+            s->prec = p;
+            while (*p >= '0' && *p <= '9') p++;
+            s->prec_len = (int)(p - s->prec);
+        }
+    }
+    switch (*p){
+        case 'h': s->length = 'h'; p++; if (*p == 'h') p++; break;
+        case 'l': s->length = 'l'; p++; if (*p == 'l'){ s->length = 'q'; p++; } break;
+        case 'z': case 'j': case 't': case 'L': s->length = *p++; break;
+        default: break;
+    }
+    s->conv = *p;
+    return *p ? p + 1 : p;
+}
+
+static int64_t logger_signed_arg(va_list *ap, char length){
+    switch (length){
+        case 'l': return va_arg(*ap, long);
+        case 'q': return va_arg(*ap, long long);
+        case 'z': return (int64_t)va_arg(*ap, size_t);
+        case 'j': return (int64_t)va_arg(*ap, intmax_t);
+        case 't': return (int64_t)va_arg(*ap, ptrdiff_t);
+        default:  return va_arg(*ap, int);
+    }
+}
+
+static int64_t logger_unsigned_arg(va_list *ap, char length){
+    switch (length){
+        case 'l': return (int64_t)va_arg(*ap, unsigned long);
+        case 'q': return (int64_t)va_arg(*ap, unsigned long long);
+        case 'z': return (int64_t)va_arg(*ap, size_t);
+        case 'j': return (int64_t)va_arg(*ap, uintmax_t);
+        case 't': return (int64_t)va_arg(*ap, ptrdiff_t);
+        default:  return (int64_t)va_arg(*ap, unsigned int);
+    }
+}
+
+// copies the arguments described by fmt into the record, no formatting happens here
+static void logger_capture(LogRecord *r, const char *fmt, va_list ap){
+    LogSpec s;
+    int used = 0;
+    va_list args;
+    va_copy(args, ap);
+
+    r->fmt = fmt;
+    r->arg_count = 0;
+    for (const char *p = fmt; *p; ){
+        if (*p++ != '%') continue;
+        if (*p == '%'){
+            p++;
+            continue;
+        }
+        p = logger_parse_spec(p, &s);
+        int needed = 1 + s.width_star + s.prec_star;
+        if (r->arg_count + needed > LOGGER_MAX_ARGS) break;
+        if (s.width_star) r->args[r->arg_count++].i = va_arg(args, int);
+        if (s.prec_star)  r->args[r->arg_count++].i = va_arg(args, int);
+
+        LogArg *a = &r->args[r->arg_count++];
+        switch (s.conv){
+            case 'd': case 'i':
+                a->i = logger_signed_arg(&args, s.length);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                a->i = logger_unsigned_arg(&args, s.length);
+                break;
+            case 'c':
+                a->i = va_arg(args, int);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                a->d = (s.length == 'L') ? (double)va_arg(args, long double) : va_arg(args, double);
+                break;
+            case 'p':
+                a->p = va_arg(args, void *);
+                break;
+            case 's': {
+                const char *str = va_arg(args, const char *);
+                if (!str){
+                    a->i = -1;
+                    break;
+                }
+                // used never passes the last byte, later strings become empty once space runs out
+                size_t len = strlen(str);
+                size_t room = (size_t)(LOGGER_STRING_SPACE - 1 - used);
+                if (len > room) len = room;
+                memcpy(&r->strings[used], str, len);
+                r->strings[used + len] = '\0';
+                a->i = used;
+                used += (int)len;
+                if (used < LOGGER_STRING_SPACE - 1) used++;
+                break;
+            }
+            default:
+                // unsupported conversion, stop capturing
+                r->arg_count--;
+                va_end(args);
+                return;
+        }
+    }
+    va_end(args);
+}
+
+// formats a captured record, the format string is walked a second time with the stored arguments
+static void logger_format(const LogRecord *r, char *out, size_t size){
+    LogSpec s;
+    char spec[48];
+    int arg = 0;
+    size_t n = (size_t)snprintf(out, size, "[%7.3f %-5s] ", r->time_ms / 1000.0, level_names[r->level]);
+
+    for (const char *p = r->fmt; *p && n + 1 < size; ){
+        if (*p != '%'){
+            out[n++] = *p++;
+            continue;
+        }
+        p++;
+        if (*p == '%'){
+            out[n++] = *p++;
+            continue;
+        }
+        p = logger_parse_spec(p, &s);
+        if (arg + 1 + s.width_star + s.prec_star > r->arg_count) break;
+
+        // rebuild the specification with resolved widths and a fixed argument size
+        int len = snprintf(spec, sizeof(spec), "%%%.*s", s.flags_len, s.flags);
+        if (s.width_star) len += snprintf(spec + len, sizeof(spec) - len, "%d", (int)r->args[arg++].i);
+        else              len += snprintf(spec + len, sizeof(spec) - len, "%.*s", s.width_len, s.width);
+        if (s.prec_star)     len += snprintf(spec + len, sizeof(spec) - len, ".%d", (int)r->args[arg++].i);
+        else if (s.has_prec) len += snprintf(spec + len, sizeof(spec) - len, ".%.*s", s.prec_len, s.prec);
+
+        const LogArg *a = &r->args[arg++];
+        int written;
+        switch (s.conv){
+            case 'd': case 'i':
+                snprintf(spec + len, sizeof(spec) - len, "ll%c", s.conv);
+                written = snprintf(out + n, size - n, spec, (long long)a->i);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                snprintf(spec + len, sizeof(spec) - len, "ll%c", s.conv);
+                written = snprintf(out + n, size - n, spec, (unsigned long long)a->i);
+                break;
+            case 'c':
+                snprintf(spec + len, sizeof(spec) - len, "c");
+                written = snprintf(out + n, size - n, spec, (int)a->i);
+                break;
+            case 'p':
+                snprintf(spec + len, sizeof(spec) - len, "p");
+                written = snprintf(out + n, size - n, spec, a->p);
+                break;
+            case 's':
+                snprintf(spec + len, sizeof(spec) - len, "s");
+                written = snprintf(out + n, size - n, spec, a->i < 0 ? "(null)" : &r->strings[a->i]);
+                break;
+            default:
+                snprintf(spec + len, sizeof(spec) - len, "%c", s.conv);
+                written = snprintf(out + n, size - n, spec, a->d);
+                break;
+        }
+        if (written < 0) break;
+        n += (size_t)written;
+        if (n >= size) n = size - 1;
+    }
+    out[n < size ? n : size - 1] = '\0';
+}
+
+static void logger_emit(const LogRecord *r){
+    char line[LOGGER_LINE_LEN];
+    logger_format(r, line, sizeof(line));
+    fputs(line, stderr);
+}
+
+static uint64_t logger_now_ms(void){
+    return platform_time_ms() - start_ms;
+}
+
+void logger_write(int level, const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+
+    if (!running){
+        LogRecord r;
+        r.level = level;
+        r.time_ms = start_ms ? logger_now_ms() : 0;
+        logger_capture(&r, fmt, ap);
+        va_end(ap);
+        logger_emit(&r);
+        return;
+    }
+
+    // bounded multi-producer ring, a slot is free when its sequence equals the claiming position
+    LogRecord *r;
+    for (;;){
+        long pos = head;
+        r = &ring[pos & (LOGGER_RING_SIZE - 1)];
+        long diff = r->seq - pos;
+        if (diff == 0){
+            if (platform_atomic_cas(&head, pos + 1, pos) == pos) break;
+        } else if (diff < 0){
+            platform_atomic_inc(&dropped);
+            va_end(ap);
+            return;
+        }
+    }
+    long pos = r->seq;
+    r->level = level;
+    r->time_ms = logger_now_ms();
+    logger_capture(r, fmt, ap);
+    va_end(ap);
+    platform_barrier();
+    r->seq = pos + 1;
+
+    if (level <= LOG_LEVEL_ERROR)
+        platform_event_set(&wake);
+}
+
+static void logger_drain(void){
+    platform_mutex_lock(&flush_lock);
+    for (;;){
+        LogRecord *r = &ring[tail & (LOGGER_RING_SIZE - 1)];
+        if (r->seq != tail + 1) break;
+        platform_barrier();
+        logger_emit(r);
+        platform_barrier();
+        r->seq = tail + LOGGER_RING_SIZE;
+        tail++;
+    }
+    long lost = dropped;
+    if (lost != dropped_reported){
+        fprintf(stderr, "[%7.3f WARN ] %ld log records dropped\n", logger_now_ms() / 1000.0, (long)(lost - dropped_reported));
+        dropped_reported = lost;
+    }
+    fflush(stderr);
+    platform_mutex_unlock(&flush_lock);
+}
+
+void logger_flush(void){
+    if (platform_thread_started(&flush_thread))
+        logger_drain();
+}
+
+static void logger_thread(void *param){
+    (void)param;
+    while (running){
+        platform_event_wait(&wake, LOGGER_FLUSH_MS);
+        logger_drain();
+    }
+}
+
+int logger_due(uint64_t *last_ms, uint32_t interval_ms){
+    uint64_t now = platform_time_ms();
+    if (*last_ms && now - *last_ms < interval_ms)
+        return 0;
+    *last_ms = now;
+    return 1;
+}
+
+void logger_init(void){
+    if (platform_thread_started(&flush_thread)) return;
+    start_ms = platform_time_ms();
+    for (long i = 0; i < LOGGER_RING_SIZE; i++)
+        ring[i].seq = i;
+    head = 0;
+    tail = 0;
+    platform_mutex_init(&flush_lock);
+    if (platform_event_init(&wake, 0) != FT_OK){
+        platform_mutex_destroy(&flush_lock);
+        return;
+    }
+    running = 1;
+    if (platform_thread_start(&flush_thread, logger_thread, NULL) != FT_OK){
+        running = 0;
+        platform_event_destroy(&wake);
+        platform_mutex_destroy(&flush_lock);
+        return;
+    }
+    atexit(logger_close);
+}
+
+void logger_close(void){
+    if (!platform_thread_started(&flush_thread)) return;
+    running = 0;
+    platform_event_set(&wake);
+    platform_thread_join(&flush_thread);
+    // records captured while stopping
+    logger_drain();
+    platform_event_destroy(&wake);
+    platform_mutex_destroy(&flush_lock);
+}
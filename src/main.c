@@ -2,41 +2,213 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include <windows.h>
 #include "ftd2xx.h"
 
 #include "programmer.h"
-#include "fileparser.h"
+#include "image.h"
+#include "image_loader.h"
+#include "trace.h"
+#include "logger.h"
 #include "config.h"
 #include "cli.h"
+#include "board.h"
+#include "platform.h"
+#include "flash_timing.h"
 
 
 #define APP_CHECK_STATUS(exp) {if(exp!=FT_OK){printf("%s:%d:%s(): status(0x%x) \
 	!= FT_OK\n",__FILE__, __LINE__, __FUNCTION__,exp);}else{;}};
 
 
-static const char* chip_select_to_str(spi_chip_select_t cs){
-    switch(cs){
-        case SPI_CS_1:  return "1";
-        case SPI_CS_2:  return "2";
-        case SPI_CS_3:  return "3";
-        case SPI_CS_4:  return "4";
-        default:        return "?";
+// times both SPI engines on the first flash chip found, leaves the selected engine in place
+static int run_spi_benchmark(unsigned long iterations){
+    static const spi_chip_select_t chipSelects[] = {SPI_CS_2, SPI_CS_3, SPI_CS_4};
+    static const spi_engine_t engines[] = {SPI_ENGINE_LIBMPSSE, SPI_ENGINE_RAW};
+    spi_engine_t selected = spi_driver_engine();
+    const FlashPart *part = NULL;
+    int chip = -1;
+    int failed = 0;
+
+    for (int i = 0; i < 3 && chip < 0; i++){
+        if (programmer_flash_chip(chipSelects[i], &part) == FT_OK)
+            chip = i;
+    }
+    if (chip < 0){
+        printf("No flash chip found to benchmark\n");
+        return -1;
     }
+    printf("Benchmarking SPI engines on CS %s (%s), %lu reads each\n", board_chip_select_str(chipSelects[chip]), part->name, iterations);
+    for (int i = 0; i < 2; i++){
+        SpiBenchmark result;
+        FT_STATUS ftStatus = programmer_spi_set_engine(engines[i]);
+        if (ftStatus == FT_OK) ftStatus = programmer_flash_select_chip(chipSelects[chip]);
+        if (ftStatus == FT_OK) ftStatus = programmer_spi_benchmark((uint32_t)iterations, &result);
+        if (ftStatus != FT_OK){
+            printf("  %-9s FAILED! (%d)\n", spi_engine_to_str(engines[i]), (int)ftStatus);
+            failed = 1;
+            continue;
+        }
+        printf("  %-9s status read %8.1f us   %u B read %8.1f KB/s\n", spi_engine_to_str(engines[i]),
+               result.status_us, FLASH_VERIFY_BLOCK, result.read_kbps);
+    }
+    if (programmer_spi_set_engine(selected) != FT_OK)
+        failed = 1;
+    return failed ? -1 : 0;
 }
     
 
+static void print_usb_settings(const char *name, const UsbSettings *settings){
+    if (settings->latency_ms)
+        printf("  %-5s latency %3u ms, USB in %5u / out %5u bytes (%.0f us)\n", name, settings->latency_ms,
+               settings->in_size, settings->out_size, settings->us);
+    else
+        printf("  %-5s driver defaults\n", name);
+}
+
+// applies the cached USB settings of this AmPLink, sweeping the ones not cached yet
+static void tune_usb(int force){
+    UsbSettings spi, i2c, gpio;
+    int swept;
+    if (programmer_usb_tune(NULL, force, &swept) != FT_OK)
+        printf("Some channels could not be tuned and keep their driver defaults\n");
+    else if (swept)
+        printf("Tuned USB settings of %d channels, cached in '%s'\n", swept, USB_TUNING_DEFAULT_FILE);
+    programmer_get_usb_settings(&spi, &i2c, &gpio);
+    printf("USB settings:\n");
+    print_usb_settings("SPI", &spi);
+    print_usb_settings("I2C", &i2c);
+    print_usb_settings("GPIO", &gpio);
+}
+
+// loads the learned program and erase times of this AmPLink and reports their percentiles
+static void load_flash_timing(void){
+    const char *part, *op;
+    FlashTimingEstimate est;
+    if (flash_timing_load(FLASH_TIMING_DEFAULT_FILE, programmer_serial()) != FT_OK || !flash_timing_get(0, &part, &op, &est)){
+        printf("No flash timing recorded yet, polling from the datasheet times\n");
+        return;
+    }
+    printf("Flash timing:\n");
+    for (uint32_t i = 0; flash_timing_get(i, &part, &op, &est); i++)
+        printf("  %-12s %-11s p10 %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms (%u times)\n", part, op,
+               est.p10_us / 1000.0, est.p50_us / 1000.0, est.p90_us / 1000.0, est.p99_us / 1000.0, est.max_us / 1000.0, est.count);
+}
+
+// loads the input files again, the images in use are kept if any file fails
+static FT_STATUS reload_images(const Args *args, ImageLoad loads[BOARD_FILES]){
+    ImageLoad fresh[BOARD_FILES];
+    const Image *images[BOARD_FILES];
+    for (int i = 0; i < BOARD_FILES; i++)
+        fresh[i].filename = loads[i].filename;
+    if (image_loader_start(fresh, BOARD_FILES, args->cache_dir, args->no_cache) != FT_OK)
+        return FT_OTHER_ERROR;
+    if (image_loader_wait(fresh, BOARD_FILES) != FT_OK){
+        for (int i = 0; i < BOARD_FILES; i++){
+            if (fresh[i].status != FT_OK)
+                printf("Failed to load '%s'\n", fresh[i].filename);
+            image_free(&fresh[i].image);
+        }
+        return FT_IO_ERROR;
+    }
+    for (int i = 0; i < BOARD_FILES; i++){
+        image_free(&loads[i].image);
+        loads[i] = fresh[i];
+        images[i] = &loads[i].image;
+    }
+    board_set_images(images);
+    return FT_OK;
+}
+
+// serves commands from stdin until "quit" or end of input, every command is answered by one status line on out.
+// all other output goes to stdout, which daemon mode has moved onto stderr
+static int run_daemon(const Args *args, ImageLoad loads[BOARD_FILES], FILE *out){
+    char line[128];
+    fprintf(out, "READY\n");
+    fflush(out);
+    while (fgets(line, sizeof(line), stdin)){
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strcmp(line, "program") == 0){
+            // a new board is in the fixture, its chips may differ from the last one
+            uint64_t start = platform_time_us();
+            if (programmer_flash_probe() != FT_OK)
+                printf("Failed to probe flash chips\n");
+            FT_STATUS ftStatus = board_program();
+            if (ftStatus == FT_OK)
+                fprintf(out, "DONE OK %.0f\n", platform_elapsed_ms(start));
+            else
+                fprintf(out, "DONE FAIL %d %.0f\n", (int)ftStatus, platform_elapsed_ms(start));
+        } else if (strcmp(line, "reload") == 0){
+            if (reload_images(args, loads) == FT_OK)
+                fprintf(out, "RELOADED\n");
+            else
+                fprintf(out, "ERROR reload failed, previous images kept\n");
+        } else if (strcmp(line, "quit") == 0){
+            break;
+        } else if (line[0] != '\0'){
+            fprintf(out, "ERROR unknown command '%s'\n", line);
+        }
+        // the board output of a command is complete before its reply
+        fflush(stdout);
+        fflush(out);
+    }
+    return 0;
+}
+
+// programs every board inserted into the fixture until count boards are done, 0 runs until interrupted
+static int run_continuous(unsigned long count){
+    unsigned long boards = 0;
+    unsigned long passed = 0;
+    uint64_t start = 0;
+
+    printf("Waiting for a board...\n");
+    while (count == 0 || boards < count){
+        // the probe that detects the board is also the probe it is programmed with
+        if (board_wait(1) != FT_OK){
+            printf("Failed to probe flash chips, AmPLink disconnected?\n");
+            return -1;
+        }
+        if (!start) start = platform_time_us();
+        uint64_t boardStart = platform_time_us();
+        FT_STATUS ftStatus = board_program();
+        boards++;
+        if (ftStatus == FT_OK) passed++;
+
+        double hours = platform_elapsed_ms(start) / 3600000.0;
+        printf("Board %lu %s in %.1f s, %lu of %lu passed, %.0f boards/hour\n", boards,
+               ftStatus == FT_OK ? "PASSED" : "FAILED", platform_elapsed_ms(boardStart) / 1000.0,
+               passed, boards, hours > 0 ? boards / hours : 0.0);
+        if (count && boards == count)
+            break;
+        printf("Remove the board...\n");
+        fflush(stdout);
+        if (board_wait(0) != FT_OK){
+            printf("Failed to probe flash chips, AmPLink disconnected?\n");
+            return -1;
+        }
+        printf("Waiting for a board...\n");
+        fflush(stdout);
+    }
+    return 0;
+}
+
+
 int main(int argc, char *argv[]) {
-    int i;
     FT_STATUS ftStatus;
-    unsigned char writeVal;
-    unsigned char readVal;
     Args args;
 
+    logger_init();
+
     // get cli args and set defaults
     if (parse_args(argc, argv, &args) != 0)
         return 1;
+    // daemon replies keep stdout to themselves, everything else is printed to stderr
+    FILE *protocol = stdout;
+    if (args.daemon && !(protocol = platform_split_stdout())){
+        fprintf(stderr, "Failed to separate the daemon replies from other output\n");
+        return 1;
+    }
     if (!args.file1_name) args.file1_name = "clock.hex";
     if (!args.file2_name) args.file2_name = "flash_2A.hex";
     if (!args.file3_name) args.file3_name = "flash_3A.hex";
@@ -44,87 +216,108 @@ int main(int argc, char *argv[]) {
     if (!args.i2c_addr)   args.i2c_addr = 0x6A;
 
 
-    printf("Connecting to AmPLink...  ");
-    // init device
-    ftStatus = programmer_init();
+#ifdef AMPLINK_TRACE
+    trace_init();
+#else
+    if (args.trace_file) printf("Tracing not available, rebuild with -DAMPLINK_TRACE=ON\n");
+#endif
+
+    // parse and validate input files in the background while connecting
+    const char *imageNames[] = {args.file1_name, args.file2_name, args.file3_name, args.file4_name};
+    ImageLoad loads[BOARD_FILES];
+    const Image *loaded[BOARD_FILES];
+    for (int i = 0; i < BOARD_FILES; i++)
+        loads[i].filename = imageNames[i];
+    ftStatus = image_loader_start(loads, BOARD_FILES, args.cache_dir, args.no_cache);
     if (ftStatus != FT_OK){
-        printf("AmPLink device not found\n");
-        MessageBox(NULL,
-                    "AmPLink device not found!",
-                    "Warning",
-                    MB_OK | MB_ICONERROR);
+        printf("Failed to start image loader\n");
         return -1;
     }
-    printf("Success!\n");
 
+    spi_driver_set_engine(args.spi_engine);
+    printf("Connecting to AmPLink...  ");
+    // init device
+    FT_STATUS initStatus = programmer_init();
+    if (initStatus != FT_OK) printf("AmPLink device not found\n");
+    else printf("Success!\n");
 
-    // -- SPI STREAM ---------------------
-    char **filenames[] = {&args.file2_name, &args.file3_name, &args.file4_name};
-    spi_chip_select_t chipSelects[] = {SPI_CS_2, SPI_CS_3, SPI_CS_4};
-    for (int i = 0; i < 3; i++){
-        const char *filename = *filenames[i];
-        spi_chip_select_t chipSelect = chipSelects[i];
-        // select flash chip
-        ftStatus = programmer_flash_select_chip(chipSelect); // verify that gpio is switching
-        if (ftStatus != FT_OK){
-            printf("\nChipselect failed: %s\n", chip_select_to_str(chipSelect));
-            continue;
-        }
-        else printf("\nSet SPI chipSelect to: %s\n", chip_select_to_str(chipSelect));
-    
-        // set write enable
-        ftStatus = programmer_flash_set_write_state(1);
-        if (ftStatus != FT_OK){
-            printf("Failed to enable flash write\n");
-            continue;
-        }
-    
-        // erase chip
-        printf("Erasing flash...   ");
-        ftStatus = programmer_flash_erase_chip();
-        if (ftStatus != FT_OK) {
-            printf("FAILED!\n");
-            // unset write enable
-            ftStatus = programmer_flash_set_write_state(0);
-            if (ftStatus != FT_OK) printf("Failed to disable flash write\n");
-            continue;
-        }
-        else printf("Success!  \n");
-    
-        // stream file to page flash callback
-        printf("Programming flash...   ");
-        ftStatus = fileparser_stream_intel_hex(filename, programmer_flash_write_page);
-        if (ftStatus != FT_OK) {
-            printf("FAILED!\n");
-            continue;
+    // find the flash parts up front, absent chips are skipped instead of timing out
+    if (initStatus == FT_OK && programmer_flash_probe() != FT_OK)
+        printf("Failed to probe flash chips\n");
+    if (initStatus == FT_OK)
+        load_flash_timing();
+
+    if (initStatus == FT_OK && args.bench_iterations){
+        int result = run_spi_benchmark(args.bench_iterations);
+        image_loader_wait(loads, BOARD_FILES);
+        for (int i = 0; i < BOARD_FILES; i++)
+            image_free(&loads[i].image);
+        programmer_close();
+        return result;
+    }
+
+    // a bad file aborts before any chip is erased
+    ftStatus = image_loader_wait(loads, BOARD_FILES);
+    for (int i = 0; i < BOARD_FILES; i++){
+        loaded[i] = &loads[i].image;
+        if (loads[i].status != FT_OK)
+            printf("Failed to load '%s'\n", imageNames[i]);
+        else
+            printf("Loaded '%s': %u bytes%s\n", imageNames[i], loads[i].image.data_bytes, loads[i].cache_hit ? " (cached)" : "");
+    }
+    if (initStatus != FT_OK || ftStatus != FT_OK){
+        for (int i = 0; i < BOARD_FILES; i++)
+            image_free(&loads[i].image);
+        if (initStatus != FT_OK){
+            // nobody is at the screen to dismiss a dialog in the unattended modes
+            if (!args.daemon && !args.continuous)
+                platform_alert("Warning", "AmPLink device not found!");
+        } else {
+            programmer_close();
         }
-        else printf("Success!\n");
-    
-        // verify readback
-    
-        // unset write enable
-        ftStatus = programmer_flash_set_write_state(0);
-        if (ftStatus != FT_OK) printf("Failed to disable flash write\n");
+        return -1;
     }
 
 
     // --- I2C ------------------
     ftStatus = programmer_clock_set_addr(args.i2c_addr);
-    if (ftStatus != FT_OK) printf("\nFailed to set i2c address: 0x%0X\n", args.i2c_addr);
-    else printf("\nSet i2c address: 0x%0X\n", args.i2c_addr);
-
-    printf("Programming clock...   ");
-    ftStatus = fileparser_stream_intel_hex(args.file1_name, programmer_clock_write_page);
-    if (ftStatus != FT_OK) 
-        printf("FAILED!: stream\n");
-    else {
-        // burn data
-        ftStatus = programmer_clock_burn();
-        if (ftStatus != FT_OK) printf("FAILED!: burn\n");
-        else printf("Success!\n");
+    if (ftStatus != FT_OK) printf("Failed to set i2c address: 0x%0X\n", args.i2c_addr);
+    else printf("Set i2c address: 0x%0X\n", args.i2c_addr);
+    tune_usb(args.retune);
+
+    BoardConfig board = { .cache_dir = args.cache_dir, .no_cache = args.no_cache, .quiet = args.quiet,
+                          .metrics_file = args.metrics_file, .differential = args.differential };
+    for (int i = 0; i < BOARD_FILES; i++){
+        board.files[i] = imageNames[i];
+        board.images[i] = loaded[i];
+    }
+    ftStatus = board_init(&board);
+    if (ftStatus != FT_OK){
+        printf("Failed to start job queue\n");
+        for (int i = 0; i < BOARD_FILES; i++)
+            image_free(&loads[i].image);
+        programmer_close();
+        return -1;
     }
 
+    int result = 0;
+    if (args.daemon)
+        result = run_daemon(&args, loads, protocol);
+    else if (args.continuous)
+        result = run_continuous(args.board_count);
+    else
+        result = board_program() == FT_OK ? 0 : -1;
+
+    board_close();
+    for (int i = 0; i < BOARD_FILES; i++)
+        image_free(&loads[i].image);
+
 
     programmer_close();
-    return 0;
+#ifdef AMPLINK_TRACE
+    const char *traceFile = args.trace_file ? args.trace_file : "amplink_trace.json";
+    if (trace_dump(traceFile) == FT_OK) printf("Wrote trace '%s'\n", traceFile);
+    else printf("Failed to write trace '%s'\n", traceFile);
+#endif
+    return result;
 }
\ No newline at end of file
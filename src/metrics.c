@@ -0,0 +1,88 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define METRICS_CSV_HEADER "start,serial,run_status,total_ms,chip,file,status,erase_ms,program_ms,verify_ms,burn_ms," \
+                           "bytes_written,bytes_skipped,pages_skipped,retries,clock_hz,kbps,peak_kbps,latency_ms,usb_in_size,usb_out_size\n"
+
+
+double metrics_kbps(const ChipMetrics *chip){
+    if (chip->program_ms <= 0 || chip->bytes_written == 0)
+        return 0;
+    return (chip->bytes_written / 1024.0) / (chip->program_ms / 1000.0);
+}
+
+static int metrics_is_csv(const char *path){
+    const char *ext = strrchr(path, '.');
+    if (!ext) return 0;
+    return tolower((unsigned char)ext[1]) == 'c' && tolower((unsigned char)ext[2]) == 's'
+        && tolower((unsigned char)ext[3]) == 'v' && ext[4] == '\0';
+}
+
+// file names go into quoted fields, JSON escapes with a backslash, CSV doubles quotes
+static void metrics_put_string(FILE *file, const char *s, int csv){
+    fputc('"', file);
+    for (; s && *s; s++){
+        if (*s == '"')
+            fputc(csv ? '"' : '\\', file);
+        else if (*s == '\\' && !csv)
+            fputc('\\', file);
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+static void metrics_write_json(FILE *file, const char *stamp, const RunMetrics *run){
+    fprintf(file, "{\"start\":\"%s\",\"serial\":", stamp);
+    metrics_put_string(file, run->serial, 0);
+    fprintf(file, ",\"status\":%d,\"total_ms\":%.1f,\"spi_clock_hz\":%u,\"i2c_clock_hz\":%u,\"chips\":[",
+            (int)run->status, run->total_ms, run->spi_clock_hz, run->i2c_clock_hz);
+    for (int i = 0; i < run->chip_count; i++){
+        const ChipMetrics *c = &run->chips[i];
+        fprintf(file, "%s{\"chip\":", i ? "," : "");
+        metrics_put_string(file, c->name, 0);
+        fprintf(file, ",\"file\":");
+        metrics_put_string(file, c->file, 0);
+        fprintf(file, ",\"status\":%d,\"erase_ms\":%.1f,\"program_ms\":%.1f,\"verify_ms\":%.1f,\"burn_ms\":%.1f,"
+                      "\"bytes_written\":%u,\"bytes_skipped\":%u,\"pages_skipped\":%u,\"retries\":%u,\"clock_hz\":%u,\"kbps\":%.2f,\"peak_kbps\":%.2f,"
+                      "\"latency_ms\":%u,\"usb_in_size\":%u,\"usb_out_size\":%u}",
+                (int)c->status, c->erase_ms, c->program_ms, c->verify_ms, c->burn_ms,
+                c->bytes_written, c->bytes_skipped, c->pages_skipped, c->retries, c->clock_hz, metrics_kbps(c), c->peak_kbps,
+                c->latency_ms, c->usb_in_size, c->usb_out_size);
+    }
+    fprintf(file, "]}\n");
+}
+
+static void metrics_write_csv(FILE *file, const char *stamp, const RunMetrics *run){
+    for (int i = 0; i < run->chip_count; i++){
+        const ChipMetrics *c = &run->chips[i];
+        fprintf(file, "%s,", stamp);
+        metrics_put_string(file, run->serial, 1);
+        fprintf(file, ",%d,%.1f,%s,", (int)run->status, run->total_ms, c->name);
+        metrics_put_string(file, c->file, 1);
+        fprintf(file, ",%d,%.1f,%.1f,%.1f,%.1f,%u,%u,%u,%u,%u,%.2f,%.2f,%u,%u,%u\n",
+                (int)c->status, c->erase_ms, c->program_ms, c->verify_ms, c->burn_ms,
+                c->bytes_written, c->bytes_skipped, c->pages_skipped, c->retries, c->clock_hz, metrics_kbps(c), c->peak_kbps,
+                c->latency_ms, c->usb_in_size, c->usb_out_size);
+    }
+}
+
+FT_STATUS metrics_append(const char *path, const RunMetrics *run){
+    char stamp[32];
+    FILE *file = fopen(path, "a");
+    if (!file) return FT_IO_ERROR;
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&run->start));
+    if (metrics_is_csv(path)){
+        // append mode starts at the end, an empty file needs the header
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0)
+            fputs(METRICS_CSV_HEADER, file);
+        metrics_write_csv(file, stamp, run);
+    } else {
+        metrics_write_json(file, stamp, run);
+    }
+    return fclose(file) == 0 ? FT_OK : FT_IO_ERROR;
+}
@@ -0,0 +1,84 @@
+/*! @file metrics.h
+ *  @brief Structured per-run metrics appended to a local log file.
+ *
+ * Every run appends one record with per-chip phase timings, bytes written,
+ * skipped pages, retries, bus clocks and effective throughput, so station
+ * throughput can be charted over time and slow fixtures spotted.
+ *
+ * @details
+ * The format is chosen by file extension:
+ * - **.csv**: one row per chip, a header row is written to new files.
+ * - **anything else**: JSON Lines, one JSON object per run.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+#include "ftd2xx.h"
+
+//! Default metrics log file
+#define METRICS_DEFAULT_FILE "amplink_metrics.jsonl"
+//! Chips recorded per run, the clock and three flash chips
+#define METRICS_MAX_CHIPS 4
+
+/*!
+ * @struct ChipMetrics
+ * @brief Results of a single programmed chip
+ */
+typedef struct {
+    const char *name;       /*!< Chip name, e.g. "CS2" */
+    const char *file;       /*!< Input file */
+    FT_STATUS status;       /*!< First failed phase status, FT_OK on success */
+    double erase_ms;        /*!< Erase duration */
+    double program_ms;      /*!< Program duration */
+    double verify_ms;       /*!< Verify duration */
+    double burn_ms;         /*!< OTP burn duration, clock only */
+    uint32_t bytes_written; /*!< Bytes sent to the chip by the program phase */
+    uint32_t bytes_skipped; /*!< Bytes of the image not sent to the chip, erased or already in place */
+    uint32_t pages_skipped; /*!< Pages not sent to the chip, erased or already in place */
+    uint32_t retries;       /*!< Operations repeated after an error */
+    uint32_t clock_hz;      /*!< Bus clock used for the chip */
+    double peak_kbps;       /*!< Highest smoothed throughput of any phase, see @ref progress.h */
+    uint8_t latency_ms;     /*!< Latency timer of the chip's channel, 0 on driver defaults, see @ref usb_tuning.h */
+    uint32_t usb_in_size;   /*!< USB IN transfer size of the chip's channel */
+    uint32_t usb_out_size;  /*!< USB OUT transfer size of the chip's channel */
+} ChipMetrics;
+
+/*!
+ * @struct RunMetrics
+ * @brief Results of a whole programming run
+ */
+typedef struct {
+    time_t start;           /*!< Wall clock time the run started */
+    double total_ms;        /*!< Duration of the run */
+    const char *serial;     /*!< AmPLink serial number */
+    FT_STATUS status;       /*!< FT_OK if every chip succeeded */
+    uint32_t spi_clock_hz;  /*!< SPI clock rate */
+    uint32_t i2c_clock_hz;  /*!< I2C clock rate */
+    ChipMetrics chips[METRICS_MAX_CHIPS]; /*!< Per chip results */
+    int chip_count;         /*!< Number of chips */
+} RunMetrics;
+
+/*!
+ * @brief Returns the effective programming throughput of a chip.
+ *
+ * @param[in] chip Chip results
+ * @return double KB/s over the program phase, 0 if nothing was programmed
+ */
+double metrics_kbps(const ChipMetrics *chip);
+
+/*!
+ * @brief Appends a run record to a metrics log file.
+ *
+ * @param[in] path Log file, CSV if it ends in .csv, JSON Lines otherwise
+ * @param[in] run Run results
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file could not be written
+ */
+FT_STATUS metrics_append(const char *path, const RunMetrics *run);
+
+#endif
@@ -0,0 +1,179 @@
+#include "pipeline.h"
+
+#include <string.h>
+#include "fileparser.h"
+#include "platform.h"
+
+/*!
+ * @struct PageSlot
+ * @brief A single page buffer in the ring
+ */
+typedef struct {
+    uint32_t addr;                      /*!< Start address of the data */
+    uint32_t len;                       /*!< Number of valid bytes */
+    uint8_t data[PIPELINE_PAGE_SIZE];   /*!< Page data */
+} PageSlot;
+
+/*!
+ * @struct Pipeline
+ * @brief State shared by the parser and programming threads
+ *
+ * head is only written by the producer and tail only by the consumer.
+ */
+typedef struct {
+    PageSlot slots[PIPELINE_RING_SLOTS];
+    volatile long head;        /*!< Next slot the producer publishes */
+    volatile long tail;        /*!< Next slot the consumer takes */
+    volatile long done;        /*!< Set by the producer once parsing has finished */
+    volatile long abort;       /*!< Set by the consumer to stop the producer */
+    PlatformEvent not_full;    /*!< Auto-reset event, signalled after every take */
+    PlatformEvent not_empty;   /*!< Auto-reset event, signalled after every publish */
+
+    // producer only
+    const char *filename;
+    PageSlot *fill;            /*!< Slot being filled, NULL if none */
+    FT_STATUS parse_status;    /*!< Result of the parser, valid once done is set */
+    PipelineStats *stats;
+} Pipeline;
+
+
+static long ring_count(Pipeline *p){
+    return p->head - p->tail;
+}
+
+// producer: reserve the next free slot, waits while the ring is full
+static PageSlot *ring_reserve(Pipeline *p){
+    if (ring_count(p) == PIPELINE_RING_SLOTS){
+        p->stats->producer_stalls++;
+        while (ring_count(p) == PIPELINE_RING_SLOTS && !p->abort)
+            platform_event_wait(&p->not_full, PLATFORM_WAIT_INFINITE);
+    }
+    if (p->abort) return NULL;
+    return &p->slots[p->head & (PIPELINE_RING_SLOTS - 1)];
+}
+
+// producer: hand the filled slot to the consumer
+static void ring_publish(Pipeline *p){
+    platform_barrier(); // slot contents visible before head
+    platform_atomic_inc(&p->head);
+    platform_event_set(&p->not_empty);
+    p->fill = NULL;
+}
+
+// parser callback, coalesces records into page buffers
+static FT_STATUS pipeline_produce(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    Pipeline *p = (Pipeline *)ctx;
+
+    while (len > 0){
+        // continue current page if the record is contiguous with it
+        if (p->fill && (p->fill->addr + p->fill->len != addr || p->fill->len == PIPELINE_PAGE_SIZE))
+            ring_publish(p);
+        if (!p->fill){
+            p->fill = ring_reserve(p);
+            if (!p->fill) return FT_OTHER_ERROR; // consumer failed
+            p->fill->addr = addr;
+            p->fill->len = 0;
+        }
+
+        // never cross a page boundary
+        uint32_t space_left = PIPELINE_PAGE_SIZE - (addr % PIPELINE_PAGE_SIZE);
+        uint32_t chunk = (len <= space_left) ? len : space_left;
+        memcpy(p->fill->data + p->fill->len, data, chunk);
+        p->fill->len += chunk;
+        if ((addr + chunk) % PIPELINE_PAGE_SIZE == 0)
+            ring_publish(p);
+
+        addr += chunk;
+        data += chunk;
+        len -= (uint8_t)chunk;
+    }
+    return FT_OK;
+}
+
+static void pipeline_producer_thread(void *param){
+    Pipeline *p = (Pipeline *)param;
+
+    p->parse_status = fileparser_stream_intel_hex_ctx(p->filename, pipeline_produce, p);
+    if (p->fill && p->parse_status == FT_OK)
+        ring_publish(p);
+
+    platform_barrier();
+    platform_atomic_store(&p->done, 1);
+    platform_event_set(&p->not_empty);
+}
+
+
+FT_STATUS pipeline_stream_intel_hex(const char *filename, FT_STATUS (*consumer_callback)(uint32_t addr, const uint8_t *data, uint32_t len), PipelineStats *stats){
+    static Pipeline pipeline; // page buffers are too large for worker stacks
+    Pipeline *p = &pipeline;
+    PipelineStats local_stats;
+    PlatformThread producer;
+    FT_STATUS ftStatus = FT_OK;
+
+    if (!stats) stats = &local_stats;
+    memset(stats, 0, sizeof(*stats));
+
+    p->head = 0;
+    p->tail = 0;
+    p->done = 0;
+    p->abort = 0;
+    p->fill = NULL;
+    p->filename = filename;
+    p->parse_status = FT_OK;
+    p->stats = stats;
+    ftStatus = platform_event_init(&p->not_full, 0);
+    if (ftStatus == FT_OK)
+        ftStatus = platform_event_init(&p->not_empty, 0);
+    if (ftStatus == FT_OK)
+        ftStatus = platform_thread_start(&producer, pipeline_producer_thread, p);
+    if (ftStatus != FT_OK)
+        goto cleanup;
+
+    for (;;){
+        long count = ring_count(p);
+        if (count == 0){
+            if (p->done && ring_count(p) == 0) break;
+            stats->consumer_stalls++;
+            while (ring_count(p) == 0 && !p->done)
+                platform_event_wait(&p->not_empty, PLATFORM_WAIT_INFINITE);
+            continue;
+        }
+        platform_barrier(); // head read before slot contents
+
+        stats->occupancy_hist[count]++;
+        if ((uint32_t)count > stats->occupancy_max) stats->occupancy_max = count;
+
+        PageSlot *slot = &p->slots[p->tail & (PIPELINE_RING_SLOTS - 1)];
+        ftStatus = consumer_callback(slot->addr, slot->data, slot->len);
+        if (ftStatus != FT_OK){
+            platform_atomic_store(&p->abort, 1);
+            platform_event_set(&p->not_full);
+            break;
+        }
+        stats->pages++;
+        stats->bytes += slot->len;
+
+        platform_barrier(); // slot consumed before it is released
+        platform_atomic_inc(&p->tail);
+        platform_event_set(&p->not_full);
+    }
+
+    platform_thread_join(&producer);
+    if (ftStatus == FT_OK)
+        ftStatus = p->parse_status;
+
+cleanup:
+    platform_event_destroy(&p->not_full);
+    platform_event_destroy(&p->not_empty);
+    return ftStatus;
+}
+
+double pipeline_avg_occupancy(const PipelineStats *stats){
+    uint64_t sum = 0;
+    uint32_t samples = 0;
+    for (int i = 0; i <= PIPELINE_RING_SLOTS; i++){
+        sum += (uint64_t)i * stats->occupancy_hist[i];
+        samples += stats->occupancy_hist[i];
+    }
+    return samples ? (double)sum / samples : 0.0;
+}
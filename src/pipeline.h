@@ -0,0 +1,71 @@
+/*! @file pipeline.h
+ *  @brief Double-buffered producer/consumer pipeline between HEX parsing and programming.
+ *
+ * Runs the Intel HEX parser on its own thread. Parsed records are coalesced into
+ * page sized buffers and handed to the programming thread through a lock-free
+ * single-producer/single-consumer ring, so parse time is hidden behind flash
+ * program time.
+ *
+ * @details
+ * The consumer callback runs on the calling thread and receives whole pages
+ * (up to @ref PIPELINE_PAGE_SIZE bytes) instead of individual HEX records.
+ * Ring occupancy statistics are collected for every run.
+ *
+ * @note Only one pipeline can run at a time.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+
+//! Number of page buffers in the ring, must be a power of 2
+#define PIPELINE_RING_SLOTS 8
+//! Size of a single page buffer in bytes
+#define PIPELINE_PAGE_SIZE  256
+
+/*!
+ * @struct PipelineStats
+ * @brief Ring statistics of a single pipeline run
+ */
+typedef struct {
+    uint32_t pages;           /*!< Page buffers passed from parser to programmer */
+    uint32_t bytes;           /*!< Data bytes passed from parser to programmer */
+    uint32_t producer_stalls; /*!< Times the parser waited on a full ring */
+    uint32_t consumer_stalls; /*!< Times the programmer waited on an empty ring */
+    uint32_t occupancy_max;   /*!< Highest number of filled buffers seen by the programmer */
+    uint32_t occupancy_hist[PIPELINE_RING_SLOTS + 1]; /*!< Histogram of filled buffers, sampled before each page is consumed */
+} PipelineStats;
+
+/*!
+ * @brief Parses an Intel HEX file on a worker thread and streams page buffers to a callback.
+ *
+ * @param[in] filename Path to the Intel HEX file to parse.
+ * @param[in] consumer_callback Callback receiving each page buffer on the calling thread.
+ *                              The function signature must be:
+ *                              @code
+ *                              FT_STATUS callback(uint32_t addr, const uint8_t *data, uint32_t len);
+ *                              @endcode
+ * @param[out] stats Optional pointer to store ring statistics, may be NULL.
+ *
+ * @return FT_STATUS Status of the operation
+ * - **FT_OK** if the file was parsed and consumed successfully
+ * - Any error code returned by the parser or the consumer callback
+ *
+ * @see fileparser_stream_intel_hex
+ */
+FT_STATUS pipeline_stream_intel_hex(const char *filename, FT_STATUS (*consumer_callback)(uint32_t addr, const uint8_t *data, uint32_t len), PipelineStats *stats);
+
+/*!
+ * @brief Returns the average ring occupancy seen by the programmer.
+ *
+ * @param[in] stats Statistics of a pipeline run
+ * @return double Average number of filled buffers, 0 if no pages were consumed
+ */
+double pipeline_avg_occupancy(const PipelineStats *stats);
+
+#endif
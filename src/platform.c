@@ -0,0 +1,435 @@
+#if !defined(_WIN32)
+#define _GNU_SOURCE
+#endif
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// waits shorter than this are spun out, no OS timer wakes up that precisely
+#define PLATFORM_SPIN_US 50
+
+
+#if defined(_WIN32)
+
+uint64_t platform_time_us(void){
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    // split to keep the multiplication in range
+    uint64_t sec = (uint64_t)now.QuadPart / (uint64_t)frequency.QuadPart;
+    uint64_t rem = (uint64_t)now.QuadPart % (uint64_t)frequency.QuadPart;
+    return sec * 1000000u + rem * 1000000u / (uint64_t)frequency.QuadPart;
+}
+
+// one timer per thread, created on first use. Without high resolution
+// support (before Windows 10 1803) Sleep rounds up to the system tick.
+static void platform_os_sleep_us(uint32_t us){
+    static PLATFORM_THREAD_LOCAL HANDLE timer;
+    static PLATFORM_THREAD_LOCAL int timer_failed;
+    if (!timer && !timer_failed){
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        timer_failed = !timer;
+    }
+    if (timer){
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)us * 10; // relative, 100 ns units
+        if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)){
+            WaitForSingleObject(timer, INFINITE);
+            return;
+        }
+    }
+    Sleep((us + 999) / 1000);
+}
+
+static void platform_yield(void){
+    SwitchToThread();
+}
+
+int platform_cpu_count(void){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+static DWORD WINAPI platform_thread_entry(LPVOID param){
+    PlatformThread *thread = (PlatformThread *)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+FT_STATUS platform_thread_start(PlatformThread *thread, platform_thread_fn fn, void *arg){
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, platform_thread_entry, thread, 0, NULL);
+    return thread->handle ? FT_OK : FT_INSUFFICIENT_RESOURCES;
+}
+
+int platform_thread_started(const PlatformThread *thread){
+    return thread->handle != NULL;
+}
+
+void platform_thread_join(PlatformThread *thread){
+    if (!thread->handle) return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+}
+
+void platform_mutex_init(PlatformMutex *mutex){
+    InitializeSRWLock((PSRWLOCK)&mutex->lock);
+}
+
+void platform_mutex_destroy(PlatformMutex *mutex){
+    (void)mutex; // SRW locks hold no resources
+}
+
+void platform_mutex_lock(PlatformMutex *mutex){
+    AcquireSRWLockExclusive((PSRWLOCK)&mutex->lock);
+}
+
+void platform_mutex_unlock(PlatformMutex *mutex){
+    ReleaseSRWLockExclusive((PSRWLOCK)&mutex->lock);
+}
+
+void platform_cond_init(PlatformCond *cond){
+    InitializeConditionVariable((PCONDITION_VARIABLE)&cond->cv);
+}
+
+void platform_cond_destroy(PlatformCond *cond){
+    (void)cond;
+}
+
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex){
+    SleepConditionVariableSRW((PCONDITION_VARIABLE)&cond->cv, (PSRWLOCK)&mutex->lock, INFINITE, 0);
+}
+
+void platform_cond_wake_one(PlatformCond *cond){
+    WakeConditionVariable((PCONDITION_VARIABLE)&cond->cv);
+}
+
+void platform_cond_wake_all(PlatformCond *cond){
+    WakeAllConditionVariable((PCONDITION_VARIABLE)&cond->cv);
+}
+
+FT_STATUS platform_event_init(PlatformEvent *event, int manual_reset){
+    event->handle = CreateEvent(NULL, manual_reset ? TRUE : FALSE, FALSE, NULL);
+    return event->handle ? FT_OK : FT_INSUFFICIENT_RESOURCES;
+}
+
+void platform_event_destroy(PlatformEvent *event){
+    if (!event->handle) return;
+    CloseHandle(event->handle);
+    event->handle = NULL;
+}
+
+void platform_event_set(PlatformEvent *event){
+    SetEvent(event->handle);
+}
+
+int platform_event_wait(PlatformEvent *event, uint32_t timeout_ms){
+    DWORD timeout = (timeout_ms == PLATFORM_WAIT_INFINITE) ? INFINITE : timeout_ms;
+    return WaitForSingleObject(event->handle, timeout) == WAIT_OBJECT_0;
+}
+
+FT_STATUS platform_map_file(const char *path, PlatformMapping *mapping){
+    LARGE_INTEGER size;
+    memset(mapping, 0, sizeof(*mapping));
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FT_IO_ERROR;
+    HANDLE map = NULL;
+    void *view = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map)
+        view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (!view){
+        if (map) CloseHandle(map);
+        CloseHandle(file);
+        return FT_IO_ERROR;
+    }
+    mapping->view = view;
+    mapping->size = (size_t)size.QuadPart;
+    mapping->file = file;
+    mapping->map = map;
+    return FT_OK;
+}
+
+void platform_unmap_file(PlatformMapping *mapping){
+    if (!mapping->view) return;
+    UnmapViewOfFile(mapping->view);
+    CloseHandle(mapping->map);
+    CloseHandle(mapping->file);
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+void platform_alert(const char *title, const char *message){
+    MessageBoxA(NULL, message, title, MB_OK | MB_ICONERROR);
+}
+
+FILE *platform_split_stdout(void){
+    fflush(stdout);
+    int fd = _dup(_fileno(stdout));
+    if (fd < 0) return NULL;
+    FILE *out = _fdopen(fd, "w");
+    if (!out || _dup2(_fileno(stderr), _fileno(stdout)) != 0){
+        if (out) fclose(out);
+        else _close(fd);
+        return NULL;
+    }
+    return out;
+}
+
+#else // POSIX
+
+uint64_t platform_time_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void platform_os_sleep_us(uint32_t us){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += us / 1000000u;
+    ts.tv_nsec += (long)(us % 1000000u) * 1000;
+    if (ts.tv_nsec >= 1000000000L){
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    // absolute wake time, so signals do not stretch the sleep
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void platform_yield(void){
+    sched_yield();
+}
+
+int platform_cpu_count(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void *platform_thread_entry(void *param){
+    PlatformThread *thread = (PlatformThread *)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+FT_STATUS platform_thread_start(PlatformThread *thread, platform_thread_fn fn, void *arg){
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->started = pthread_create(&thread->thread, NULL, platform_thread_entry, thread) == 0;
+    return thread->started ? FT_OK : FT_INSUFFICIENT_RESOURCES;
+}
+
+int platform_thread_started(const PlatformThread *thread){
+    return thread->started;
+}
+
+void platform_thread_join(PlatformThread *thread){
+    if (!thread->started) return;
+    pthread_join(thread->thread, NULL);
+    thread->started = 0;
+}
+
+void platform_mutex_init(PlatformMutex *mutex){
+    pthread_mutex_init(&mutex->lock, NULL);
+}
+
+void platform_mutex_destroy(PlatformMutex *mutex){
+    pthread_mutex_destroy(&mutex->lock);
+}
+
+void platform_mutex_lock(PlatformMutex *mutex){
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void platform_mutex_unlock(PlatformMutex *mutex){
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+void platform_cond_init(PlatformCond *cond){
+    pthread_cond_init(&cond->cv, NULL);
+}
+
+void platform_cond_destroy(PlatformCond *cond){
+    pthread_cond_destroy(&cond->cv);
+}
+
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex){
+    pthread_cond_wait(&cond->cv, &mutex->lock);
+}
+
+void platform_cond_wake_one(PlatformCond *cond){
+    pthread_cond_signal(&cond->cv);
+}
+
+void platform_cond_wake_all(PlatformCond *cond){
+    pthread_cond_broadcast(&cond->cv);
+}
+
+FT_STATUS platform_event_init(PlatformEvent *event, int manual_reset){
+    pthread_condattr_t attr;
+    memset(event, 0, sizeof(*event));
+    if (pthread_mutex_init(&event->lock, NULL) != 0)
+        return FT_INSUFFICIENT_RESOURCES;
+    // timed waits run on the monotonic clock like everything else
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_cond_init(&event->cv, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err != 0){
+        pthread_mutex_destroy(&event->lock);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    event->manual = manual_reset;
+    event->valid = 1;
+    return FT_OK;
+}
+
+void platform_event_destroy(PlatformEvent *event){
+    if (!event->valid) return;
+    pthread_cond_destroy(&event->cv);
+    pthread_mutex_destroy(&event->lock);
+    event->valid = 0;
+}
+
+void platform_event_set(PlatformEvent *event){
+    pthread_mutex_lock(&event->lock);
+    event->signalled = 1;
+    if (event->manual)
+        pthread_cond_broadcast(&event->cv);
+    else
+        pthread_cond_signal(&event->cv);
+    pthread_mutex_unlock(&event->lock);
+}
+
+int platform_event_wait(PlatformEvent *event, uint32_t timeout_ms){
+    struct timespec ts;
+    if (timeout_ms != PLATFORM_WAIT_INFINITE){
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L){
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&event->lock);
+    int err = 0;
+    while (!event->signalled && err != ETIMEDOUT){
+        if (timeout_ms == PLATFORM_WAIT_INFINITE)
+            pthread_cond_wait(&event->cv, &event->lock);
+        else
+            err = pthread_cond_timedwait(&event->cv, &event->lock, &ts);
+    }
+    int signalled = event->signalled;
+    if (signalled && !event->manual)
+        event->signalled = 0;
+    pthread_mutex_unlock(&event->lock);
+    return signalled;
+}
+
+FT_STATUS platform_map_file(const char *path, PlatformMapping *mapping){
+    struct stat st;
+    memset(mapping, 0, sizeof(*mapping));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FT_IO_ERROR;
+    void *view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (view == MAP_FAILED)
+        return FT_IO_ERROR;
+    mapping->view = view;
+    mapping->size = (size_t)st.st_size;
+    return FT_OK;
+}
+
+void platform_unmap_file(PlatformMapping *mapping){
+    if (!mapping->view) return;
+    munmap((void *)mapping->view, mapping->size);
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+void platform_alert(const char *title, const char *message){
+    fprintf(stderr, "%s: %s\n", title, message);
+}
+
+FILE *platform_split_stdout(void){
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0) return NULL;
+    FILE *out = fdopen(fd, "w");
+    if (!out || dup2(STDERR_FILENO, STDOUT_FILENO) < 0){
+        if (out) fclose(out);
+        else close(fd);
+        return NULL;
+    }
+    return out;
+}
+
+#endif
+
+
+uint64_t platform_time_ms(void){
+    return platform_time_us() / 1000u;
+}
+
+double platform_elapsed_ms(uint64_t start_us){
+    return (double)(platform_time_us() - start_us) / 1000.0;
+}
+
+void platform_sleep_us(uint32_t us){
+    if (us == 0){
+        platform_yield();
+        return;
+    }
+    // let the OS timer cover most of the wait and spin out the rest
+    uint64_t end = platform_time_us() + us;
+    if (us > PLATFORM_SPIN_US)
+        platform_os_sleep_us(us - PLATFORM_SPIN_US);
+    while (platform_time_us() < end)
+        platform_yield();
+}
+
+uint64_t platform_deadline(uint64_t timeout_us){
+    return platform_time_us() + timeout_us;
+}
+
+int platform_deadline_passed(uint64_t deadline){
+    return platform_time_us() >= deadline;
+}
+
+int platform_sleep_until(uint64_t deadline, uint32_t us){
+    uint64_t now = platform_time_us();
+    if (now >= deadline) return 1;
+    if (deadline - now < us) us = (uint32_t)(deadline - now);
+    platform_sleep_us(us);
+    return platform_deadline_passed(deadline);
+}
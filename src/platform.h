@@ -0,0 +1,301 @@
+/*! @file platform.h
+ *  @brief Operating system services used by the programmer, for Windows and Linux.
+ *
+ * Wraps the monotonic clock, sleeping, threads, locks, events, atomics and
+ * file mappings so no other module includes `<windows.h>` or `<pthread.h>`.
+ *
+ * @details
+ * Time is kept in microseconds on a monotonic clock. Waits are expressed as
+ * deadlines, see @ref platform_deadline, so polling loops keep their overall
+ * timeout however long each poll takes.
+ *
+ * `Sleep(1)` on Windows rounds up to the 15.6 ms system tick.
+ * @ref platform_sleep_us uses a high resolution waitable timer there and
+ * `clock_nanosleep` on Linux, both good to well below a millisecond.
+ *
+ * **Example usage:**
+ * @code
+ * uint64_t deadline = platform_deadline(100 * 1000);
+ * while (!ready()){
+ *     if (platform_deadline_passed(deadline)) return FT_OTHER_ERROR;
+ *     platform_sleep_us(50);
+ * }
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "ftd2xx.h"
+
+#if defined(_WIN32)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #endif
+#else
+  #include <pthread.h>
+#endif
+
+#if defined(_MSC_VER)
+  #define PLATFORM_THREAD_LOCAL __declspec(thread)
+#else
+  #define PLATFORM_THREAD_LOCAL _Thread_local
+#endif
+
+//! Timeout of @ref platform_event_wait that never expires
+#define PLATFORM_WAIT_INFINITE 0xFFFFFFFFu
+
+//! Entry point of a thread started with @ref platform_thread_start
+typedef void (*platform_thread_fn)(void *arg);
+
+#if defined(_WIN32)
+/*! @brief A joinable thread */
+typedef struct {
+    void *handle;          /*!< Thread handle, NULL if not started */
+    platform_thread_fn fn; /*!< Entry point */
+    void *arg;             /*!< Entry point argument */
+} PlatformThread;
+
+/*! @brief A non-recursive lock (slim reader/writer lock) */
+typedef struct { void *lock; } PlatformMutex;
+
+/*! @brief A condition variable used with a @ref PlatformMutex */
+typedef struct { void *cv; } PlatformCond;
+
+/*! @brief An auto or manual reset event */
+typedef struct { void *handle; } PlatformEvent;
+#else
+typedef struct {
+    pthread_t thread;
+    int started;
+    platform_thread_fn fn;
+    void *arg;
+} PlatformThread;
+
+typedef struct { pthread_mutex_t lock; } PlatformMutex;
+
+typedef struct { pthread_cond_t cv; } PlatformCond;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    int signalled;
+    int manual;
+    int valid;
+} PlatformEvent;
+#endif
+
+/*!
+ * @struct PlatformMapping
+ * @brief A file mapped read-only into memory
+ */
+typedef struct {
+    const void *view; /*!< Start of the mapped file */
+    size_t size;      /*!< File size in bytes */
+    void *file;       /*!< OS file handle (Windows) */
+    void *map;        /*!< OS mapping handle (Windows) */
+} PlatformMapping;
+
+/*!
+ * @brief Monotonic time in microseconds since an arbitrary origin.
+ *
+ * @return uint64_t Current time
+ */
+uint64_t platform_time_us(void);
+
+/*!
+ * @brief Monotonic time in milliseconds since an arbitrary origin.
+ *
+ * @return uint64_t Current time
+ */
+uint64_t platform_time_ms(void);
+
+/*!
+ * @brief Milliseconds elapsed since a @ref platform_time_us timestamp.
+ *
+ * @param[in] start_us Earlier timestamp
+ * @return double Elapsed time with microsecond resolution
+ */
+double platform_elapsed_ms(uint64_t start_us);
+
+/*!
+ * @brief Sleeps for at least the given time.
+ *
+ * @param[in] us Microseconds to sleep, 0 yields the processor
+ */
+void platform_sleep_us(uint32_t us);
+
+/*!
+ * @brief Deadline timeout_us from now, for @ref platform_deadline_passed.
+ *
+ * @param[in] timeout_us Timeout in microseconds
+ * @return uint64_t Deadline on the @ref platform_time_us clock
+ */
+uint64_t platform_deadline(uint64_t timeout_us);
+
+/*!
+ * @brief Checks whether a deadline has passed.
+ *
+ * @param[in] deadline Deadline from @ref platform_deadline
+ * @return int 1 if passed, 0 otherwise
+ */
+int platform_deadline_passed(uint64_t deadline);
+
+/*!
+ * @brief Sleeps for us, cut short so the sleep ends no later than the deadline.
+ *
+ * @param[in] deadline Deadline from @ref platform_deadline
+ * @param[in] us Microseconds to sleep
+ * @return int 1 if the deadline has passed on return, 0 otherwise
+ */
+int platform_sleep_until(uint64_t deadline, uint32_t us);
+
+/*!
+ * @brief Number of logical processors.
+ *
+ * @return int Processor count, at least 1
+ */
+int platform_cpu_count(void);
+
+/*!
+ * @brief Starts a thread.
+ *
+ * The thread object must stay in place until @ref platform_thread_join.
+ *
+ * @param[out] thread Thread object
+ * @param[in] fn Entry point
+ * @param[in] arg Entry point argument
+ * @return FT_STATUS FT_OK, FT_INSUFFICIENT_RESOURCES if the thread could not be created
+ */
+FT_STATUS platform_thread_start(PlatformThread *thread, platform_thread_fn fn, void *arg);
+
+/*!
+ * @brief Checks whether a thread object holds a started thread.
+ *
+ * @param[in] thread Thread object
+ * @return int 1 if started and not yet joined
+ */
+int platform_thread_started(const PlatformThread *thread);
+
+/*!
+ * @brief Waits for a thread to return and releases it. Does nothing if not started.
+ *
+ * @param[in,out] thread Thread object
+ */
+void platform_thread_join(PlatformThread *thread);
+
+/*! @brief Initializes a mutex. */
+void platform_mutex_init(PlatformMutex *mutex);
+/*! @brief Releases a mutex. */
+void platform_mutex_destroy(PlatformMutex *mutex);
+/*! @brief Acquires a mutex, not recursive. */
+void platform_mutex_lock(PlatformMutex *mutex);
+/*! @brief Releases a held mutex. */
+void platform_mutex_unlock(PlatformMutex *mutex);
+
+/*! @brief Initializes a condition variable. */
+void platform_cond_init(PlatformCond *cond);
+/*! @brief Releases a condition variable. */
+void platform_cond_destroy(PlatformCond *cond);
+/*! @brief Atomically releases the held mutex and waits for a wake, reacquires the mutex before returning. */
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex);
+/*! @brief Wakes one waiter. */
+void platform_cond_wake_one(PlatformCond *cond);
+/*! @brief Wakes all waiters. */
+void platform_cond_wake_all(PlatformCond *cond);
+
+/*!
+ * @brief Creates an event, initially not signalled.
+ *
+ * An auto reset event releases a single waiter and clears itself,
+ * a manual reset event stays signalled.
+ *
+ * @param[out] event Event object
+ * @param[in] manual_reset 1 for a manual reset event
+ * @return FT_STATUS FT_OK, FT_INSUFFICIENT_RESOURCES on failure
+ */
+FT_STATUS platform_event_init(PlatformEvent *event, int manual_reset);
+
+/*! @brief Releases an event. Does nothing for a zeroed or already released event. */
+void platform_event_destroy(PlatformEvent *event);
+
+/*! @brief Signals an event. */
+void platform_event_set(PlatformEvent *event);
+
+/*!
+ * @brief Waits for an event to be signalled.
+ *
+ * @param[in] event Event object
+ * @param[in] timeout_ms Timeout in milliseconds or @ref PLATFORM_WAIT_INFINITE
+ * @return int 1 if signalled, 0 on timeout
+ */
+int platform_event_wait(PlatformEvent *event, uint32_t timeout_ms);
+
+/*!
+ * @brief Maps a whole file read-only.
+ *
+ * @param[in] path File to map
+ * @param[out] mapping Mapping, release with @ref platform_unmap_file
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file could not be opened or mapped
+ */
+FT_STATUS platform_map_file(const char *path, PlatformMapping *mapping);
+
+/*!
+ * @brief Releases a mapping from @ref platform_map_file.
+ *
+ * @param[in,out] mapping Mapping to release
+ */
+void platform_unmap_file(PlatformMapping *mapping);
+
+/*!
+ * @brief Reports a fatal problem to the operator.
+ *
+ * A message box on Windows, stderr on Linux.
+ *
+ * @param[in] title Short title
+ * @param[in] message Message text
+ */
+void platform_alert(const char *title, const char *message);
+
+/*!
+ * @brief Moves stdout onto stderr and returns a stream on the original stdout.
+ *
+ * Everything printed afterwards goes to stderr, only the returned stream
+ * still writes where stdout went before.
+ *
+ * @return FILE* Stream on the original stdout, NULL on failure with stdout unchanged
+ */
+FILE *platform_split_stdout(void);
+
+// atomics, full barriers on every operation
+#if defined(_MSC_VER)
+static inline long platform_atomic_inc(volatile long *value){ return _InterlockedIncrement(value); }
+static inline long platform_atomic_cas(volatile long *value, long desired, long expected){
+    return _InterlockedCompareExchange(value, desired, expected);
+}
+static inline void platform_atomic_store(volatile long *value, long desired){ _InterlockedExchange(value, desired); }
+static inline void platform_atomic_or8(volatile uint8_t *value, uint8_t mask){ _InterlockedOr8((volatile char *)value, (char)mask); }
+static inline void platform_barrier(void){ volatile long fence = 0; _InterlockedOr(&fence, 0); }
+#else
+/*! @brief Increments a counter, returns the new value. */
+static inline long platform_atomic_inc(volatile long *value){ return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST); }
+/*! @brief Stores desired if the value equals expected, returns the previous value. */
+static inline long platform_atomic_cas(volatile long *value, long desired, long expected){
+    __atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+/*! @brief Stores a value. */
+static inline void platform_atomic_store(volatile long *value, long desired){ __atomic_store_n(value, desired, __ATOMIC_SEQ_CST); }
+/*! @brief ORs a mask into a byte. */
+static inline void platform_atomic_or8(volatile uint8_t *value, uint8_t mask){ __atomic_fetch_or(value, mask, __ATOMIC_SEQ_CST); }
+/*! @brief Full memory barrier. */
+static inline void platform_barrier(void){ __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
+
+#endif
@@ -1,12 +1,22 @@
 #include "programmer.h"
 
+#include <string.h>
 #include "utils.h"
+#include "trace.h"
 #include "spi_flash.h"
 #include "gpio_driver.h"
 #include "spi_driver.h"
 #include "i2c_driver.h"
+#include "arena.h"
+#include "platform.h"
+#include "usb_tuning.h"
 
 #define AMPLINK_CHANNEL_NUM 4 // amplink programmer will always have 4 channels
+#define CLOCK_PAGE_SIZE     256
+#define CLOCK_ADDR_LEN      2
+#define CLOCK_MAX_WRITE     255 // longest data chunk of programmer_clock_write_page
+#define CLOCK_BURN_PULSE_US 500000 // OTP fuse burn time per write of 0xF8
+#define TUNE_CLOCK_READ     16     // bytes of the clock page read timed by the I2C sweep
 
 /*!
  * @struct ProgrammerContext
@@ -23,12 +33,26 @@ typedef struct {
     FT_HANDLE ftI2CHandle;  /*!< Handle for I2C communication channel */
     FT_HANDLE ftGPIOHandle; /*!< Handle for general GPIO channel */
     FT_HANDLE ftCTRLHandle; /*!< Handle for internal control GPIO channel */
+    Arena spiArena;         /*!< Command buffers of the SPI channel, used by the SPI job worker only */
+    Arena i2cArena;         /*!< Command buffers of the I2C channel, used by the I2C job worker only */
 } ProgrammerContext;
 
 //! Global static instance of ProgrammerContext
 static ProgrammerContext device;
 //! Static variable of the versaClock i2c address
 static uint8_t i2c_addr;
+//! Serial number of the first channel of the AmPLink
+static char serial[16];
+//! Flash part detected on each chip select, indexed by spi_chip_select_t >> 2
+static const FlashPart *chip_parts[4];
+//! Detection result of each chip select, FT_EEPROM_NOT_PRESENT if no chip answered
+static FT_STATUS chip_status[4];
+//! Set once @ref programmer_flash_probe has run
+static int chips_probed;
+//! Flash part on the selected chip select
+static const FlashPart *flash_part;
+//! USB settings of the SPI, I2C and GPIO channels, latency_ms 0 while on driver defaults
+static UsbSettings usb_spi, usb_i2c, usb_gpio;
 
 
 FT_STATUS programmer_init(void){
@@ -36,9 +60,15 @@ FT_STATUS programmer_init(void){
     DWORD numDevs;
 
     // amplink has 4 channels, use this to detect device
-    RETURN_IF_ERROR(FT_CreateDeviceInfoList(&numDevs));
+    RETURN_IF_ERROR(TRACE_CALL("USB", 0, FT_CreateDeviceInfoList, &numDevs));
     if (numDevs != AMPLINK_CHANNEL_NUM) 
         return FT_OTHER_ERROR;
+    RETURN_IF_ERROR(TRACE_CALL("USB", 0, FT_GetDeviceInfoDetail, 0, NULL, NULL, NULL, NULL, serial, NULL, NULL));
+    // all per-run buffers are allocated once here
+    if (!device.spiArena.base)
+        RETURN_IF_ERROR(arena_init(&device.spiArena, PROGRAMMER_ARENA_SIZE));
+    if (!device.i2cArena.base)
+        RETURN_IF_ERROR(arena_init(&device.i2cArena, PROGRAMMER_ARENA_SIZE));
     // open GPIO ports
     RETURN_IF_ERROR(gpio_driver_init(GPIO_CHANNEL, &device.ftGPIOHandle));
     RETURN_IF_ERROR(gpio_driver_init(CTRL_CHANNEL, &device.ftCTRLHandle));
@@ -52,7 +82,17 @@ FT_STATUS programmer_init(void){
     return FT_OK;
 }
 
-FT_STATUS programmer_flash_select_chip(spi_chip_select_t chipSelect){
+const char *programmer_serial(void){
+    return serial;
+}
+
+void programmer_get_clock_rates(uint32_t *spi_hz, uint32_t *i2c_hz){
+    *spi_hz = SPI_CLOCK_RATE;
+    *i2c_hz = I2C_CLOCK_RATE;
+}
+
+// routes the SPI lines to a flash chip and asserts its chip select
+static FT_STATUS flash_route(spi_chip_select_t chipSelect){
     unsigned char mode_pin;
     unsigned char en_pin;
     // set onebox processor mux
@@ -77,41 +117,112 @@ FT_STATUS programmer_flash_select_chip(spi_chip_select_t chipSelect){
     return spi_driver_setCS(device.ftSPIHandle, chipSelect);
 }
 
-FT_STATUS programmer_flash_write_page(uint32_t address, const uint8_t *data, uint8_t length){
-    FT_STATUS ftStatus;
-
-    while (length > 0) {
-        // calculate space left on current flash page
-        uint32_t page_offset = address % 256;
-        uint32_t space_left = 256 - page_offset;
+FT_STATUS programmer_flash_probe(void){
+    static const spi_chip_select_t chipSelects[] = {SPI_CS_2, SPI_CS_3, SPI_CS_4};
+
+    // one JEDEC ID read per chip back to back, no write enable or status polling
+    chips_probed = 0;
+    for (int i = 0; i < 3; i++){
+        int index = chipSelects[i] >> 2;
+        chip_parts[index] = NULL;
+        RETURN_IF_ERROR(flash_route(chipSelects[i]));
+        chip_status[index] = flash_detect(device.ftSPIHandle, &chip_parts[index]);
+        if (chip_status[index] != FT_OK && chip_status[index] != FT_EEPROM_NOT_PRESENT)
+            return chip_status[index];
+    }
+    chips_probed = 1;
+    return FT_OK;
+}
 
-        // limit write length to smaller of data or page space
-        uint8_t chunk_length = (length <= space_left) ? length : space_left;
+FT_STATUS programmer_flash_chip(spi_chip_select_t chipSelect, const FlashPart **part){
+    int index = (chipSelect >> 2) & 3;
+    *part = chip_parts[index];
+    if (!chips_probed) return FT_OTHER_ERROR;
+    return chip_status[index];
+}
 
-        //printf("Writing %d bytes to address 0x%06X\n", chunk_length, address);
-        ftStatus = flash_write_page(device.ftSPIHandle, address, data, chunk_length);
+uint8_t programmer_flash_found(void){
+    uint8_t found = 0;
+    if (!chips_probed) return 0;
+    // the flash chips sit on CS2 to CS4, CS1 is never probed
+    for (int i = 1; i < 4; i++){
+        if (chip_status[i] == FT_OK)
+            found |= 1 << i;
+    }
+    return found;
+}
 
-        // move to next chunk
-        address += chunk_length;
-        data += chunk_length;
-        length -= chunk_length;
+FT_STATUS programmer_flash_select_chip(spi_chip_select_t chipSelect){
+    int index = (chipSelect >> 2) & 3;
+    flash_part = NULL;
+    // absent chips found by the probe fail without touching the bus
+    if (chips_probed && chip_status[index] != FT_OK)
+        return chip_status[index];
+    RETURN_IF_ERROR(flash_route(chipSelect));
+
+    // identify the part once per chip select
+    if (!chip_parts[index]){
+        chip_status[index] = flash_detect(device.ftSPIHandle, &chip_parts[index]);
+        RETURN_IF_ERROR(chip_status[index]);
     }
-    return ftStatus;
+    flash_part = chip_parts[index];
+    return FT_OK;
 }
 
-FT_STATUS programmer_flash_verify_page(uint32_t address, const uint8_t *data, uint8_t length){
+const FlashPart *programmer_flash_part(void){
+    return flash_part;
+}
+
+FT_STATUS programmer_flash_run_batch(uint32_t address, const uint8_t *cmd, uint32_t cmd_len, uint32_t pages, uint32_t *done){
+    *done = 0;
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_run_batch(device.ftSPIHandle, flash_part, address, cmd, cmd_len, pages, done);
+}
+
+FT_STATUS programmer_flash_run_polled(uint32_t address, const uint8_t *cmd, uint32_t poll_len){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_run_polled(device.ftSPIHandle, flash_part, address, cmd, poll_len);
+}
+
+FT_STATUS programmer_flash_write(uint32_t address, const uint8_t *data, uint32_t length){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_program(device.ftSPIHandle, flash_part, &device.spiArena, address, data, length);
+}
+
+FT_STATUS programmer_flash_write_page(uint32_t address, const uint8_t *data, uint8_t length){
+    return programmer_flash_write(address, data, length);
+}
 
+FT_STATUS programmer_flash_verify(uint32_t address, const uint8_t *data, uint32_t length){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_verify(device.ftSPIHandle, flash_part, &device.spiArena, address, data, length);
+}
+
+FT_STATUS programmer_flash_verify_page(uint32_t address, const uint8_t *data, uint8_t length){
+    return programmer_flash_verify(address, data, length);
 }
 
 FT_STATUS programmer_flash_erase_chip(void){
-    return flash_chip_erase(device.ftSPIHandle);
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_chip_erase(device.ftSPIHandle, flash_part);
+}
+
+FT_STATUS programmer_flash_erase(uint32_t address, uint32_t size){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_erase(device.ftSPIHandle, flash_part, address, size);
+}
+
+FT_STATUS programmer_flash_read(uint32_t address, uint8_t *data, uint32_t length){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    return flash_read(device.ftSPIHandle, flash_part, address, data, length);
 }
 
 FT_STATUS programmer_flash_set_write_state(uint8_t enable){
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
     if (enable)
-        return flash_write_enable(device.ftSPIHandle);
+        return flash_write_enable(device.ftSPIHandle, flash_part);
     else
-        return flash_write_disable(device.ftSPIHandle);
+        return flash_write_disable(device.ftSPIHandle, flash_part);
 }
 
 FT_STATUS programmer_clock_set_addr(uint8_t address){
@@ -123,34 +234,36 @@ FT_STATUS programmer_clock_set_addr(uint8_t address){
 }
 
 FT_STATUS programmer_clock_write_page(uint32_t address, const uint8_t *data, uint8_t length){
-    FT_STATUS ftStatus;
+    FT_STATUS ftStatus = FT_OK;
     if (!i2c_addr){
         return FT_INVALID_PARAMETER;
     }
 
+    // cmd = register address + data chunk, built in place
+    size_t mark = arena_mark(&device.i2cArena);
+    uint8_t *cmd = arena_alloc(&device.i2cArena, CLOCK_ADDR_LEN + CLOCK_MAX_WRITE);
+    if (!cmd) return FT_INSUFFICIENT_RESOURCES;
+
     while (length > 0) {
         // calculate space left on current flash page
-        uint32_t page_offset = address % 256;
-        uint32_t space_left = 256 - page_offset;
+        uint32_t page_offset = address % CLOCK_PAGE_SIZE;
+        uint32_t space_left = CLOCK_PAGE_SIZE - page_offset;
 
         // limit write length to smaller of data or page space
         uint8_t chunk_length = (length <= space_left) ? length : space_left;
 
-        //printf("Writing %d bytes to address 0x%04X\n", chunk_length, address);
-        // address
-        uint8_t buffer[256];
-        buffer[0] = (uint8_t)(address >> 8);
-        buffer[1] = (uint8_t)(address);
-
-        // data
-        memcpy(buffer + 2, data, chunk_length);
-        ftStatus = (i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, chunk_length + 2));
+        cmd[0] = (uint8_t)(address >> 8);
+        cmd[1] = (uint8_t)(address);
+        memcpy(cmd + CLOCK_ADDR_LEN, data, chunk_length);
+        ftStatus = i2c_driver_write(device.ftI2CHandle, i2c_addr, cmd, chunk_length + CLOCK_ADDR_LEN);
+        if (ftStatus != FT_OK) break;
 
         // move to next chunk
         address += chunk_length;
         data += chunk_length;
         length -= chunk_length;
     }
+    arena_release(&device.i2cArena, mark);
     return ftStatus;
 }
 
@@ -163,12 +276,12 @@ FT_STATUS programmer_clock_burn(void){
     RETURN_IF_ERROR(i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, 3));
     buffer[2] = 0xF8;
     RETURN_IF_ERROR(i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, 3));
-    Sleep(500);
+    platform_sleep_us(CLOCK_BURN_PULSE_US);
     buffer[2] = 0xF0;
     RETURN_IF_ERROR(i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, 3));
     buffer[2] = 0xF8;
     RETURN_IF_ERROR(i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, 3));
-    Sleep(500);
+    platform_sleep_us(CLOCK_BURN_PULSE_US);
     buffer[2] = 0xF0;
     RETURN_IF_ERROR(i2c_driver_write(device.ftI2CHandle, i2c_addr, buffer, 3));
     buffer[2] = 0xF2;
@@ -192,7 +305,24 @@ FT_STATUS programmer_clock_burn(void){
 }
 
 FT_STATUS programmer_clock_verify_page(uint32_t address, const uint8_t *data, uint8_t length){
+    FT_STATUS ftStatus;
+    uint8_t addr_buff[CLOCK_ADDR_LEN];
+    if (!i2c_addr){
+        return FT_INVALID_PARAMETER;
+    }
 
+    size_t mark = arena_mark(&device.i2cArena);
+    uint8_t *buffer = arena_alloc(&device.i2cArena, length);
+    if (!buffer) return FT_INSUFFICIENT_RESOURCES;
+    addr_buff[0] = (uint8_t)(address >> 8);
+    addr_buff[1] = (uint8_t)(address);
+    ftStatus = i2c_driver_transfer(device.ftI2CHandle, i2c_addr, addr_buff, CLOCK_ADDR_LEN, buffer, length);
+    if (ftStatus == FT_OK && memcmp(buffer, data, length) != 0){
+        LOG_ERROR("clock verify mismatch at address 0x%04X\n", address);
+        ftStatus = FT_FAILED_TO_WRITE_DEVICE;
+    }
+    arena_release(&device.i2cArena, mark);
+    return ftStatus;
 }
 
 FT_STATUS programmer_spi_write(uint8_t *tx_buff, uint32_t numBytes){
@@ -203,11 +333,145 @@ FT_STATUS programmer_spi_transfer(uint8_t *tx_buff, uint32_t num_write, uint8_t
     return spi_driver_transfer(device.ftSPIHandle, tx_buff, num_write, rx_buff, num_read);
 }
 
+FT_STATUS programmer_spi_set_engine(spi_engine_t engine){
+    if (engine == spi_driver_engine())
+        return FT_OK;
+    spi_driver_close(device.ftSPIHandle);
+    spi_driver_set_engine(engine);
+    flash_part = NULL;
+    RETURN_IF_ERROR(spi_driver_init(SPI_CHANNEL, &device.ftSPIHandle));
+    // the engine's own setup replaced the tuned settings
+    return usb_tuning_apply(device.ftSPIHandle, &usb_spi);
+}
+
+FT_STATUS programmer_spi_benchmark(uint32_t iterations, SpiBenchmark *result){
+    FT_STATUS ftStatus = FT_OK;
+    uint8_t header[1 + FLASH_MAX_ADDR_LEN] = {0};
+    uint8_t status;
+
+    result->status_us = 0;
+    result->read_kbps = 0;
+    if (!flash_part) return FT_EEPROM_NOT_PRESENT;
+    if (iterations == 0) return FT_OK;
+    size_t mark = arena_mark(&device.spiArena);
+    uint8_t *block = arena_alloc(&device.spiArena, FLASH_VERIFY_BLOCK);
+    if (!block) return FT_INSUFFICIENT_RESOURCES;
+
+    uint64_t start = platform_time_us();
+    header[0] = flash_part->op_read_status;
+    for (uint32_t i = 0; i < iterations && ftStatus == FT_OK; i++)
+        ftStatus = spi_driver_transfer(device.ftSPIHandle, header, 1, &status, 1);
+    if (ftStatus == FT_OK)
+        result->status_us = platform_elapsed_ms(start) * 1000.0 / iterations;
+
+    // Read Array from address 0
+    start = platform_time_us();
+    header[0] = flash_part->op_read;
+    for (uint32_t i = 0; i < iterations && ftStatus == FT_OK; i++)
+        ftStatus = spi_driver_transfer(device.ftSPIHandle, header, 1 + flash_part->addr_len, block, FLASH_VERIFY_BLOCK);
+    if (ftStatus == FT_OK){
+        double elapsed_ms = platform_elapsed_ms(start);
+        if (elapsed_ms > 0)
+            result->read_kbps = (double)FLASH_VERIFY_BLOCK * iterations / 1024.0 / (elapsed_ms / 1000.0);
+    }
+    arena_release(&device.spiArena, mark);
+    return ftStatus;
+}
+
+
+// a status read and a page sized Read Array, the round trips programming and verifying wait on
+static FT_STATUS tune_spi_probe(void *ctx){
+    uint8_t header[4] = {0x05, 0, 0, 0};
+    uint8_t status_reg;
+    RETURN_IF_ERROR(spi_driver_transfer(device.ftSPIHandle, header, 1, &status_reg, 1));
+    header[0] = 0x03;
+    return spi_driver_transfer(device.ftSPIHandle, header, 4, (uint8_t *)ctx, FLASH_PAGE_SIZE);
+}
+
+// a clock page read, as done by the clock verify
+static FT_STATUS tune_i2c_probe(void *ctx){
+    uint8_t addr_buff[CLOCK_ADDR_LEN] = {0, 0};
+    return i2c_driver_transfer(device.ftI2CHandle, i2c_addr, addr_buff, CLOCK_ADDR_LEN, (uint8_t *)ctx, TUNE_CLOCK_READ);
+}
+
+// a port read, the chip routing reads back its pins the same way
+static FT_STATUS tune_gpio_probe(void *ctx){
+    return gpio_driver_read_port(device.ftGPIOHandle, (unsigned char *)ctx);
+}
+
+// takes the cached settings of a channel or sweeps and caches them, the result stays applied
+static FT_STATUS tune_channel(const char *path, int force, const char *name, FT_HANDLE ftHandle,
+                              usb_tuning_probe_t probe, void *ctx, UsbSettings *settings, int *swept){
+    const char *key = serial[0] ? serial : "-";
+    if (force || usb_tuning_load(path, key, name, settings) != FT_OK){
+        if (usb_tuning_sweep(ftHandle, probe, ctx, settings) != FT_OK){
+            // keep the driver defaults, a later run sweeps again
+            memset(settings, 0, sizeof(*settings));
+            LOG_WARN("no stable USB settings found for the %s channel\n", name);
+            return FT_OTHER_ERROR;
+        }
+        (*swept)++;
+        if (usb_tuning_save(path, key, name, settings) != FT_OK)
+            LOG_WARN("could not write USB settings to '%s'\n", path);
+        return FT_OK;
+    }
+    return usb_tuning_apply(ftHandle, settings);
+}
+
+FT_STATUS programmer_usb_tune(const char *path, int force, int *swept){
+    FT_STATUS result = FT_OK;
+    unsigned char port;
+    *swept = 0;
+    if (!path) path = USB_TUNING_DEFAULT_FILE;
+
+    // route to a fitted chip if there is one, the timing does not depend on the reply
+    static const spi_chip_select_t chipSelects[] = {SPI_CS_2, SPI_CS_3, SPI_CS_4};
+    spi_chip_select_t route = SPI_CS_2;
+    for (int i = 0; i < 3; i++){
+        if (chips_probed && chip_status[chipSelects[i] >> 2] == FT_OK){
+            route = chipSelects[i];
+            break;
+        }
+    }
+    flash_part = NULL;
+    size_t mark = arena_mark(&device.spiArena);
+    uint8_t *block = arena_alloc(&device.spiArena, FLASH_PAGE_SIZE);
+    if (!block) return FT_INSUFFICIENT_RESOURCES;
+    FT_STATUS ftStatus = flash_route(route);
+    if (ftStatus == FT_OK)
+        ftStatus = tune_channel(path, force, "spi", device.ftSPIHandle, tune_spi_probe, block, &usb_spi, swept);
+    arena_release(&device.spiArena, mark);
+    if (ftStatus != FT_OK) result = ftStatus;
+
+    // needs the clock fitted, without it the I2C channel keeps its defaults
+    mark = arena_mark(&device.i2cArena);
+    block = arena_alloc(&device.i2cArena, TUNE_CLOCK_READ);
+    if (!block) return FT_INSUFFICIENT_RESOURCES;
+    ftStatus = i2c_addr ? tune_channel(path, force, "i2c", device.ftI2CHandle, tune_i2c_probe, block, &usb_i2c, swept)
+                        : FT_INVALID_PARAMETER;
+    arena_release(&device.i2cArena, mark);
+    if (ftStatus != FT_OK && result == FT_OK) result = ftStatus;
+
+    // both GPIO channels do the same single byte port accesses
+    ftStatus = tune_channel(path, force, "gpio", device.ftGPIOHandle, tune_gpio_probe, &port, &usb_gpio, swept);
+    if (ftStatus == FT_OK) ftStatus = usb_tuning_apply(device.ftCTRLHandle, &usb_gpio);
+    if (ftStatus != FT_OK && result == FT_OK) result = ftStatus;
+    return result;
+}
+
+void programmer_get_usb_settings(UsbSettings *spi, UsbSettings *i2c, UsbSettings *gpio){
+    if (spi) *spi = usb_spi;
+    if (i2c) *i2c = usb_i2c;
+    if (gpio) *gpio = usb_gpio;
+}
+
 
 void programmer_close(void){
     gpio_driver_close(device.ftGPIOHandle);
     gpio_driver_close(device.ftCTRLHandle);
     spi_driver_close(device.ftSPIHandle);
     i2c_driver_close(device.ftI2CHandle);
+    arena_free(&device.spiArena);
+    arena_free(&device.i2cArena);
 }
 
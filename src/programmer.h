@@ -9,27 +9,112 @@
 #ifndef PROGRAMMER_H
 #define PROGRAMMER_H
 
-#include <windows.h>
 #include <stdint.h>
 
 #include "config.h"
 #include "ftd2xx.h"
+#include "spi_flash.h"
+#include "spi_driver.h"
+#include "usb_tuning.h"
 
-//! Opens ftdi GPIO, SPI, and I2C ports
+/*!
+ * @brief Size of the buffer arena of each bus channel
+ *
+ * One MPSSE clock data command moves at most 64 KB, no single transfer needs more.
+ * Must cover @ref FLASH_ARENA_SIZE.
+*/
+#define PROGRAMMER_ARENA_SIZE 0x10000
+_Static_assert(PROGRAMMER_ARENA_SIZE >= FLASH_ARENA_SIZE, "PROGRAMMER_ARENA_SIZE must cover FLASH_ARENA_SIZE");
+
+/*!
+ * @struct SpiBenchmark
+ * @brief Timings of the plain SPI passthroughs on the selected flash chip
+ */
+typedef struct {
+    double status_us; /*!< Mean time of a status register read (1 byte out, 1 byte in) */
+    double read_kbps; /*!< Throughput of FLASH_VERIFY_BLOCK sized Read Array commands */
+} SpiBenchmark;
+
+//! Opens ftdi GPIO, SPI, and I2C ports and allocates the per-run buffers
 FT_STATUS programmer_init(void);
 
+/*!
+ * @brief Returns the serial number of the connected AmPLink
+ *
+ * @return const char* Serial number, empty string before @ref programmer_init
+*/
+const char *programmer_serial(void);
+
+/*!
+ * @brief Gets the clock rates used on the SPI and I2C channels
+ *
+ * @param[out] spi_hz SPI clock rate in Hz
+ * @param[out] i2c_hz I2C clock rate in Hz
+*/
+void programmer_get_clock_rates(uint32_t *spi_hz, uint32_t *i2c_hz);
+
+/*!
+ * @brief Reads the JEDEC ID of all three flash chips in one pass
+ *
+ * Call right after @ref programmer_init. Selects the part descriptor of every
+ * chip, see @ref programmer_flash_chip. Chips found absent are failed by
+ * @ref programmer_flash_select_chip without further bus traffic.
+ *
+ * @return FT_STATUS Status of the operation, FT_OK even if chips are absent
+*/
+FT_STATUS programmer_flash_probe(void);
+
+/*!
+ * @brief Returns the probe result of a flash chip
+ *
+ * @param[in] chipSelect Chip to query
+ * @param[out] part Descriptor of the detected part, NULL if absent
+ * @return FT_STATUS FT_OK if present, FT_EEPROM_NOT_PRESENT if absent,
+ *         FT_OTHER_ERROR before @ref programmer_flash_probe
+*/
+FT_STATUS programmer_flash_chip(spi_chip_select_t chipSelect, const FlashPart **part);
+
+/*!
+ * @brief Returns the flash chips found by the last probe
+ *
+ * @return uint8_t Bit (chipSelect >> 2) set for every chip present, 0 before @ref programmer_flash_probe
+*/
+uint8_t programmer_flash_found(void);
+
 /*!
  * @brief Selects processor board flash chip mux and sets SPI_driver CS
  *
+ * Without a prior @ref programmer_flash_probe the part is identified by its
+ * JEDEC ID the first time a chip select is used.
+ *
  * @param chipSelect variable of type spi_chip_select_t
- * @return FT_STATUS Status of the operation
+ * @return FT_STATUS Status of the operation, FT_EEPROM_NOT_PRESENT if no chip answers
 */
 FT_STATUS programmer_flash_select_chip(spi_chip_select_t chipSelect);
 
+/*!
+ * @brief Returns the descriptor of the selected flash part
+ *
+ * @return const FlashPart* Descriptor, NULL if no chip is selected
+*/
+const FlashPart *programmer_flash_part(void);
+
 /*!
  * @brief Writes data to flash memory over SPI
  *
- * Data is automatically chunked into 256 byte pages with seperate writes
+ * Data is automatically chunked into pages of the selected part with seperate writes
+ * 
+ * @param address address of flash memory to start writing
+ * @param data pointer to array of type uint8_t to program
+ * @param length number of bytes in data
+ * @return FT_STATUS Status of the operation
+*/
+FT_STATUS programmer_flash_write(uint32_t address, const uint8_t *data, uint32_t length);
+
+/*!
+ * @brief Writes a single HEX record to flash memory over SPI
+ *
+ * Callback compatible wrapper of @ref programmer_flash_write for @ref fileparser.h
  * 
  * @param address address of flash memory to start writing
  * @param data pointer to array of type uint8_t to program
@@ -38,6 +123,51 @@ FT_STATUS programmer_flash_select_chip(spi_chip_select_t chipSelect);
 */
 FT_STATUS programmer_flash_write_page(uint32_t address, const uint8_t *data, uint8_t length);
 
+/*!
+ * @brief Sends pages compiled by @ref flash_compile_page to the selected flash chip in one round trip
+ *
+ * @param[in] address Address of the first page, for error messages
+ * @param[in] cmd Concatenated MPSSE buffers of the pages
+ * @param[in] cmd_len Length of cmd
+ * @param[in] pages Number of pages, at most @ref FLASH_BATCH_PAGES
+ * @param[out] done Pages that completed before the first failure, see @ref flash_run_batch
+ * @return FT_STATUS Status of the operation, see @ref flash_run_batch
+*/
+FT_STATUS programmer_flash_run_batch(uint32_t address, const uint8_t *cmd, uint32_t cmd_len, uint32_t pages, uint32_t *done);
+
+/*!
+ * @brief Sends one page compiled by @ref flash_compile_page to the selected flash chip and polls it until done
+ *
+ * @param[in] address Address of the page, for error messages
+ * @param[in] cmd MPSSE buffer of the page
+ * @param[in] poll_len Length of cmd up to the program time delay, see FlashStep::poll_len
+ * @return FT_STATUS Status of the operation, see @ref flash_run_polled
+*/
+FT_STATUS programmer_flash_run_polled(uint32_t address, const uint8_t *cmd, uint32_t poll_len);
+
+/*!
+ * @brief Reads back flash memory over SPI and compares it to data
+ *
+ * Data is read back in blocks of up to @ref FLASH_VERIFY_BLOCK bytes, with Fast Read
+ * when the part supports it and the data spans more than one page
+ *
+ * @param address address of flash memory to start reading
+ * @param data pointer to array of type uint8_t of expected bytes
+ * @param length number of bytes in data
+ * @return FT_STATUS Status of the operation: FT_OK, FT_FAILED_TO_WRITE_DEVICE on mismatch
+*/
+FT_STATUS programmer_flash_verify(uint32_t address, const uint8_t *data, uint32_t length);
+
+/*!
+ * @brief Verifies a single HEX record against flash memory
+ *
+ * Callback compatible wrapper of @ref programmer_flash_verify for @ref fileparser.h
+ *
+ * @param address address of flash memory to start reading
+ * @param data pointer to array of type uint8_t of expected bytes
+ * @param length number of bytes in data
+ * @return FT_STATUS Status of the operation: FT_OK, FT_FAILED_TO_WRITE_DEVICE on mismatch
+*/
 FT_STATUS programmer_flash_verify_page(uint32_t address, const uint8_t *data, uint8_t length);
 
 /*!
@@ -47,6 +177,27 @@ FT_STATUS programmer_flash_verify_page(uint32_t address, const uint8_t *data, ui
 */
 FT_STATUS programmer_flash_erase_chip(void);
 
+/*!
+ * @brief Erases one block of the selected flash chip
+ *
+ * Write enable must be set, see @ref programmer_flash_set_write_state
+ *
+ * @param address start of the block, aligned to size
+ * @param size one of the erase sizes of the part, see @ref FlashPart::erase
+ * @return FT_STATUS Status of the operation, see @ref flash_erase
+*/
+FT_STATUS programmer_flash_erase(uint32_t address, uint32_t size);
+
+/*!
+ * @brief Reads flash memory of the selected chip over SPI
+ *
+ * @param address address of flash memory to start reading
+ * @param data buffer receiving the bytes
+ * @param length number of bytes to read
+ * @return FT_STATUS Status of the operation
+*/
+FT_STATUS programmer_flash_read(uint32_t address, uint8_t *data, uint32_t length);
+
 /*!
  * @brief Sets write enable bit in flash memory status register
  * 
@@ -82,6 +233,14 @@ FT_STATUS programmer_clock_write_page(uint32_t address, const uint8_t *data, uin
  */
 FT_STATUS programmer_clock_burn(void);
 
+/*!
+ * @brief Reads back clock memory over i2c and compares it to data
+ *
+ * @param address address of clock memory to start reading
+ * @param data pointer to array of type uint8_t of expected bytes
+ * @param length number of bytes in data
+ * @return FT_STATUS Status of the operation: FT_OK, FT_FAILED_TO_WRITE_DEVICE on mismatch
+*/
 FT_STATUS programmer_clock_verify_page(uint32_t address, const uint8_t *data, uint8_t length);
 
 /*!
@@ -104,6 +263,53 @@ FT_STATUS programmer_spi_write(uint8_t *tx_buff, uint32_t numBytes);
 */
 FT_STATUS programmer_spi_transfer(uint8_t *tx_buff, uint32_t num_write, uint8_t *rx_buff, uint32_t num_read);
 
+/*!
+ * @brief Reopens the SPI channel on another engine, see @ref spi_engine_t
+ *
+ * Call between jobs only. The chip select is set again by the next
+ * @ref programmer_flash_select_chip.
+ *
+ * @param[in] engine Engine to switch to
+ * @return FT_STATUS Status of the operation
+*/
+FT_STATUS programmer_spi_set_engine(spi_engine_t engine);
+
+/*!
+ * @brief Applies the fastest stable USB settings to every channel
+ *
+ * Settings cached for the serial number of this AmPLink are applied as they
+ * are, missing ones are found by @ref usb_tuning_sweep and cached. The I2C
+ * channel is only swept with the clock fitted and its address set by
+ * @ref programmer_clock_set_addr, a channel that cannot be swept keeps its
+ * driver defaults. Call before any job is started.
+ *
+ * @param[in] path Cache file, NULL for @ref USB_TUNING_DEFAULT_FILE
+ * @param[in] force Set to sweep again even if settings are cached
+ * @param[out] swept Number of channels swept instead of taken from the cache
+ * @return FT_STATUS FT_OK if every channel runs tuned settings, otherwise the first failure
+*/
+FT_STATUS programmer_usb_tune(const char *path, int force, int *swept);
+
+/*!
+ * @brief Returns the USB settings in use
+ *
+ * @param[out] spi Settings of the SPI channel, optional
+ * @param[out] i2c Settings of the I2C channel, optional
+ * @param[out] gpio Settings of the GPIO channels, optional
+*/
+void programmer_get_usb_settings(UsbSettings *spi, UsbSettings *i2c, UsbSettings *gpio);
+
+/*!
+ * @brief Times status reads and block reads through @ref programmer_spi_transfer
+ *
+ * Uses the chip chosen by @ref programmer_flash_select_chip, nothing is written to it.
+ *
+ * @param[in] iterations Number of status reads and of block reads
+ * @param[out] result Measured timings
+ * @return FT_STATUS Status of the operation, FT_EEPROM_NOT_PRESENT if no chip is selected
+*/
+FT_STATUS programmer_spi_benchmark(uint32_t iterations, SpiBenchmark *result);
+
 /*! 
  * @brief Close all related ports on the AmPLink device.
  */
@@ -0,0 +1,244 @@
+#include "progress.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string.h>
+#include "platform.h"
+
+#define PROGRESS_LINE_LEN 160
+
+/*!
+ * @struct ProgressLane
+ * @brief Jobs of one chip and their sampling state
+ */
+typedef struct {
+    const char *label;                      /*!< Lane label */
+    Job *jobs[PROGRESS_MAX_LANE_JOBS];      /*!< Jobs in execution order */
+    int job_count;                          /*!< Number of jobs */
+    const Job *current;                     /*!< Job seen running at the last sample */
+    uint32_t last_bytes;                    /*!< Bytes written or verified at the last sample, skipped bytes left out */
+    uint64_t last_ms;                       /*!< Time of the last sample */
+    uint64_t start_ms;                      /*!< Time the current job was first seen running */
+    ProgressSample sample;                  /*!< Latest sample */
+} ProgressLane;
+
+static ProgressLane lanes[PROGRESS_MAX_LANES];
+static int lane_count;
+static int stopped;
+static int console_enabled;
+static size_t line_len;
+static PlatformMutex lock;
+static PlatformEvent stop_event;
+static PlatformThread thread;
+
+
+static const char *progress_job_name(job_type_t type){
+    switch (type){
+        case JOB_FLASH_ERASE:   return "erase";
+        case JOB_FLASH_PROGRAM: return "program";
+        case JOB_FLASH_VERIFY:  return "verify";
+        case JOB_CLOCK_PROGRAM: return "program";
+        case JOB_CLOCK_VERIFY:  return "verify";
+        case JOB_CLOCK_BURN:    return "burn";
+        default:                return "?";
+    }
+}
+
+// called with the lock held
+static void progress_sample_lane(ProgressLane *lane, uint64_t now){
+    ProgressSample *s = &lane->sample;
+
+    // the first job not done is the running one
+    const Job *job = NULL;
+    for (int i = 0; i < lane->job_count; i++){
+        if (lane->jobs[i]->state != JOB_DONE){
+            job = lane->jobs[i];
+            break;
+        }
+    }
+    s->finished = (job == NULL);
+    if (!job){
+        s->eta_s = 0;
+        return;
+    }
+    if (job->state != JOB_RUNNING)
+        return;
+
+    // the rate counts only data sent to the chip, skipped pages complete instantly.
+    // bytes_skipped is read first, the queue adds to it after bytes_done
+    uint32_t skipped = job->bytes_skipped;
+    uint32_t done = job->bytes_done;
+    uint32_t sent = done - skipped;
+    if (job != lane->current){
+        lane->current = job;
+        lane->start_ms = now;
+        lane->last_ms = now;
+        lane->last_bytes = sent;
+        s->rate_bps = 0;
+    }
+    s->job = job;
+    s->bytes_done = done;
+    s->bytes_total = job->bytes_total;
+    s->elapsed_s = (now - lane->start_ms) / 1000.0;
+
+    uint64_t dt_ms = now - lane->last_ms;
+    if (dt_ms > 0 && lane->last_ms != lane->start_ms){
+        double rate = (sent - lane->last_bytes) * 1000.0 / (double)dt_ms;
+        double alpha = 1.0 - exp(-(double)dt_ms / PROGRESS_TAU_MS);
+        s->rate_bps = s->rate_bps > 0 ? s->rate_bps + alpha * (rate - s->rate_bps) : rate;
+    } else if (dt_ms > 0 && sent > lane->last_bytes){
+        s->rate_bps = (sent - lane->last_bytes) * 1000.0 / (double)dt_ms;
+    }
+    if (dt_ms > 0){
+        lane->last_ms = now;
+        lane->last_bytes = sent;
+    }
+    if (s->rate_bps > s->peak_bps)
+        s->peak_bps = s->rate_bps;
+
+    if (s->bytes_total && s->rate_bps > 0)
+        s->eta_s = (s->bytes_total > done ? s->bytes_total - done : 0) / s->rate_bps;
+    else
+        s->eta_s = -1;
+}
+
+// called with the lock held
+static void progress_clear_line(void){
+    if (!line_len) return;
+    printf("\r%*s\r", (int)line_len, "");
+    line_len = 0;
+}
+
+// called with the lock held
+static void progress_draw(void){
+    char line[PROGRESS_LINE_LEN];
+    size_t n = 0;
+
+    for (int i = 0; i < lane_count && n < sizeof(line); i++){
+        const ProgressSample *s = &lanes[i].sample;
+        int w;
+        if (s->finished || !s->job || s->job->state != JOB_RUNNING){
+            continue;
+        } else if (s->bytes_total){
+            w = snprintf(line + n, sizeof(line) - n, "%s%s %s %3u%%",
+                         n ? " | " : "", lanes[i].label, progress_job_name(s->job->type),
+                         (unsigned)((uint64_t)s->bytes_done * 100 / s->bytes_total));
+            // no rate or ETA until the first bytes were measured
+            if (w > 0 && s->eta_s >= 0 && (size_t)w < sizeof(line) - n)
+                w += snprintf(line + n + w, sizeof(line) - n - w, " %.1fKB/s ETA %.0fs", s->rate_bps / 1024.0, ceil(s->eta_s));
+        } else {
+            w = snprintf(line + n, sizeof(line) - n, "%s%s %s %.1fs",
+                         n ? " | " : "", lanes[i].label, progress_job_name(s->job->type), s->elapsed_s);
+        }
+        if (w < 0) break;
+        n += (size_t)w;
+    }
+    if (n >= sizeof(line)) n = sizeof(line) - 1;
+    line[n] = '\0';
+
+    size_t previous = line_len;
+    printf("\r%s", line);
+    if (previous > n)
+        printf("%*s\r%s", (int)(previous - n), "", line);
+    line_len = n;
+    fflush(stdout);
+}
+
+static void progress_tick(void){
+    uint64_t now = platform_time_ms();
+    platform_mutex_lock(&lock);
+    for (int i = 0; i < lane_count; i++)
+        progress_sample_lane(&lanes[i], now);
+    if (console_enabled)
+        progress_draw();
+    platform_mutex_unlock(&lock);
+}
+
+static void progress_thread(void *param){
+    (void)param;
+    while (!platform_event_wait(&stop_event, PROGRESS_INTERVAL_MS))
+        progress_tick();
+}
+
+
+int progress_add_lane(const char *label, Job *const *jobs, int count){
+    if (stopped){
+        // lanes of the previous run are kept readable until a new run is set up
+        lane_count = 0;
+        stopped = 0;
+    }
+    if (platform_thread_started(&thread) || lane_count >= PROGRESS_MAX_LANES || count > PROGRESS_MAX_LANE_JOBS)
+        return -1;
+    ProgressLane *lane = &lanes[lane_count];
+    memset(lane, 0, sizeof(*lane));
+    lane->label = label;
+    lane->job_count = count;
+    for (int i = 0; i < count; i++)
+        lane->jobs[i] = jobs[i];
+    lane->sample.eta_s = -1;
+    return lane_count++;
+}
+
+FT_STATUS progress_start(int console){
+    console_enabled = console;
+    line_len = 0;
+    platform_mutex_init(&lock);
+    if (platform_event_init(&stop_event, 1) != FT_OK){
+        platform_mutex_destroy(&lock);
+        return FT_OTHER_ERROR;
+    }
+    if (platform_thread_start(&thread, progress_thread, NULL) != FT_OK){
+        platform_event_destroy(&stop_event);
+        platform_mutex_destroy(&lock);
+        return FT_OTHER_ERROR;
+    }
+    return FT_OK;
+}
+
+void progress_get(int lane, ProgressSample *sample){
+    if (lane < 0 || lane >= lane_count){
+        memset(sample, 0, sizeof(*sample));
+        sample->eta_s = -1;
+        return;
+    }
+    int running = platform_thread_started(&thread);
+    if (running) platform_mutex_lock(&lock);
+    *sample = lanes[lane].sample;
+    if (running) platform_mutex_unlock(&lock);
+}
+
+void progress_println(const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    int running = platform_thread_started(&thread);
+    if (running){
+        platform_mutex_lock(&lock);
+        progress_clear_line();
+    }
+    vprintf(fmt, ap);
+    printf("\n");
+    if (running){
+        fflush(stdout);
+        platform_mutex_unlock(&lock);
+    }
+    va_end(ap);
+}
+
+void progress_stop(void){
+    stopped = 1;
+    if (!platform_thread_started(&thread))
+        return;
+    platform_event_set(&stop_event);
+    platform_thread_join(&thread);
+    platform_event_destroy(&stop_event);
+
+    // final sample so finished lanes report their totals
+    uint64_t now = platform_time_ms();
+    for (int i = 0; i < lane_count; i++)
+        progress_sample_lane(&lanes[i], now);
+    if (console_enabled)
+        progress_clear_line();
+    fflush(stdout);
+    platform_mutex_destroy(&lock);
+}
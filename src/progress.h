@@ -0,0 +1,106 @@
+/*! @file progress.h
+ *  @brief Live progress and ETA of running jobs, sampled at a fixed low rate.
+ *
+ * A reporter thread samples the byte counters of submitted jobs a few times
+ * per second, computes a smoothed throughput and an ETA, and redraws a single
+ * status line on the console. Nothing is added to the per-page programming
+ * loop, the jobs only update their byte counters as before.
+ *
+ * @details
+ * Jobs are grouped in lanes, one lane per chip, e.g. erase, program and verify
+ * of one flash chip. A lane shows the job that is currently running.
+ *
+ * Throughput is an exponential moving average with a time constant of
+ * @ref PROGRESS_TAU_MS, so it settles within a few seconds and ignores single
+ * slow pages. Samples can be read at any time with @ref progress_get.
+ *
+ * **Example usage:**
+ * @code
+ * Job *jobs[] = {&erase, &program, &verify};
+ * progress_add_lane("CS2", jobs, 3);
+ * progress_start(1);
+ * job_wait(&verify);
+ * progress_stop();
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+#include "job_queue.h"
+
+//! Maximum number of lanes
+#define PROGRESS_MAX_LANES      8
+//! Maximum number of jobs per lane
+#define PROGRESS_MAX_LANE_JOBS  4
+//! Sampling and redraw interval in milliseconds
+#define PROGRESS_INTERVAL_MS    250
+//! Time constant of the throughput average in milliseconds
+#define PROGRESS_TAU_MS         2000
+
+/*!
+ * @struct ProgressSample
+ * @brief Latest progress of a lane
+ */
+typedef struct {
+    const Job *job;       /*!< Job currently running, or the last job once the lane finished, NULL before start */
+    uint32_t bytes_done;  /*!< Bytes done by the job */
+    uint32_t bytes_total; /*!< Bytes to do, 0 if unknown */
+    double rate_bps;      /*!< Smoothed throughput in bytes per second */
+    double peak_bps;      /*!< Highest smoothed throughput seen in the lane */
+    double elapsed_s;     /*!< Time since the job started */
+    double eta_s;         /*!< Estimated seconds left for the job, negative if unknown */
+    int finished;         /*!< Set once every job of the lane is done */
+} ProgressSample;
+
+/*!
+ * @brief Adds a lane of jobs to report on, before @ref progress_start.
+ *
+ * The first lane added after @ref progress_stop starts a new set of lanes.
+ *
+ * @param[in] label Short lane label, e.g. "CS2"
+ * @param[in] jobs Jobs of the lane in execution order
+ * @param[in] count Number of jobs
+ * @return int Lane index, -1 if there is no space left
+ */
+int progress_add_lane(const char *label, Job *const *jobs, int count);
+
+/*!
+ * @brief Starts the reporter thread.
+ *
+ * @param[in] console Non-zero to redraw a status line on the console
+ * @return FT_STATUS FT_OK, FT_OTHER_ERROR if the thread could not be started
+ */
+FT_STATUS progress_start(int console);
+
+/*!
+ * @brief Reads the latest sample of a lane.
+ *
+ * @param[in] lane Lane index returned by @ref progress_add_lane
+ * @param[out] sample Latest sample
+ */
+void progress_get(int lane, ProgressSample *sample);
+
+/*!
+ * @brief Prints a line without garbling the status line.
+ *
+ * Use instead of printf while the reporter is running. The status line is
+ * redrawn below the printed line on the next sample.
+ *
+ * @param[in] fmt printf style format string
+ */
+void progress_println(const char *fmt, ...);
+
+/*!
+ * @brief Takes a final sample, clears the status line and stops the reporter.
+ *
+ * Samples stay readable with @ref progress_get until the next @ref progress_add_lane.
+ */
+void progress_stop(void);
+
+#endif
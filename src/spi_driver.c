@@ -1,33 +1,148 @@
 #include "spi_driver.h"
 #include "utils.h"
+#include "trace.h"
+#include "platform.h"
 #include "libmpsse_spi.h"
+#include <string.h>
+
+// MPSSE opcodes, see FTDI AN_108
+#define MPSSE_SET_LOW        0x80 // value, direction of ADBUS0-7
+#define MPSSE_WRITE_BYTES    0x11 // clock bytes out on the falling edge, MSB first
+#define MPSSE_READ_BYTES     0x20 // clock bytes in on the rising edge, MSB first
+#define MPSSE_CLOCK_BYTES    0x8F // clock n x 8 bits without data
+#define MPSSE_SEND_IMMEDIATE 0x87 // flush the read buffer to the host now
+#define MPSSE_LOOPBACK_OFF   0x85
+#define MPSSE_SET_DIVISOR    0x86 // clock = 60 MHz / ((1 + divisor) * 2)
+#define MPSSE_DIV5_OFF       0x8A // 60 MHz master clock
+#define MPSSE_3PHASE_OFF     0x8D
+#define MPSSE_ADAPTIVE_OFF   0x97
+#define MPSSE_BAD_COMMAND    0xAA // answered with 0xFA 0xAA, used to sync
+#define MPSSE_MAX_CHUNK      0x10000
+
+// raw engine channel setup
+#define SPI_RAW_DIVISOR      (60000000 / (2 * SPI_CLOCK_RATE) - 1)
+#define SPI_RAW_TIMEOUT_MS   5000
+#define SPI_RAW_SETTLE_US    50000 // MPSSE start up after the bit mode change
+#define SPI_RAW_ARENA_SIZE   (2 * MPSSE_MAX_CHUNK)
+
+// ADBUS0 SCK, ADBUS1 MOSI and ADBUS3-7 chip selects out, ADBUS2 MISO in
+#define SPI_PIN_DIR  0xFB
+// mode 0 idle: SCK low, every active low chip select high
+#define SPI_PIN_IDLE 0xF8
+#define SPI_CS_PIN(cs) (uint8_t)(1u << (3 + ((cs) >> 2)))
+
+//! Chip select set by spi_driver_setCS, libMPSSE defaults to ADBUS3
+static spi_chip_select_t chip_select = SPI_CS_1;
+//! Engine used by the next spi_driver_init and every call on the open channel
+static spi_engine_t engine = SPI_ENGINE_LIBMPSSE;
+//! Command buffers of spi_driver_write/spi_driver_transfer on the raw engine
+static Arena raw_arena;
+
+
+static FT_STATUS raw_write(FT_HANDLE ftHandle, uint8_t *cmd, DWORD len){
+    FT_STATUS ftStatus;
+    DWORD bytesTransferred;
+    RETURN_IF_ERROR(TRACE_CALL("SPI", len, FT_Write, ftHandle, cmd, len, &bytesTransferred));
+    if (bytesTransferred != len)
+        return FT_OTHER_ERROR;
+    return FT_OK;
+}
+
+// puts the channel in MPSSE mode and checks it echoes a bad command, see FTDI AN_135
+static FT_STATUS raw_init(ftd_channel_t deviceNumber, FT_HANDLE *pHandle){
+    FT_STATUS ftStatus;
+    DWORD bytesTransferred;
+    uint8_t reply[2] = {0, 0};
+
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_Open, deviceNumber, pHandle));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_ResetDevice, *pHandle));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetUSBParameters, *pHandle, MPSSE_MAX_CHUNK, MPSSE_MAX_CHUNK));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetChars, *pHandle, 0, 0, 0, 0));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetTimeouts, *pHandle, SPI_RAW_TIMEOUT_MS, SPI_RAW_TIMEOUT_MS));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetLatencyTimer, *pHandle, 255));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetFlowControl, *pHandle, FT_FLOW_RTS_CTS, 0, 0));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetBitMode, *pHandle, 0, FT_BITMODE_RESET));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_SetBitMode, *pHandle, 0, FT_BITMODE_MPSSE));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, FT_Purge, *pHandle, FT_PURGE_RX | FT_PURGE_TX));
+    platform_sleep_us(SPI_RAW_SETTLE_US);
+
+    uint8_t sync = MPSSE_BAD_COMMAND;
+    RETURN_IF_ERROR(raw_write(*pHandle, &sync, 1));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 2, FT_Read, *pHandle, reply, 2, &bytesTransferred));
+    if (bytesTransferred != 2 || reply[0] != 0xFA || reply[1] != MPSSE_BAD_COMMAND){
+        LOG_ERROR("spi: MPSSE did not sync (%02X %02X)\n", reply[0], reply[1]);
+        return FT_OTHER_ERROR;
+    }
+
+    // mode 0 at SPI_CLOCK_RATE, every chip select high
+    uint8_t setup[] = {
+        MPSSE_DIV5_OFF, MPSSE_ADAPTIVE_OFF, MPSSE_3PHASE_OFF, MPSSE_LOOPBACK_OFF,
+        MPSSE_SET_DIVISOR, (uint8_t)(SPI_RAW_DIVISOR & 0xFF), (uint8_t)(SPI_RAW_DIVISOR >> 8),
+        MPSSE_SET_LOW, SPI_PIN_IDLE, SPI_PIN_DIR
+    };
+    RETURN_IF_ERROR(raw_write(*pHandle, setup, sizeof(setup)));
+    if (!raw_arena.base)
+        RETURN_IF_ERROR(arena_init(&raw_arena, SPI_RAW_ARENA_SIZE));
+    return FT_OK;
+}
+
+
+void spi_driver_set_engine(spi_engine_t selected){
+    engine = selected;
+}
+
+spi_engine_t spi_driver_engine(void){
+    return engine;
+}
+
+const char *spi_engine_to_str(spi_engine_t selected){
+    switch (selected){
+        case SPI_ENGINE_LIBMPSSE: return "libmpsse";
+        case SPI_ENGINE_RAW:      return "raw";
+        default:                  return "unknown";
+    }
+}
 
 
 FT_STATUS spi_driver_init(ftd_channel_t deviceNumber, FT_HANDLE *pHandle){
     FT_STATUS ftStatus;
     ChannelConfigSPI channelConfSPI;
 
-    RETURN_IF_ERROR(SPI_OpenChannel(deviceNumber, pHandle));
+    chip_select = SPI_CS_1;
+    if (engine == SPI_ENGINE_RAW)
+        return raw_init(deviceNumber, pHandle);
+
+    RETURN_IF_ERROR(TRACE_CALL("SPI", 0, SPI_OpenChannel, deviceNumber, pHandle));
 
     memset(&channelConfSPI, 0, sizeof(channelConfSPI));
-    channelConfSPI.ClockRate = 100000;
+    channelConfSPI.ClockRate = SPI_CLOCK_RATE;
     channelConfSPI.LatencyTimer = 255;
     channelConfSPI.configOptions = SPI_CONFIG_OPTION_MODE0 | SPI_CONFIG_OPTION_CS_ACTIVELOW;
     channelConfSPI.Pin = 0xFFFFFFFF; // all pins output high on init/close
 
-    return SPI_InitChannel(*pHandle, &channelConfSPI);
+    return TRACE_CALL("SPI", 0, SPI_InitChannel, *pHandle, &channelConfSPI);
 }
 
 
 FT_STATUS spi_driver_setCS(FT_HANDLE ftHandle, spi_chip_select_t chipSelect){
+    FT_STATUS ftStatus;
     DWORD configOptions = SPI_CONFIG_OPTION_MODE0 | SPI_CONFIG_OPTION_CS_ACTIVELOW | chipSelect;
-    return SPI_ChangeCS(ftHandle, configOptions);
+    // the raw engine drives the pin inside every transaction
+    if (engine == SPI_ENGINE_LIBMPSSE)
+        RETURN_IF_ERROR(TRACE_CALL("SPI", 0, SPI_ChangeCS, ftHandle, configOptions));
+    chip_select = chipSelect;
+    return FT_OK;
 }
 
 
 FT_STATUS spi_driver_write(FT_HANDLE ftHandle, uint8_t *tx_buff, uint32_t numBytes){
     DWORD bytesTransferred;
-    RETURN_IF_ERROR(SPI_Write(ftHandle, tx_buff, numBytes, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES |
+    if (engine == SPI_ENGINE_RAW){
+        const SpiSegment write[] = {SPI_WRITE(tx_buff, numBytes)};
+        const SpiWindow window = {write, 1};
+        return spi_driver_transaction(ftHandle, &raw_arena, &window, 1);
+    }
+    RETURN_IF_ERROR(TRACE_CALL("SPI", numBytes, SPI_Write, ftHandle, tx_buff, numBytes, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES |
                                                             SPI_TRANSFER_OPTIONS_CHIPSELECT_ENABLE |
                                                             SPI_TRANSFER_OPTIONS_CHIPSELECT_DISABLE));
     if (bytesTransferred != numBytes) 
@@ -38,19 +153,171 @@ FT_STATUS spi_driver_write(FT_HANDLE ftHandle, uint8_t *tx_buff, uint32_t numByt
 
 FT_STATUS spi_driver_transfer(FT_HANDLE ftHandle, uint8_t *tx_buff, uint32_t num_write, uint8_t *rx_buff, uint32_t num_read){
     DWORD bytesTransferred;
-    
+    if (engine == SPI_ENGINE_RAW){
+        const SpiSegment transfer[] = {SPI_WRITE(tx_buff, num_write), SPI_READ(rx_buff, num_read)};
+        const SpiWindow window = {transfer, 2};
+        return spi_driver_transaction(ftHandle, &raw_arena, &window, 1);
+    }
 
-    RETURN_IF_ERROR(SPI_Write(ftHandle, tx_buff, num_write, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES | SPI_TRANSFER_OPTIONS_CHIPSELECT_ENABLE));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", num_write, SPI_Write, ftHandle, tx_buff, num_write, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES | SPI_TRANSFER_OPTIONS_CHIPSELECT_ENABLE));
     if (bytesTransferred != num_write) 
         return FT_OTHER_ERROR;
     
     bytesTransferred = 0;
-    RETURN_IF_ERROR(SPI_Read(ftHandle, rx_buff, num_read, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES | SPI_TRANSFER_OPTIONS_CHIPSELECT_DISABLE));
+    RETURN_IF_ERROR(TRACE_CALL("SPI", num_read, SPI_Read, ftHandle, rx_buff, num_read, &bytesTransferred, SPI_TRANSFER_OPTIONS_SIZE_IN_BYTES | SPI_TRANSFER_OPTIONS_CHIPSELECT_DISABLE));
     if (bytesTransferred != num_read) 
         return FT_OTHER_ERROR;
     return FT_OK;
 }
 
+static uint8_t *mpsse_pins(uint8_t *p, uint8_t value){
+    for (int i = 0; i < SPI_CS_EDGE_REPEAT; i++){
+        *p++ = MPSSE_SET_LOW;
+        *p++ = value;
+        *p++ = SPI_PIN_DIR;
+    }
+    return p;
+}
+
+// clock command for len bytes, the length field holds len - 1
+static uint8_t *mpsse_clock(uint8_t *p, uint8_t opcode, uint32_t len){
+    *p++ = opcode;
+    *p++ = (uint8_t)((len - 1) & 0xFF);
+    *p++ = (uint8_t)((len - 1) >> 8);
+    return p;
+}
+
+size_t spi_driver_compile_len(const SpiWindow *windows, uint32_t window_count, uint32_t *read_len){
+    size_t cmd_len = 1;
+    uint32_t reads = 0;
+    for (uint32_t w = 0; w < window_count; w++){
+        cmd_len += 2 * 3 * SPI_CS_EDGE_REPEAT;
+        for (uint32_t s = 0; s < windows[w].count; s++){
+            const SpiSegment *seg = &windows[w].segments[s];
+            cmd_len += 3 * (size_t)((seg->len + MPSSE_MAX_CHUNK - 1) / MPSSE_MAX_CHUNK);
+            if (seg->type == SPI_SEGMENT_WRITE)
+                cmd_len += seg->len;
+            if (seg->type == SPI_SEGMENT_READ)
+                reads += seg->len;
+        }
+    }
+    if (read_len) *read_len = reads;
+    return cmd_len;
+}
+
+size_t spi_driver_compile(spi_chip_select_t chipSelect, const SpiWindow *windows, uint32_t window_count, uint8_t *cmd){
+    uint8_t *p = cmd;
+    int reads = 0;
+    for (uint32_t w = 0; w < window_count; w++){
+        // a delay clocks with every chip select still released, the part ignores SCK meanwhile
+        int idle = windows[w].count && windows[w].segments[0].type == SPI_SEGMENT_IDLE;
+        if (!idle)
+            p = mpsse_pins(p, SPI_PIN_IDLE & ~SPI_CS_PIN(chipSelect));
+        for (uint32_t s = 0; s < windows[w].count; s++){
+            const SpiSegment *seg = &windows[w].segments[s];
+            for (uint32_t done = 0; done < seg->len; ){
+                uint32_t chunk = seg->len - done;
+                if (chunk > MPSSE_MAX_CHUNK) chunk = MPSSE_MAX_CHUNK;
+                switch (seg->type){
+                    case SPI_SEGMENT_WRITE:
+                        p = mpsse_clock(p, MPSSE_WRITE_BYTES, chunk);
+                        memcpy(p, seg->tx + done, chunk);
+                        p += chunk;
+                        break;
+                    case SPI_SEGMENT_READ:
+                        p = mpsse_clock(p, MPSSE_READ_BYTES, chunk);
+                        reads = 1;
+                        break;
+                    default:
+                        p = mpsse_clock(p, MPSSE_CLOCK_BYTES, chunk);
+                        break;
+                }
+                done += chunk;
+            }
+        }
+        if (!idle)
+            p = mpsse_pins(p, SPI_PIN_IDLE);
+    }
+    if (reads)
+        *p++ = MPSSE_SEND_IMMEDIATE;
+    return (size_t)(p - cmd);
+}
+
+int spi_driver_set_idle(uint8_t *cmd, uint32_t len){
+    // an idle segment compiled to more than one command is never shortened
+    uint32_t compiled = (uint32_t)(cmd[1] | (cmd[2] << 8)) + 1;
+    if (cmd[0] != MPSSE_CLOCK_BYTES || len == 0 || len > compiled)
+        return 0;
+    mpsse_clock(cmd, MPSSE_CLOCK_BYTES, len);
+    return 1;
+}
+
+FT_STATUS spi_driver_run(FT_HANDLE ftHandle, const uint8_t *cmd, uint32_t cmd_len, uint8_t *rx, uint32_t read_len){
+    FT_STATUS ftStatus;
+    DWORD bytesTransferred;
+    // FT_Write takes a non-const buffer but never writes to it
+    RETURN_IF_ERROR(TRACE_CALL("SPI", cmd_len, FT_Write, ftHandle, (void *)cmd, cmd_len, &bytesTransferred));
+    if (bytesTransferred != cmd_len)
+        return FT_OTHER_ERROR;
+    if (read_len == 0)
+        return FT_OK;
+    RETURN_IF_ERROR(TRACE_CALL("SPI", read_len, FT_Read, ftHandle, rx, read_len, &bytesTransferred));
+    if (bytesTransferred != read_len){
+        LOG_ERROR("spi transaction: read %lu of %lu bytes\n", (unsigned long)bytesTransferred, (unsigned long)read_len);
+        return FT_OTHER_ERROR;
+    }
+    return FT_OK;
+}
+
+FT_STATUS spi_driver_transaction(FT_HANDLE ftHandle, Arena *arena, const SpiWindow *windows, uint32_t window_count){
+    FT_STATUS ftStatus;
+    uint32_t read_len;
+    uint32_t read_segments = 0;
+    uint8_t *single_rx = NULL;
+
+    size_t cmd_len = spi_driver_compile_len(windows, window_count, &read_len);
+    for (uint32_t w = 0; w < window_count; w++){
+        for (uint32_t s = 0; s < windows[w].count; s++){
+            const SpiSegment *seg = &windows[w].segments[s];
+            if (seg->type == SPI_SEGMENT_READ && seg->len){
+                read_segments++;
+                single_rx = seg->rx;
+            }
+        }
+    }
+
+    size_t mark = arena_mark(arena);
+    uint8_t *cmd = arena_alloc(arena, cmd_len);
+    // a lone read lands in place, several are gathered and scattered afterwards
+    uint8_t *rx = (read_segments > 1) ? arena_alloc(arena, read_len) : single_rx;
+    if (!cmd || (read_len && !rx)){
+        arena_release(arena, mark);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    cmd_len = spi_driver_compile(chip_select, windows, window_count, cmd);
+    ftStatus = spi_driver_run(ftHandle, cmd, (uint32_t)cmd_len, rx, read_len);
+
+    if (ftStatus == FT_OK && read_segments > 1){
+        const uint8_t *q = rx;
+        for (uint32_t w = 0; w < window_count; w++){
+            for (uint32_t s = 0; s < windows[w].count; s++){
+                const SpiSegment *seg = &windows[w].segments[s];
+                if (seg->type != SPI_SEGMENT_READ) continue;
+                memcpy(seg->rx, q, seg->len);
+                q += seg->len;
+            }
+        }
+    }
+    arena_release(arena, mark);
+    return ftStatus;
+}
+
 FT_STATUS spi_driver_close(FT_HANDLE ftHandle){
-    return SPI_CloseChannel(ftHandle);
+    if (engine == SPI_ENGINE_RAW){
+        TRACE_CALL("SPI", 0, FT_SetBitMode, ftHandle, 0, FT_BITMODE_RESET);
+        arena_free(&raw_arena);
+        return TRACE_CALL("SPI", 0, FT_Close, ftHandle);
+    }
+    return TRACE_CALL("SPI", 0, SPI_CloseChannel, ftHandle);
 }
\ No newline at end of file
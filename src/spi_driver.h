@@ -8,6 +8,17 @@
  * All functions return an'FT_STATUS' value from the FTD2xx library.
  * Handles of type 'FT_HANDLE' are used to reference the open SPI channel.
  * 
+ * Transactions (see @ref spi_driver_transaction) bypass libMPSSE's
+ * write/read calls: a list of chip select windows, each made of write, read
+ * and dummy segments, is compiled into one MPSSE command buffer and completes
+ * in a single USB write plus a single USB read.
+ *
+ * Two engines drive the channel, chosen with @ref spi_driver_set_engine
+ * before @ref spi_driver_init. The libMPSSE engine opens it through
+ * libMPSSE and uses `SPI_Write`/`SPI_Read`. The raw engine opens it with
+ * `FT_Open`, configures the MPSSE itself and runs every call, including
+ * @ref spi_driver_write and @ref spi_driver_transfer, as a transaction.
+ *
  * @note Ensure the correct channel is initialized and passed to the write/read functions.
  * 
  * @date 2025-08-14
@@ -18,8 +29,103 @@
 #define SPI_DRIVER_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "config.h"
 #include "ftd2xx.h"
+#include "arena.h"
+
+//! SPI clock rate in Hz
+#define SPI_CLOCK_RATE 100000
+//! Chip select commands emitted per edge, stretches CS high time between windows
+#define SPI_CS_EDGE_REPEAT 4
+
+/*!
+ * @brief Command buffer bytes needed by a transaction, see @ref spi_driver_transaction.
+ *
+ * Valid for segments of at most 64 KB. A transaction with more than one read
+ * segment also needs its total read length for the receive buffer.
+ *
+ * @param write_bytes Sum of all write segment lengths
+ * @param windows Number of chip select windows
+ * @param segments Number of segments over all windows
+ */
+#define SPI_TRANSACTION_LEN(write_bytes, windows, segments) \
+    ((write_bytes) + (windows) * 2 * 3 * SPI_CS_EDGE_REPEAT + (segments) * 3 + 1 + ARENA_ALIGN)
+
+/*!
+ * @enum spi_engine_t
+ * @brief How the SPI channel is driven
+ */
+typedef enum {
+    SPI_ENGINE_LIBMPSSE, /*!< libMPSSE opens the channel, plain writes and reads go through SPI_Write/SPI_Read */
+    SPI_ENGINE_RAW       /*!< FT_Open and MPSSE opcodes written directly, one round trip per call */
+} spi_engine_t;
+
+/*!
+ * @enum spi_segment_t
+ * @brief Kind of a transaction segment
+ */
+typedef enum {
+    SPI_SEGMENT_WRITE, /*!< Clock out SpiSegment::tx */
+    SPI_SEGMENT_READ,  /*!< Clock in to SpiSegment::rx */
+    SPI_SEGMENT_DUMMY, /*!< Clock len bytes without data, e.g. Fast Read dummy cycles */
+    SPI_SEGMENT_IDLE   /*!< Clock len bytes with the chip select released, a delay. Only segment of its window */
+} spi_segment_t;
+
+/*!
+ * @struct SpiSegment
+ * @brief A contiguous run of bytes inside a chip select window
+ */
+typedef struct {
+    spi_segment_t type; /*!< Segment kind */
+    uint32_t len;       /*!< Length in bytes */
+    const uint8_t *tx;  /*!< Data to write, write segments only */
+    uint8_t *rx;        /*!< Destination of read data, read segments only */
+} SpiSegment;
+
+/*!
+ * @struct SpiWindow
+ * @brief One assertion of the selected chip select
+ */
+typedef struct {
+    const SpiSegment *segments; /*!< Segments in bus order */
+    uint32_t count;             /*!< Number of segments */
+} SpiWindow;
+
+//! @brief Write segment initializer
+#define SPI_WRITE(buf, n) {SPI_SEGMENT_WRITE, (n), (buf), NULL}
+//! @brief Read segment initializer
+#define SPI_READ(buf, n)  {SPI_SEGMENT_READ, (n), NULL, (buf)}
+//! @brief Dummy segment initializer
+#define SPI_DUMMY(n)      {SPI_SEGMENT_DUMMY, (n), NULL, NULL}
+//! @brief Idle segment initializer
+#define SPI_IDLE(n)       {SPI_SEGMENT_IDLE, (n), NULL, NULL}
+//! @brief Idle segment length that lasts at least us microseconds at @ref SPI_CLOCK_RATE
+#define SPI_IDLE_BYTES(us) ((uint32_t)(((uint64_t)(us) * SPI_CLOCK_RATE + 7999999) / 8000000))
+
+/*!
+ * @brief Selects the engine, takes effect at the next @ref spi_driver_init.
+ *
+ * Only change it while the channel is closed.
+ *
+ * @param[in] selected Engine to use
+ */
+void spi_driver_set_engine(spi_engine_t selected);
+
+/*!
+ * @brief Engine currently in use.
+ *
+ * @return spi_engine_t Selected engine, SPI_ENGINE_LIBMPSSE by default
+ */
+spi_engine_t spi_driver_engine(void);
+
+/*!
+ * @brief Converts an engine to its command line name.
+ *
+ * @param[in] selected Engine
+ * @return const char* "libmpsse" or "raw"
+ */
+const char *spi_engine_to_str(spi_engine_t selected);
 
 /*!
  * @brief Initializes the selected FTDI channel for SPI
@@ -61,6 +167,77 @@ FT_STATUS spi_driver_write(FT_HANDLE ftHandle, uint8_t *tx_buff, uint32_t numByt
 */
 FT_STATUS spi_driver_transfer(FT_HANDLE ftHandle, uint8_t *tx_buff, uint32_t num_write, uint8_t *rx_buff, uint32_t num_read);
 
+/*!
+ * @brief Runs chip select windows back to back in one USB round trip.
+ *
+ * Every window asserts the chip select set by @ref spi_driver_setCS, runs its
+ * segments in order and deasserts it again. The whole list is compiled into
+ * one MPSSE command buffer ending in Send Immediate, written with one FT_Write
+ * and answered by one FT_Read.
+ *
+ * **Example usage:**
+ * @code
+ * uint8_t op = 0x05, status;
+ * const SpiSegment seg[] = {SPI_WRITE(&op, 1), SPI_READ(&status, 1)};
+ * const SpiWindow win = {seg, 2};
+ * ftStatus = spi_driver_transaction(ftHandle, &arena, &win, 1);
+ * @endcode
+ *
+ * @param[in] ftHandle Handle of the SPI channel.
+ * @param[in,out] arena Scratch space of at least @ref SPI_TRANSACTION_LEN free bytes
+ * @param[in] windows Chip select windows in bus order
+ * @param[in] window_count Number of windows
+ * @return FT_STATUS Status of the operation, FT_INSUFFICIENT_RESOURCES if the arena is too small
+*/
+FT_STATUS spi_driver_transaction(FT_HANDLE ftHandle, Arena *arena, const SpiWindow *windows, uint32_t window_count);
+
+/*!
+ * @brief Command buffer length and read length of a list of windows.
+ *
+ * @param[in] windows Chip select windows in bus order
+ * @param[in] window_count Number of windows
+ * @param[out] read_len Optional, total bytes read by the windows
+ * @return size_t Upper bound of the bytes written by @ref spi_driver_compile
+*/
+size_t spi_driver_compile_len(const SpiWindow *windows, uint32_t window_count, uint32_t *read_len);
+
+/*!
+ * @brief Compiles chip select windows into an MPSSE command buffer.
+ *
+ * The buffer depends only on the windows and the chip select, so it can be
+ * built ahead of time, stored, and replayed with @ref spi_driver_run.
+ *
+ * @param[in] chipSelect Chip select asserted by every window
+ * @param[in] windows Chip select windows in bus order
+ * @param[in] window_count Number of windows
+ * @param[out] cmd Buffer of at least @ref spi_driver_compile_len bytes
+ * @return size_t Bytes written to cmd
+*/
+size_t spi_driver_compile(spi_chip_select_t chipSelect, const SpiWindow *windows, uint32_t window_count, uint8_t *cmd);
+
+/*!
+ * @brief Changes the length of a compiled idle segment in place.
+ *
+ * Lets a buffer compiled with one delay be sent with a shorter one.
+ *
+ * @param[in,out] cmd Clock command of the idle segment within a buffer from @ref spi_driver_compile
+ * @param[in] len New idle length in bytes, from 1 up to the compiled length
+ * @return int 1 on success, 0 if cmd is not a single idle clock command or len is out of range
+*/
+int spi_driver_set_idle(uint8_t *cmd, uint32_t len);
+
+/*!
+ * @brief Sends a compiled command buffer and reads its answer, one USB round trip.
+ *
+ * @param[in] ftHandle Handle of the SPI channel.
+ * @param[in] cmd Buffer from @ref spi_driver_compile
+ * @param[in] cmd_len Length of cmd
+ * @param[out] rx Read bytes of all read segments in bus order
+ * @param[in] read_len Bytes to read, 0 to only write
+ * @return FT_STATUS Status of the operation
+*/
+FT_STATUS spi_driver_run(FT_HANDLE ftHandle, const uint8_t *cmd, uint32_t cmd_len, uint8_t *rx, uint32_t read_len);
+
 /*!
  * @brief Handles clean closing of SPI port
  *
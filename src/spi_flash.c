@@ -1,126 +1,635 @@
 #include <stdio.h>
+#include <string.h>
 #include "spi_flash.h"
 #include "utils.h"
+#include "platform.h"
+#include "flash_timing.h"
 
-#define FLASH_MAX_BUFF_LEN  256
 #define FLASH_OP_LEN        1
-#define FLASH_ADDR_LEN      3
 
-#define FLASH_OP_PAGE_WRITE     0x02
-#define FLASH_OP_CHIP_ERASE     0x60
-#define FLASH_OP_WRITE_EN       0x06
-#define FLASH_OP_WRITE_DI       0x04
-#define FLASH_OP_READ_STATUS    0x05
+#define FLASH_OP_READ_ID    0x9F
+#define FLASH_ID_LEN        3
 
-#define FLASH_STATUS_BUSY       0x01
-#define FLASH_STATUS_WE         0x02
-#define FLASH_STATUS_SUCCESS    0x40
+// busy polling gives up after twice the datasheet maximum plus USB latency
+#define FLASH_TIMEOUT_FACTOR    2
+#define FLASH_TIMEOUT_SLACK_MS  100
 
+// with a timing model the first poll waits for 90% of the 10th percentile, later polls come every 1/32 of the median
+#define FLASH_POLL_LEAD_PCT     90
+#define FLASH_POLL_STEPS        32
+#define FLASH_POLL_MAX_US       10000
+// batched pages get the slowest recent program time plus a quarter and a step, rounded up to steps
+#define FLASH_DELAY_STEP_US     250
 
-FT_STATUS flash_write_enable(FT_HANDLE ftHandle){
+// time of one byte on the SPI bus
+#define FLASH_BYTE_US (8000000 / SPI_CLOCK_RATE)
+
+// control transfers move a few bytes, their command buffer lives on the stack
+#define FLASH_CTRL_LEN SPI_TRANSACTION_LEN(FLASH_OP_LEN + FLASH_MAX_ADDR_LEN, 2, 4)
+
+#if defined(_MSC_VER)
+#define FLASH_ALWAYS_INLINE __forceinline
+#else
+#define FLASH_ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
+
+//! Shortest status read round trip seen, less its clocking: the USB latency out and back
+static uint32_t usb_round_trip_us;
+static int usb_round_trip_known;
+
+
+// a status read clocks two bytes, the rest of its round trip is USB latency
+static void flash_note_round_trip(uint64_t elapsed_us){
+    uint32_t rtt = elapsed_us > 2 * FLASH_BYTE_US ? (uint32_t)(elapsed_us - 2 * FLASH_BYTE_US) : 0;
+    if (!usb_round_trip_known || rtt < usb_round_trip_us){
+        usb_round_trip_us = rtt;
+        usb_round_trip_known = 1;
+    }
+}
+
+/*
+ * Time an operation started whose command was sent at sent_us and whose
+ * reply arrived at done_us: the chip select rose tail_bytes before the end
+ * of the command, and the reply took the one-way USB latency to come back.
+ */
+static uint64_t flash_started_us(uint64_t sent_us, uint64_t done_us, uint32_t tail_bytes){
+    uint64_t back = usb_round_trip_us / 2 + (uint64_t)tail_bytes * FLASH_BYTE_US;
+    uint64_t start_us = done_us > back ? done_us - back : 0;
+    return start_us > sent_us ? start_us : sent_us;
+}
+
+// time a command without reply started its operation: sending returns at once, the bytes then travel and are clocked out
+static uint64_t flash_written_us(uint64_t sent_us, uint32_t bytes){
+    return sent_us + usb_round_trip_us / 2 + (uint64_t)bytes * FLASH_BYTE_US;
+}
+
+static void flash_put_addr(uint8_t *buffer, uint32_t address, uint32_t addr_len){
+    for (uint32_t i = 0; i < addr_len; i++){
+        buffer[i] = (uint8_t)(address >> (8 * (addr_len - 1 - i)));
+    }
+}
+
+static FT_STATUS flash_transaction(FT_HANDLE ftHandle, const SpiWindow *windows, uint32_t count){
+    uint8_t scratch[FLASH_CTRL_LEN];
+    Arena arena;
+    arena_wrap(&arena, scratch, sizeof(scratch));
+    return spi_driver_transaction(ftHandle, &arena, windows, count);
+}
+
+// sends a single opcode and reads the status register back in the same round trip
+static FT_STATUS flash_command_status(FT_HANDLE ftHandle, const FlashPart *part, uint8_t opcode, uint8_t *status){
     FT_STATUS ftStatus;
-    uint8_t buffer = FLASH_OP_WRITE_EN;
-    RETURN_IF_ERROR(spi_driver_write(ftHandle, &buffer, 1));
-    // verify enable is set
-    uint8_t status_reg;
-    ftStatus = flash_get_status(ftHandle, &status_reg);
-    if (ftStatus != FT_OK) return ftStatus;
-    if ((status_reg & FLASH_STATUS_WE) != 0) 
-        return FT_OK;
-    return FT_OTHER_ERROR;
+    uint8_t ops[2] = {opcode, part->op_read_status};
+    const SpiSegment command[] = {SPI_WRITE(&ops[0], 1)};
+    const SpiSegment read_status[] = {SPI_WRITE(&ops[1], 1), SPI_READ(status, 1)};
+    const SpiWindow windows[] = {{command, 1}, {read_status, 2}};
+    *status = 0;
+    RETURN_IF_ERROR(flash_transaction(ftHandle, windows, 2));
+    if (*status == 0xFF) return FT_EEPROM_NOT_PRESENT;
+    return FT_OK;
 }
 
-FT_STATUS flash_write_disable(FT_HANDLE ftHandle){
+/*
+ * Polls the status register until BUSY clears or the timeout expires. op
+ * names the timing model of the operation started at start_us: with enough
+ * recorded times the first poll is held back until just before the fastest
+ * of them and later polls are spaced finely, without a model the polls go
+ * back to back. The time of the first ready poll is recorded. op NULL polls
+ * back to back and records nothing.
+ */
+static FT_STATUS flash_wait_ready(FT_HANDLE ftHandle, const FlashPart *part, const char *op, uint32_t max_ms,
+                                  uint64_t start_us, uint8_t *status_reg){
     FT_STATUS ftStatus;
-    uint8_t buffer = FLASH_OP_WRITE_DI;
-    RETURN_IF_ERROR(spi_driver_write(ftHandle, &buffer, 1));
-    uint8_t status_reg;
-    ftStatus = flash_get_status(ftHandle, &status_reg);
-    if (ftStatus != FT_OK) return ftStatus;
-    if ((status_reg & FLASH_STATUS_WE) == 0) 
-        return FT_OK;
-    return FT_OTHER_ERROR;
+    FlashTimingEstimate est;
+    uint32_t interval_us = 0;
+    uint64_t deadline = start_us + ((uint64_t)max_ms * FLASH_TIMEOUT_FACTOR + FLASH_TIMEOUT_SLACK_MS) * 1000;
+
+    if (op && flash_timing_estimate(part->name, op, &est)){
+        uint64_t first_poll = start_us + (uint64_t)est.p10_us * FLASH_POLL_LEAD_PCT / 100;
+        uint64_t now = platform_time_us();
+        if (first_poll > now)
+            platform_sleep_until(deadline, (uint32_t)(first_poll - now));
+        interval_us = est.p50_us / FLASH_POLL_STEPS;
+        if (interval_us > FLASH_POLL_MAX_US) interval_us = FLASH_POLL_MAX_US;
+    }
+    for (;;){
+        uint64_t poll_us = platform_time_us();
+        ftStatus = flash_get_status(ftHandle, part, status_reg);
+        if (ftStatus != FT_OK) return ftStatus;
+        flash_note_round_trip(platform_time_us() - poll_us);
+        if ((*status_reg & part->status_busy) == 0){
+            // the status was read one-way latency and an opcode after the poll was sent
+            uint64_t read_us = poll_us + usb_round_trip_us / 2 + FLASH_BYTE_US;
+            if (op) flash_timing_record(part->name, op, read_us > start_us ? (uint32_t)(read_us - start_us) : 0);
+            return FT_OK;
+        }
+        if (platform_deadline_passed(deadline)){
+            LOG_ERROR("%s busy for more than %u ms, status 0x%02X\n", part->name, max_ms * FLASH_TIMEOUT_FACTOR, *status_reg);
+            return FT_OTHER_ERROR;
+        }
+        LOG_EVERY_MS(LOG_LEVEL_DEBUG, 1000, "%s busy, status 0x%02X\n", part->name, *status_reg);
+        if (interval_us)
+            platform_sleep_until(deadline, interval_us);
+    }
 }
 
-FT_STATUS flash_chip_erase(FT_HANDLE ftHandle){
-    uint8_t buffer = FLASH_OP_CHIP_ERASE;
-    FT_STATUS ftStatus = spi_driver_write(ftHandle, &buffer, 1);
-    if (ftStatus != FT_OK) return FT_EEPROM_ERASE_FAILED;
-    
+static FT_STATUS flash_wait_erased(FT_HANDLE ftHandle, const FlashPart *part, const char *op, uint32_t max_ms, uint64_t start_us){
     uint8_t status_reg;
-    do {
-        ftStatus = flash_get_status(ftHandle, &status_reg);
-        if (ftStatus != FT_OK) return FT_EEPROM_ERASE_FAILED;
-        printf("\rErasing flash...  flash busy");
-    } while((status_reg & FLASH_STATUS_BUSY == 1));
-    
-    if (flash_success(ftHandle)){
-        printf("\rErasing flash...  ");
+    if (flash_wait_ready(ftHandle, part, op, max_ms, start_us, &status_reg) != FT_OK)
+        return FT_EEPROM_ERASE_FAILED;
+    if (status_reg & part->status_error){
+        LOG_ERROR("%s erase error, status 0x%02X\n", part->name, status_reg);
+        return FT_EEPROM_ERASE_FAILED;
+    }
+    return FT_OK;
+}
+
+// finishes a page program sent at start_us given the status read right after it
+static FT_STATUS flash_page_done(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint64_t start_us, uint8_t status_reg){
+    FT_STATUS ftStatus;
+    if (status_reg & part->status_busy){
+        ftStatus = flash_wait_ready(ftHandle, part, FLASH_TIMING_PROGRAM, part->program_max_ms, start_us, &status_reg);
+        if (ftStatus != FT_OK) return ftStatus;
+    }
+
+    if ((status_reg & part->status_error) == 0) // success
         return FT_OK;
+    LOG_ERROR("flash EPE bit set while programming page at 0x%06X\n", address);
+    return FT_EEPROM_WRITE_FAILED;
+}
+
+// finishes a page sent without its delay and closing status read, given the status read after its write enable
+static FT_STATUS flash_page_polled(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint64_t start_us, uint8_t enabled){
+    if ((enabled & part->status_wel) == 0 || (enabled & part->status_busy)){
+        LOG_ERROR("flash write enable not set while programming page at 0x%06X, status 0x%02X\n", address, enabled);
+        return FT_OTHER_ERROR;
+    }
+    // nothing is known about the program yet, poll it as if busy
+    return flash_page_done(ftHandle, part, address, start_us, part->status_busy);
+}
+
+/*
+ * Windows of a batched page: write enable, status, page program, program time
+ * delay, status. The first three alone are a page that is polled instead.
+ * The write enable, status opcode and header buffers and the status
+ * destination, NULL when compiling, must outlive the windows.
+ */
+static inline void flash_page_windows(const FlashPart *part, uint32_t address, const uint8_t *data, uint32_t data_length,
+                                      uint32_t addr_len, uint32_t delay_us, const uint8_t *ops, uint8_t *header,
+                                      uint8_t *status, SpiSegment *segments, SpiWindow *windows){
+    header[0] = part->op_program;
+    flash_put_addr(header + FLASH_OP_LEN, address, addr_len);
+
+    segments[0] = (SpiSegment)SPI_WRITE(&ops[0], 1);
+    segments[1] = (SpiSegment)SPI_WRITE(&ops[1], 1);
+    segments[2] = (SpiSegment)SPI_READ(status, 1);
+    segments[3] = (SpiSegment)SPI_WRITE(header, FLASH_OP_LEN + addr_len);
+    segments[4] = (SpiSegment)SPI_WRITE(data, data_length);
+    segments[5] = (SpiSegment)SPI_IDLE(SPI_IDLE_BYTES(delay_us));
+    segments[6] = (SpiSegment)SPI_WRITE(&ops[1], 1);
+    segments[7] = (SpiSegment)SPI_READ(status ? status + 1 : NULL, 1);
+    windows[0] = (SpiWindow){&segments[0], 1};
+    windows[1] = (SpiWindow){&segments[1], 2};
+    windows[2] = (SpiWindow){&segments[3], 2};
+    windows[3] = (SpiWindow){&segments[5], 1};
+    windows[4] = (SpiWindow){&segments[6], 2};
+}
+
+// checks the two status bytes of every page of a batch, completed counts the pages before the first failure, see flash_run_batch
+static FT_STATUS flash_batch_check(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint8_t *status, uint32_t pages,
+                                   uint32_t *completed){
+    for (uint32_t i = 0; i < pages; i++){
+        *completed = i;
+        uint8_t *enabled = &status[i * FLASH_PAGE_READ_LEN];
+        uint8_t *done = enabled + 1;
+        // only the last page may still be programming, it is polled without recording as its start is unknown
+        if (i == pages - 1 && (*done & part->status_busy))
+            RETURN_IF_ERROR(flash_wait_ready(ftHandle, part, NULL, part->program_max_ms, platform_time_us(), done));
+
+        // a delay shorter than the program time shows as the previous page still busy, the part ignored this one
+        const char *fault = NULL;
+        if (*enabled & part->status_busy)
+            fault = "previous page not finished";
+        else if ((*enabled & part->status_wel) == 0)
+            fault = "write enable not set";
+        else if (*done & part->status_busy)
+            fault = "program not finished";
+        else if (*done & part->status_error)
+            fault = "EPE bit set";
+        if (!fault)
+            continue;
+        // a failed batch is replayed page by page, only the page level failure is an error
+        if (pages == 1)
+            LOG_ERROR("flash %s while programming page at 0x%06X, status 0x%02X 0x%02X\n", fault, address, *enabled, *done);
+        else
+            LOG_DEBUG("flash %s on page %u of batch at 0x%06X\n", fault, i, address);
+        // the replay must not start while the last page of the batch is still programming
+        uint8_t *last = &status[(pages - 1) * FLASH_PAGE_READ_LEN + 1];
+        if (i < pages - 1 && (*last & part->status_busy))
+            RETURN_IF_ERROR(flash_wait_ready(ftHandle, part, NULL, part->program_max_ms, platform_time_us(), last));
+        return (*done & part->status_error) ? FT_EEPROM_WRITE_FAILED : FT_OTHER_ERROR;
+    }
+    *completed = pages;
+    return FT_OK;
+}
+
+/*
+ * Page program and read bodies shared by the generic functions and the
+ * specialised loops. Inlined with constant page size and address length,
+ * the compiler folds the address encoding and page arithmetic per part.
+ * The page program header and data are gathered by the SPI transaction,
+ * which also reads the status register once right after the program.
+ */
+static FLASH_ALWAYS_INLINE FT_STATUS flash_page_program(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address,
+                                                        const uint8_t *data, uint32_t data_length, uint32_t addr_len){
+    FT_STATUS ftStatus;
+    // header = opcode + address
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    uint8_t op_status = part->op_read_status;
+    uint8_t status_reg = 0;
+    header[0] = part->op_program;
+    flash_put_addr(header + FLASH_OP_LEN, address, addr_len);
+
+    const SpiSegment program[] = {SPI_WRITE(header, FLASH_OP_LEN + addr_len), SPI_WRITE(data, data_length)};
+    const SpiSegment read_status[] = {SPI_WRITE(&op_status, 1), SPI_READ(&status_reg, 1)};
+    const SpiWindow windows[] = {{program, 2}, {read_status, 2}};
+    uint64_t sent_us = platform_time_us();
+    RETURN_IF_ERROR(spi_driver_transaction(ftHandle, arena, windows, 2));
+    // the status read follows the program
+    return flash_page_done(ftHandle, part, address, flash_started_us(sent_us, platform_time_us(), 2), status_reg);
+}
+
+static FLASH_ALWAYS_INLINE FT_STATUS flash_read_cmd(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address,
+                                                    uint8_t *data, uint32_t data_length, uint32_t addr_len){
+    // header = opcode + address
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    header[0] = part->op_read;
+    flash_put_addr(header + FLASH_OP_LEN, address, addr_len);
+    const SpiSegment read[] = {SPI_WRITE(header, FLASH_OP_LEN + addr_len), SPI_READ(data, data_length)};
+    const SpiWindow window = {read, 2};
+    return flash_transaction(ftHandle, &window, 1);
+}
+
+static FLASH_ALWAYS_INLINE FT_STATUS flash_fast_read_cmd(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address,
+                                                         uint8_t *data, uint32_t data_length, uint32_t addr_len){
+    // header = opcode + address, then 8 dummy clocks
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    header[0] = part->op_fast_read;
+    flash_put_addr(header + FLASH_OP_LEN, address, addr_len);
+    const SpiSegment read[] = {SPI_WRITE(header, FLASH_OP_LEN + addr_len), SPI_DUMMY(1), SPI_READ(data, data_length)};
+    const SpiWindow window = {read, 3};
+    return flash_transaction(ftHandle, &window, 1);
+}
+
+static FLASH_ALWAYS_INLINE FT_STATUS flash_program_loop(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address,
+                                                        const uint8_t *data, uint32_t length,
+                                                        uint32_t page_size, uint32_t addr_len){
+    FT_STATUS ftStatus = FT_OK;
+    const uint8_t ops[2] = {part->op_write_en, part->op_read_status};
+    uint8_t headers[FLASH_BATCH_PAGES][FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    uint8_t status_regs[FLASH_BATCH_PAGES * FLASH_PAGE_READ_LEN];
+    uint32_t addresses[FLASH_BATCH_PAGES];
+    SpiSegment segments[FLASH_BATCH_PAGES][8];
+    SpiWindow windows[FLASH_BATCH_PAGES][5];
+    uint32_t delay_us = flash_program_delay_us(part);
+
+    if (address > part->capacity || length > part->capacity - address)
+        return FT_INVALID_PARAMETER;
+    while (length > 0){
+        // WEL is cleared by the flash after every page program, every page brings its own write enable
+        uint32_t pages = 0;
+        while (length > 0 && pages < FLASH_BATCH_PAGES){
+            // limit write length to smaller of data or space left on the page
+            uint32_t space_left = page_size - (address % page_size);
+            uint32_t chunk_length = (length <= space_left) ? length : space_left;
+            flash_page_windows(part, address, data, chunk_length, addr_len, delay_us, ops, headers[pages],
+                               &status_regs[pages * FLASH_PAGE_READ_LEN], segments[pages], windows[pages]);
+            addresses[pages++] = address;
+            address += chunk_length;
+            data += chunk_length;
+            length -= chunk_length;
+        }
+
+        // a lone page is polled rather than given the delay, which also teaches the timing model
+        uint32_t completed = 0;
+        if (pages > 1){
+            ftStatus = spi_driver_transaction(ftHandle, arena, windows[0], pages * 5);
+            if (ftStatus == FT_OK)
+                ftStatus = flash_batch_check(ftHandle, part, addresses[0], status_regs, pages, &completed);
+            if (ftStatus == FT_OK) continue;
+            // replay with a round trip and full checks per page from the one that failed
+            LOG_WARN("flash batch at 0x%06X failed at 0x%06X, replaying page by page\n", addresses[0], addresses[completed]);
+        }
+        for (uint32_t i = completed; i < pages; i++){
+            uint64_t sent_us = platform_time_us();
+            RETURN_IF_ERROR(spi_driver_transaction(ftHandle, arena, windows[i], 3));
+            RETURN_IF_ERROR(flash_page_polled(ftHandle, part, addresses[i], flash_started_us(sent_us, platform_time_us(), 0),
+                                              status_regs[i * FLASH_PAGE_READ_LEN]));
+        }
+    }
+    return ftStatus;
+}
+
+static FLASH_ALWAYS_INLINE FT_STATUS flash_verify_loop(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address,
+                                                       const uint8_t *data, uint32_t length, uint32_t addr_len){
+    FT_STATUS ftStatus = FT_OK;
+    // reads go in FLASH_VERIFY_BLOCK chunks, with Fast Read when the part has it and the data is longer than a page
+    // as its dummy byte only pays off then
+    int fast = length > part->page_size && flash_read_mode(part) != FLASH_READ_ARRAY;
+    size_t mark = arena_mark(arena);
+    uint8_t *buffer = arena_alloc(arena, FLASH_VERIFY_BLOCK);
+    if (!buffer) return FT_INSUFFICIENT_RESOURCES;
+
+    while (length > 0){
+        uint32_t chunk_length = (length <= FLASH_VERIFY_BLOCK) ? length : FLASH_VERIFY_BLOCK;
+
+        if (fast)
+            ftStatus = flash_fast_read_cmd(ftHandle, part, address, buffer, chunk_length, addr_len);
+        else
+            ftStatus = flash_read_cmd(ftHandle, part, address, buffer, chunk_length, addr_len);
+        if (ftStatus != FT_OK) break;
+        if (memcmp(buffer, data, chunk_length) != 0){
+            uint32_t i = 0;
+            while (buffer[i] == data[i]) i++;
+            LOG_ERROR("flash verify mismatch at address 0x%06X\n", address + i);
+            ftStatus = FT_FAILED_TO_WRITE_DEVICE;
+            break;
+        }
+
+        address += chunk_length;
+        data += chunk_length;
+        length -= chunk_length;
+    }
+    arena_release(arena, mark);
+    return ftStatus;
+}
+
+//! Instantiates the program and verify loops for one page size and address length
+#define FLASH_SPECIALISE(tag, page_size, addr_len)                                                            \
+    static FT_STATUS flash_program_##tag(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena,              \
+                                         uint32_t address, const uint8_t *data, uint32_t length){              \
+        return flash_program_loop(ftHandle, part, arena, address, data, length, page_size, addr_len);          \
+    }                                                                                                          \
+    static FT_STATUS flash_verify_##tag(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena,               \
+                                        uint32_t address, const uint8_t *data, uint32_t length){               \
+        return flash_verify_loop(ftHandle, part, arena, address, data, length, addr_len);                      \
     }
-    return FT_EEPROM_ERASE_FAILED;
+
+FLASH_SPECIALISE(p256_a3, 256, 3)
+
+/*
+ * Supported parts, the first entry is the default for unknown IDs.
+ * Timings are datasheet maximums. Adding a part with a new page size or
+ * address length needs a matching FLASH_SPECIALISE line above.
+ */
+static const FlashPart flash_parts[] = {
+    {
+        .name = "AT25DF512C", .jedec_id = 0x1F6501, .capacity = 0x10000,
+        .page_size = 256, .addr_len = 3,
+        .op_read = 0x03, .op_fast_read = 0x0B,
+        .op_program = 0x02, .op_write_en = 0x06, .op_write_di = 0x04, .op_read_status = 0x05, .op_chip_erase = 0x60,
+        .erase = {{0x1000, 0x20, 200}, {0x8000, 0x52, 600}, {0, 0, 0}},
+        .status_busy = 0x01, .status_wel = 0x02, .status_error = 0x20,
+        .program_max_ms = 3, .chip_erase_max_ms = 1000,
+        .program = flash_program_p256_a3, .verify = flash_verify_p256_a3,
+    },
+    {
+        .name = "W25Q32JV", .jedec_id = 0xEF4016, .capacity = 0x400000,
+        .page_size = 256, .addr_len = 3,
+        .op_read = 0x03, .op_fast_read = 0x0B,
+        .op_program = 0x02, .op_write_en = 0x06, .op_write_di = 0x04, .op_read_status = 0x05, .op_chip_erase = 0x60,
+        .erase = {{0x1000, 0x20, 400}, {0x8000, 0x52, 1600}, {0x10000, 0xD8, 2000}},
+        .status_busy = 0x01, .status_wel = 0x02, .status_error = 0x00,
+        .program_max_ms = 3, .chip_erase_max_ms = 50000,
+        .program = flash_program_p256_a3, .verify = flash_verify_p256_a3,
+    },
+    {
+        .name = "W25Q128JV", .jedec_id = 0xEF4018, .capacity = 0x1000000,
+        .page_size = 256, .addr_len = 3,
+        .op_read = 0x03, .op_fast_read = 0x0B,
+        .op_program = 0x02, .op_write_en = 0x06, .op_write_di = 0x04, .op_read_status = 0x05, .op_chip_erase = 0x60,
+        .erase = {{0x1000, 0x20, 400}, {0x8000, 0x52, 1600}, {0x10000, 0xD8, 2000}},
+        .status_busy = 0x01, .status_wel = 0x02, .status_error = 0x00,
+        .program_max_ms = 3, .chip_erase_max_ms = 200000,
+        .program = flash_program_p256_a3, .verify = flash_verify_p256_a3,
+    },
+    {
+        .name = "MX25L12835F", .jedec_id = 0xC22018, .capacity = 0x1000000,
+        .page_size = 256, .addr_len = 3,
+        .op_read = 0x03, .op_fast_read = 0x0B,
+        .op_program = 0x02, .op_write_en = 0x06, .op_write_di = 0x04, .op_read_status = 0x05, .op_chip_erase = 0x60,
+        .erase = {{0x1000, 0x20, 400}, {0x8000, 0x52, 1000}, {0x10000, 0xD8, 2000}},
+        .status_busy = 0x01, .status_wel = 0x02, .status_error = 0x00,
+        .program_max_ms = 3, .chip_erase_max_ms = 150000,
+        .program = flash_program_p256_a3, .verify = flash_verify_p256_a3,
+    },
+};
+
+
+uint32_t flash_program_delay_us(const FlashPart *part){
+    FlashTimingEstimate est;
+    uint32_t max_us = part->program_max_ms * 1000;
+    if (!flash_timing_estimate(part->name, FLASH_TIMING_PROGRAM, &est))
+        return max_us;
+    uint32_t delay_us = est.max_us + est.max_us / 4 + FLASH_DELAY_STEP_US;
+    delay_us = (delay_us + FLASH_DELAY_STEP_US - 1) / FLASH_DELAY_STEP_US * FLASH_DELAY_STEP_US;
+    return delay_us < max_us ? delay_us : max_us;
+}
+
+size_t flash_compile_page_len(const FlashPart *part, uint32_t data_length, uint32_t delay_us){
+    const uint8_t ops[2] = {part->op_write_en, part->op_read_status};
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    SpiSegment segments[8];
+    SpiWindow windows[5];
+    flash_page_windows(part, 0, NULL, data_length, part->addr_len, delay_us, ops, header, NULL, segments, windows);
+    return spi_driver_compile_len(windows, 3, NULL) + spi_driver_compile_len(windows + 3, 2, NULL);
+}
+
+size_t flash_compile_page(const FlashPart *part, spi_chip_select_t chipSelect, uint32_t address, const uint8_t *data,
+                          uint32_t data_length, uint32_t delay_us, uint8_t *cmd, uint32_t *poll_len){
+    const uint8_t ops[2] = {part->op_write_en, part->op_read_status};
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    SpiSegment segments[8];
+    SpiWindow windows[5];
+    flash_page_windows(part, address, data, data_length, part->addr_len, delay_us, ops, header, NULL, segments, windows);
+    // compiled in two parts, the first ends in its own flush and can be sent alone to poll the page
+    size_t len = spi_driver_compile(chipSelect, windows, 3, cmd);
+    *poll_len = (uint32_t)len;
+    return len + spi_driver_compile(chipSelect, windows + 3, 2, cmd + len);
+}
+
+int flash_page_set_delay(uint8_t *cmd, uint32_t poll_len, uint32_t delay_us){
+    // the idle window is the first of the second part, see flash_compile_page
+    uint32_t idle = SPI_IDLE_BYTES(delay_us);
+    return spi_driver_set_idle(cmd + poll_len, idle ? idle : 1);
+}
+
+FT_STATUS flash_run_batch(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, const uint8_t *cmd, uint32_t cmd_len,
+                          uint32_t pages, uint32_t *done){
+    FT_STATUS ftStatus;
+    uint8_t status_regs[FLASH_BATCH_PAGES * FLASH_PAGE_READ_LEN];
+    *done = 0;
+    if (pages == 0 || pages > FLASH_BATCH_PAGES)
+        return FT_INVALID_PARAMETER;
+    RETURN_IF_ERROR(spi_driver_run(ftHandle, cmd, cmd_len, status_regs, pages * FLASH_PAGE_READ_LEN));
+    return flash_batch_check(ftHandle, part, address, status_regs, pages, done);
 }
 
-FT_STATUS flash_write_page(FT_HANDLE ftHandle, uint32_t address, const uint8_t *data, uint8_t data_length){
+FT_STATUS flash_run_polled(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, const uint8_t *cmd, uint32_t poll_len){
     FT_STATUS ftStatus;
-    size_t length = FLASH_OP_LEN + FLASH_ADDR_LEN + data_length; // 2=opcode, 6=address, Max255=data_legnth
-    // buffer = opcode + address + data chunk
-    uint8_t buffer[FLASH_MAX_BUFF_LEN];
-    buffer[0] = FLASH_OP_PAGE_WRITE;
-    // Address
-    for (int i = 0; i < FLASH_ADDR_LEN; i++){
-        buffer[FLASH_OP_LEN + i] = (uint8_t)(address >> (16-8*i));
+    uint8_t enabled;
+    uint64_t sent_us = platform_time_us();
+    RETURN_IF_ERROR(spi_driver_run(ftHandle, cmd, poll_len, &enabled, 1));
+    // the page program is the last window of the command
+    return flash_page_polled(ftHandle, part, address, flash_started_us(sent_us, platform_time_us(), 0), enabled);
+}
+
+flash_read_mode_t flash_read_mode(const FlashPart *part){
+    return part->op_fast_read ? FLASH_READ_FAST : FLASH_READ_ARRAY;
+}
+
+FT_STATUS flash_read_jedec_id(FT_HANDLE ftHandle, uint32_t *jedec_id){
+    uint8_t op = FLASH_OP_READ_ID;
+    uint8_t rx_buff[FLASH_ID_LEN] = {0, 0, 0};
+    const SpiSegment read_id[] = {SPI_WRITE(&op, 1), SPI_READ(rx_buff, FLASH_ID_LEN)};
+    const SpiWindow window = {read_id, 2};
+    FT_STATUS ftStatus = flash_transaction(ftHandle, &window, 1);
+    *jedec_id = ((uint32_t)rx_buff[0] << 16) | ((uint32_t)rx_buff[1] << 8) | rx_buff[2];
+    return ftStatus;
+}
+
+const FlashPart *flash_part_find(uint32_t jedec_id){
+    for (size_t i = 0; i < sizeof(flash_parts) / sizeof(flash_parts[0]); i++){
+        if (flash_parts[i].jedec_id == jedec_id)
+            return &flash_parts[i];
     }
-    // data
-    memcpy(buffer + FLASH_OP_LEN + FLASH_ADDR_LEN, data, data_length);
-    
-    // remove to 
-    RETURN_IF_ERROR(spi_driver_write(ftHandle, buffer, length));
+    return NULL;
+}
+
+const FlashPart *flash_part_default(void){
+    return &flash_parts[0];
+}
+
+FT_STATUS flash_detect(FT_HANDLE ftHandle, const FlashPart **part){
+    uint32_t jedec_id;
+    RETURN_IF_ERROR(flash_read_jedec_id(ftHandle, &jedec_id));
+    // floating or grounded MISO, no chip on this select
+    if (jedec_id == 0xFFFFFF || jedec_id == 0x000000)
+        return FT_EEPROM_NOT_PRESENT;
+
+    *part = flash_part_find(jedec_id);
+    if (!*part){
+        *part = flash_part_default();
+        LOG_WARN("unknown flash JEDEC ID 0x%06X, using %s\n", jedec_id, (*part)->name);
+    } else {
+        LOG_DEBUG("detected flash %s (JEDEC ID 0x%06X)\n", (*part)->name, jedec_id);
+    }
+    return FT_OK;
+}
+
+FT_STATUS flash_write_enable(FT_HANDLE ftHandle, const FlashPart *part){
+    FT_STATUS ftStatus;
+    // verify enable is set
     uint8_t status_reg;
-    do {
-        ftStatus = flash_get_status(ftHandle, &status_reg);
-    } while((status_reg & 0x01) == 1); // isBusy
+    RETURN_IF_ERROR(flash_command_status(ftHandle, part, part->op_write_en, &status_reg));
+    if ((status_reg & part->status_wel) != 0)
+        return FT_OK;
+    return FT_OTHER_ERROR;
+}
 
-    if ((status_reg & 0x40) == 0) // success
+FT_STATUS flash_write_disable(FT_HANDLE ftHandle, const FlashPart *part){
+    FT_STATUS ftStatus;
+    uint8_t status_reg;
+    RETURN_IF_ERROR(flash_command_status(ftHandle, part, part->op_write_di, &status_reg));
+    if ((status_reg & part->status_wel) == 0)
         return FT_OK;
-    else {
-        printf("Flash chip EPE bit set: Error while programming page\n");
-        return FT_EEPROM_WRITE_FAILED;
+    return FT_OTHER_ERROR;
+}
+
+FT_STATUS flash_chip_erase(FT_HANDLE ftHandle, const FlashPart *part){
+    uint8_t op = part->op_chip_erase;
+    const SpiSegment erase[] = {SPI_WRITE(&op, 1)};
+    const SpiWindow window = {erase, 1};
+    uint64_t sent_us = platform_time_us();
+    if (flash_transaction(ftHandle, &window, 1) != FT_OK)
+        return FT_EEPROM_ERASE_FAILED;
+    return flash_wait_erased(ftHandle, part, FLASH_TIMING_CHIP_ERASE, part->chip_erase_max_ms, flash_written_us(sent_us, 1));
+}
+
+FT_STATUS flash_erase(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint32_t size){
+    const FlashErase *erase = NULL;
+    for (int i = 0; i < FLASH_ERASE_TYPES; i++){
+        if (part->erase[i].size && part->erase[i].size == size)
+            erase = &part->erase[i];
     }
+    if (!erase || address % size != 0 || address >= part->capacity)
+        return FT_INVALID_PARAMETER;
+
+    uint8_t header[FLASH_OP_LEN + FLASH_MAX_ADDR_LEN];
+    header[0] = erase->opcode;
+    flash_put_addr(header + FLASH_OP_LEN, address, part->addr_len);
+    const SpiSegment command[] = {SPI_WRITE(header, FLASH_OP_LEN + part->addr_len)};
+    const SpiWindow window = {command, 1};
+    uint64_t sent_us = platform_time_us();
+    if (flash_transaction(ftHandle, &window, 1) != FT_OK)
+        return FT_EEPROM_ERASE_FAILED;
+    uint64_t start_us = flash_written_us(sent_us, FLASH_OP_LEN + part->addr_len);
+    // every erase size has its own model
+    char op[16];
+    snprintf(op, sizeof(op), "erase_%uK", size / 1024);
+    return flash_wait_erased(ftHandle, part, op, erase->max_ms, start_us);
+}
+
+FT_STATUS flash_write_page(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint16_t data_length){
+    if (data_length > part->page_size) return FT_INVALID_PARAMETER;
+    return flash_page_program(ftHandle, part, arena, address, data, data_length, part->addr_len);
+}
+
+FT_STATUS flash_program(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length){
+    return part->program(ftHandle, part, arena, address, data, length);
+}
+
+FT_STATUS flash_verify(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length){
+    return part->verify(ftHandle, part, arena, address, data, length);
 }
 
-FT_STATUS flash_get_status(FT_HANDLE ftHandle, uint8_t *status){
+FT_STATUS flash_read(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint8_t *data, uint32_t data_length){
+    return flash_read_cmd(ftHandle, part, address, data, data_length, part->addr_len);
+}
+
+FT_STATUS flash_get_status(FT_HANDLE ftHandle, const FlashPart *part, uint8_t *status){
     FT_STATUS ftStatus;
-    uint8_t tx_buff = FLASH_OP_READ_STATUS;
-    uint8_t rx_buff[2] = {0,0};
-    ftStatus = spi_driver_transfer(ftHandle, &tx_buff, 1, rx_buff, 2);
-    *status = rx_buff[0];
+    uint8_t op = part->op_read_status;
+    const SpiSegment read_status[] = {SPI_WRITE(&op, 1), SPI_READ(status, 1)};
+    const SpiWindow window = {read_status, 2};
+    *status = 0;
+    RETURN_IF_ERROR(flash_transaction(ftHandle, &window, 1));
     if (*status == 0xff) return FT_EEPROM_NOT_PRESENT;
-    return ftStatus;
+    return FT_OK;
 }
 
-int flash_success(FT_HANDLE ftHandle){
+int flash_success(FT_HANDLE ftHandle, const FlashPart *part){
     uint8_t status;
-    flash_get_status(ftHandle, &status);
-    return (status & FLASH_STATUS_SUCCESS) == 0;
+    flash_get_status(ftHandle, part, &status);
+    return (status & part->status_error) == 0;
 }
 
-int flash_write_isEnabled(FT_HANDLE ftHandle){
+int flash_write_isEnabled(FT_HANDLE ftHandle, const FlashPart *part){
     uint8_t status;
-    flash_get_status(ftHandle, &status);
-    printf("WE STATUS: 0x%X\n",status);
-    printf("result: %d\n", status & FLASH_STATUS_WE);
-    return ((status & FLASH_STATUS_WE) == FLASH_STATUS_WE);
+    flash_get_status(ftHandle, part, &status);
+    LOG_TRACE("flash status 0x%02X, write enable %d\n", status, (status & part->status_wel) != 0);
+    return ((status & part->status_wel) == part->status_wel);
 }
 
-int flash_isBusy(FT_HANDLE ftHandle){
+int flash_isBusy(FT_HANDLE ftHandle, const FlashPart *part){
     uint8_t status;
-    flash_get_status(ftHandle, &status);
-    return ((status & FLASH_STATUS_BUSY) == FLASH_STATUS_BUSY);
+    flash_get_status(ftHandle, part, &status);
+    return ((status & part->status_busy) == part->status_busy);
 }
 
-int flash_isReady(FT_HANDLE ftHandle){
+int flash_isReady(FT_HANDLE ftHandle, const FlashPart *part){
     uint8_t status;
-    flash_get_status(ftHandle, &status);
-    return ((status & FLASH_STATUS_BUSY) != FLASH_STATUS_BUSY);
-}
\ No newline at end of file
+    flash_get_status(ftHandle, part, &status);
+    return ((status & part->status_busy) != part->status_busy);
+}
@@ -1,11 +1,25 @@
 /**
  * @file spi_flash.h
- * @brief Functions for interfacing with AT25DF512C SPI Serial Flash Memory chips.
+ * @brief Functions for interfacing with SPI NOR flash memory chips.
  *
- * Implements functions for controlling and accessing AT25DF512C SPI flash chips via FTDI SPI channels.
- * This includes write enable/disable, chip erase, page write, and status register operations.
+ * Implements functions for controlling and accessing SPI NOR flash chips via FTDI SPI channels.
+ * This includes write enable/disable, chip and sector erase, page write, and status register operations.
  *
  * @details
+ * Every supported chip is described by a @ref FlashPart descriptor holding its
+ * geometry, opcodes, erase granularities, status bits and timing. The part on a
+ * chip select is found at runtime by its JEDEC ID, see @ref flash_detect.
+ *
+ * The multi-page program and verify loops (@ref flash_program, @ref flash_verify)
+ * are compiled separately for every page size and address length in the table,
+ * so the hot loops run on constants instead of descriptor fields.
+ *
+ * Command and readback buffers are taken from an @ref Arena owned by the caller,
+ * nothing is allocated per page.
+ *
+ * Status polling after programs and erases is scheduled from the times
+ * recorded in @ref flash_timing.h and records the times it observes.
+ *
  * All functions return an FT_STATUS value where applicable. Status-related functions
  * return integer flags (0 or 1). The SPI handle (`FT_HANDLE`) must
  * be properly initialized before calling any of these functions.
@@ -19,83 +33,365 @@
 #define SPI_FLASH_h
 
 #include "spi_driver.h"
+#include "arena.h"
 #include "ftd2xx.h"
 #include <stdint.h>
 
+//! Largest program page of any supported part in bytes, size of page buffers
+#define FLASH_PAGE_SIZE 256
+//! Largest address length of any supported part in bytes
+#define FLASH_MAX_ADDR_LEN 4
+//! Number of erase granularities in a descriptor
+#define FLASH_ERASE_TYPES 3
+//! Largest block read back per transfer by @ref flash_verify
+#define FLASH_VERIFY_BLOCK 0x1000
+//! Bytes read back per programmed page, the status after write enable and after the program
+#define FLASH_PAGE_READ_LEN 2
+//! Pages sent per round trip by @ref flash_program and compiled programs, checked once per batch
+#define FLASH_BATCH_PAGES 16
+//! Command buffer of one batched page: write enable, status read, page program, program time delay, status read
+#define FLASH_PAGE_CMD_LEN SPI_TRANSACTION_LEN(3 + 1 + FLASH_MAX_ADDR_LEN + FLASH_PAGE_SIZE, 5, 8)
+//! Largest transaction command buffer of any function, a full batch and its gathered status bytes
+#define FLASH_CMD_MAX_LEN (FLASH_BATCH_PAGES * (FLASH_PAGE_CMD_LEN + FLASH_PAGE_READ_LEN))
+//! Arena space needed by @ref flash_program and @ref flash_verify
+#define FLASH_ARENA_SIZE (FLASH_CMD_MAX_LEN + FLASH_VERIFY_BLOCK + 2 * ARENA_ALIGN)
+
+/*!
+ * @enum flash_read_mode_t
+ * @brief Read command used for bulk reads, see @ref flash_read_mode
+ */
+typedef enum {
+    FLASH_READ_ARRAY, /*!< Read Array, no dummy byte */
+    FLASH_READ_FAST   /*!< Fast Read, one dummy byte */
+} flash_read_mode_t;
+
+/*!
+ * @struct FlashErase
+ * @brief A block erase command of a part
+ */
+typedef struct {
+    uint32_t size;   /*!< Bytes erased, 0 if unused */
+    uint8_t opcode;  /*!< Erase opcode */
+    uint32_t max_ms; /*!< Maximum erase time from the datasheet */
+} FlashErase;
+
+/*!
+ * @struct FlashPart
+ * @brief Descriptor of a supported SPI NOR flash part
+ */
+typedef struct FlashPart {
+    const char *name;       /*!< Part number */
+    uint32_t jedec_id;      /*!< Manufacturer, memory type and capacity bytes of the 0x9F response */
+    uint32_t capacity;      /*!< Size in bytes */
+    uint16_t page_size;     /*!< Program page size in bytes */
+    uint8_t addr_len;       /*!< Address bytes sent with read, program and erase commands */
+
+    uint8_t op_read;        /*!< Read Array opcode */
+    uint8_t op_fast_read;   /*!< Fast Read opcode, one dummy byte */
+    uint8_t op_program;     /*!< Page Program opcode */
+    uint8_t op_write_en;    /*!< Write Enable opcode */
+    uint8_t op_write_di;    /*!< Write Disable opcode */
+    uint8_t op_read_status; /*!< Read Status Register opcode */
+    uint8_t op_chip_erase;  /*!< Chip Erase opcode */
+    FlashErase erase[FLASH_ERASE_TYPES]; /*!< Block erase commands, smallest first */
+
+    uint8_t status_busy;    /*!< Status register BUSY mask */
+    uint8_t status_wel;     /*!< Status register WEL mask */
+    uint8_t status_error;   /*!< Status register erase/program error mask, 0 if the part has none */
+
+    uint32_t program_max_ms;    /*!< Maximum page program time from the datasheet */
+    uint32_t chip_erase_max_ms; /*!< Maximum chip erase time from the datasheet */
+
+    /*! Program loop specialised for the part, see @ref flash_program */
+    FT_STATUS (*program)(FT_HANDLE ftHandle, const struct FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length);
+    /*! Verify loop specialised for the part, see @ref flash_verify */
+    FT_STATUS (*verify)(FT_HANDLE ftHandle, const struct FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length);
+} FlashPart;
+
+/*!
+ * @brief Reads the 3 byte JEDEC ID (opcode 0x9F).
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[out] jedec_id Manufacturer, memory type and capacity bytes, manufacturer in the top byte
+ * @return FT_STATUS Status of the operation
+*/
+FT_STATUS flash_read_jedec_id(FT_HANDLE ftHandle, uint32_t *jedec_id);
+
+/*!
+ * @brief Looks up the descriptor of a JEDEC ID.
+ *
+ * @param[in] jedec_id ID returned by @ref flash_read_jedec_id
+ * @return const FlashPart* Descriptor, NULL if the part is not supported
+*/
+const FlashPart *flash_part_find(uint32_t jedec_id);
+
+/*!
+ * @brief Returns the descriptor used when the JEDEC ID is not known, the AT25DF512C.
+ *
+ * @return const FlashPart* Default descriptor
+*/
+const FlashPart *flash_part_default(void);
+
+/*!
+ * @brief Identifies the part on the selected chip select.
+ *
+ * Unknown IDs fall back to @ref flash_part_default with a warning.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[out] part Descriptor of the detected part
+ * @return FT_STATUS FT_OK, FT_EEPROM_NOT_PRESENT if no chip answers
+*/
+FT_STATUS flash_detect(FT_HANDLE ftHandle, const FlashPart **part);
+
 /*!
  * @brief Sets the WEL (Write Enable Latch) bit to 1.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @return FT_STATUS Status of the operation
 */
-FT_STATUS flash_write_enable(FT_HANDLE ftHandle);
+FT_STATUS flash_write_enable(FT_HANDLE ftHandle, const FlashPart *part);
 
 /*!
  * @brief Sets the WEL (Write Enable Latch) bit to 0.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @return FT_STATUS Status of the operation
 */
-FT_STATUS flash_write_disable(FT_HANDLE ftHandle);
+FT_STATUS flash_write_disable(FT_HANDLE ftHandle, const FlashPart *part);
 
 /*!
  * @brief Erases flash chip and waits until operation is complete.
  *
  * @param[in] ftHandle Handle of the SPI channel
- * @return FT_STATUS Status of the operation
+ * @param[in] part Descriptor of the selected part
+ * @return FT_STATUS Status of the operation, FT_EEPROM_ERASE_FAILED on error or timeout
+*/
+FT_STATUS flash_chip_erase(FT_HANDLE ftHandle, const FlashPart *part);
+
+/*!
+ * @brief Erases one block and waits until operation is complete.
+ *
+ * Write enable must be set, it is cleared by the flash afterwards.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in] address Start of the block, aligned to size
+ * @param[in] size One of the erase sizes of the part, see @ref FlashPart::erase
+ * @return FT_STATUS Status of the operation, FT_INVALID_PARAMETER if the part has no such erase,
+ *         FT_EEPROM_ERASE_FAILED on error or timeout
 */
-FT_STATUS flash_chip_erase(FT_HANDLE ftHandle);
+FT_STATUS flash_erase(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint32_t size);
 
 /**
  * @brief Writes a page of data to the flash memory.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in,out] arena Scratch space of at least @ref FLASH_ARENA_SIZE free bytes
  * @param[in] address Address in flash memory to write to
  * @param[in] data Pointer to the data buffer to write
- * @param[in] data_length Number of bytes to write (max page size)
+ * @param[in] data_length Number of bytes to write (max @ref FlashPart::page_size)
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS flash_write_page(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint16_t data_length);
+
+/*!
+ * @brief Writes data of any length, split into page programs each preceded by a write enable.
+ *
+ * Up to @ref FLASH_BATCH_PAGES pages go out in one round trip, every page
+ * followed by the delay of @ref flash_program_delay_us, and their status
+ * bytes are checked once for the whole batch. A batch reporting any error is
+ * sent again page by page, each page polled until done, to find the failing
+ * page. A single page is always polled.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in,out] arena Scratch space of at least @ref FLASH_ARENA_SIZE free bytes
+ * @param[in] address Address in flash memory to start writing
+ * @param[in] data Bytes to write
+ * @param[in] length Number of bytes
+ * @return FT_STATUS Status of the operation, FT_INVALID_PARAMETER beyond the capacity of the part
+ */
+FT_STATUS flash_program(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length);
+
+/*!
+ * @brief Delay given to a batched page program before the next page follows.
+ *
+ * The slowest recent program time of the part from @ref flash_timing.h plus
+ * a quarter and a margin, or @ref FlashPart::program_max_ms while the part
+ * has too few recorded times. Never more than the datasheet maximum.
+ *
+ * @param[in] part Descriptor of the part
+ * @return uint32_t Delay in microseconds
+ */
+uint32_t flash_program_delay_us(const FlashPart *part);
+
+/*!
+ * @brief Length of the command buffer of @ref flash_compile_page.
+ *
+ * @param[in] part Descriptor of the target part
+ * @param[in] data_length Bytes programmed by the page
+ * @param[in] delay_us Program time delay of the page
+ * @return size_t Buffer length in bytes
+ */
+size_t flash_compile_page_len(const FlashPart *part, uint32_t data_length, uint32_t delay_us);
+
+/*!
+ * @brief Compiles a write enable and page program into a ready to send MPSSE buffer.
+ *
+ * The buffer holds a write enable, a status read, the page program with its
+ * data, a delay of delay_us with the chip deselected and a status read. The
+ * buffers of consecutive pages can be concatenated and sent as one batch
+ * with @ref flash_run_batch, needing no formatting at programming time. The
+ * first poll_len bytes end after the page program and are sent alone by
+ * @ref flash_run_polled.
+ *
+ * @param[in] part Descriptor of the target part
+ * @param[in] chipSelect Chip select of the target chip
+ * @param[in] address Start of the data, the page must not be crossed
+ * @param[in] data Bytes to program
+ * @param[in] data_length Number of bytes, at most @ref FlashPart::page_size
+ * @param[in] delay_us Program time delay, usually @ref flash_program_delay_us
+ * @param[out] cmd Buffer of @ref flash_compile_page_len bytes
+ * @param[out] poll_len Length of the part of cmd up to the delay
+ * @return size_t Bytes written to cmd
+ */
+size_t flash_compile_page(const FlashPart *part, spi_chip_select_t chipSelect, uint32_t address, const uint8_t *data,
+                          uint32_t data_length, uint32_t delay_us, uint8_t *cmd, uint32_t *poll_len);
+
+/*!
+ * @brief Shortens the program time delay of a page compiled by @ref flash_compile_page.
+ *
+ * The delay starts right after the first poll_len bytes of the buffer.
+ *
+ * @param[in,out] cmd Buffer of the page, or a copy of it
+ * @param[in] poll_len Poll length returned when the page was compiled
+ * @param[in] delay_us New delay, at most the delay the page was compiled with
+ * @return int 1 on success, 0 if the delay is longer than the compiled one
+ */
+int flash_page_set_delay(uint8_t *cmd, uint32_t poll_len, uint32_t delay_us);
+
+/*!
+ * @brief Sends pages compiled by @ref flash_compile_page in one round trip and checks them.
+ *
+ * Every write enable must have latched and every page but the last must have
+ * finished without error within its delay, the last one is polled until done.
+ * On failure send the pages again one by one from the first page that did
+ * not complete, the pages before it are programmed.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in] address Address of the first page, for error messages
+ * @param[in] cmd Concatenated buffers of the pages
+ * @param[in] cmd_len Length of cmd
+ * @param[in] pages Number of pages, at most @ref FLASH_BATCH_PAGES
+ * @param[out] done Pages that completed before the first failure, pages on success, 0 if the transfer failed
+ * @return FT_STATUS Status of the operation, FT_OTHER_ERROR if a write enable did not latch
+ *         or a page was still busy, FT_EEPROM_WRITE_FAILED if the part reports a program error
+ */
+FT_STATUS flash_run_batch(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, const uint8_t *cmd, uint32_t cmd_len,
+                          uint32_t pages, uint32_t *done);
+
+/*!
+ * @brief Sends one page compiled by @ref flash_compile_page without its delay and polls it until done.
+ *
+ * Slower than a batch but exact, used to find the failing page of a batch
+ * and to record the program time of the part.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in] address Address of the page, for error messages
+ * @param[in] cmd Buffer of the page
+ * @param[in] poll_len Length of the part of cmd up to the delay
+ * @return FT_STATUS Status of the operation, see @ref flash_run_batch
+ */
+FT_STATUS flash_run_polled(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, const uint8_t *cmd, uint32_t poll_len);
+
+/*!
+ * @brief Chooses the bulk read command for a part.
+ *
+ * Fast Read when the part has it, otherwise Read Array. The FT4232H MPSSE
+ * receives on a single data line, so multi-line reads are not offered.
+ *
+ * @param[in] part Descriptor of the part
+ * @return flash_read_mode_t Read command to use
+ */
+flash_read_mode_t flash_read_mode(const FlashPart *part);
+
+/*!
+ * @brief Reads back data of any length and compares it.
+ *
+ * Reads up to @ref FLASH_VERIFY_BLOCK bytes per transfer with the command
+ * chosen by @ref flash_read_mode.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in,out] arena Scratch space of at least @ref FLASH_ARENA_SIZE free bytes
+ * @param[in] address Address in flash memory to start reading
+ * @param[in] data Expected bytes
+ * @param[in] length Number of bytes
+ * @return FT_STATUS Status of the operation, FT_FAILED_TO_WRITE_DEVICE on mismatch
+ */
+FT_STATUS flash_verify(FT_HANDLE ftHandle, const FlashPart *part, Arena *arena, uint32_t address, const uint8_t *data, uint32_t length);
+
+/*!
+ * @brief Reads a block of data from flash memory.
+ *
+ * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
+ * @param[in] address Address in flash memory to start reading from
+ * @param[out] data Pointer to buffer to read data to
+ * @param[in] data_length Number of bytes to read
  * @return FT_STATUS Status of the operation
  */
-FT_STATUS flash_write_page(FT_HANDLE ftHandle, uint32_t address, const uint8_t *data, uint8_t data_length);
+FT_STATUS flash_read(FT_HANDLE ftHandle, const FlashPart *part, uint32_t address, uint8_t *data, uint32_t data_length);
 
 /*!
  * @brief Reads the flash status register.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @param[out] status Pointer to store flash status register
  * @returns FT_STATUS Status of the operation
 */
-FT_STATUS flash_get_status(FT_HANDLE ftHandle, uint8_t *status);
+FT_STATUS flash_get_status(FT_HANDLE ftHandle, const FlashPart *part, uint8_t *status);
 
 /*!
- * @brief Reads EPE (Erase/Program Error) bit from the flash status register.
+ * @brief Reads the erase/program error bit from the flash status register.
  *
  * @param[in] ftHandle Handle of the SPI channel
- * @return int Returns 1 if last program/erase succeeded, o therwise
+ * @param[in] part Descriptor of the selected part
+ * @return int Returns 1 if last program/erase succeeded, 0 otherwise
 */
-int flash_success(FT_HANDLE ftHandle);
+int flash_success(FT_HANDLE ftHandle, const FlashPart *part);
 
 /**
  * @brief Reads the WEL (Write Enable Latch) bit from the flash status register.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @return int Returns 1 if write is enabled, 0 otherwise
  */
-int flash_write_isEnabled(FT_HANDLE ftHandle);
+int flash_write_isEnabled(FT_HANDLE ftHandle, const FlashPart *part);
 
 /**
  * @brief Reads the ~BUSY bit from the flash status register.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @return int Returns 1 if flash is ready, 0 if busy
  */
-int flash_isReady(FT_HANDLE ftHandle);
+int flash_isReady(FT_HANDLE ftHandle, const FlashPart *part);
 
 /**
  * @brief Reads the BUSY bit from the flash status register.
  *
  * @param[in] ftHandle Handle of the SPI channel
+ * @param[in] part Descriptor of the selected part
  * @return int Returns 1 if flash is busy, 0 if ready
  */
-int flash_isBusy(FT_HANDLE ftHandle);
+int flash_isBusy(FT_HANDLE ftHandle, const FlashPart *part);
 
-#endif
\ No newline at end of file
+#endif
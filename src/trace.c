@@ -0,0 +1,112 @@
+#include "trace.h"
+
+#ifdef AMPLINK_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+
+/*!
+ * @struct TraceEvent
+ * @brief A single recorded library call
+ */
+typedef struct {
+    uint64_t start;      /*!< Time of the call start in microseconds */
+    uint64_t end;        /*!< Time of the call return in microseconds */
+    const char *channel; /*!< Channel name */
+    const char *op;      /*!< Library function name */
+    uint32_t bytes;      /*!< Bytes transferred */
+    FT_STATUS status;    /*!< Returned status */
+} TraceEvent;
+
+/*!
+ * @struct TraceRing
+ * @brief Events of one thread, written only by that thread
+ */
+typedef struct {
+    TraceEvent events[TRACE_RING_SIZE];
+    volatile long count; /*!< Events recorded, including overwritten ones */
+    uint32_t tid;        /*!< Index of the thread in the trace */
+    uint64_t pending;    /*!< Start of the call in progress */
+} TraceRing;
+
+static TraceRing *rings[TRACE_MAX_THREADS];
+static volatile long ring_count;
+static uint64_t origin;
+static PLATFORM_THREAD_LOCAL TraceRing *local_ring;
+static PLATFORM_THREAD_LOCAL int local_full;
+
+
+static TraceRing *trace_ring(void){
+    if (local_ring || local_full)
+        return local_ring;
+
+    TraceRing *ring = calloc(1, sizeof(TraceRing));
+    long index = ring ? platform_atomic_inc(&ring_count) - 1 : TRACE_MAX_THREADS;
+    if (index >= TRACE_MAX_THREADS){
+        // no slot left, this thread is not traced
+        free(ring);
+        local_full = 1;
+        return NULL;
+    }
+    ring->tid = (uint32_t)index;
+    rings[index] = ring;
+    local_ring = ring;
+    return ring;
+}
+
+void trace_init(void){
+    origin = platform_time_us();
+}
+
+void trace_begin(void){
+    TraceRing *ring = trace_ring();
+    uint64_t now = platform_time_us();
+    if (ring) ring->pending = now;
+}
+
+FT_STATUS trace_end(const char *channel, const char *op, uint32_t bytes, FT_STATUS status){
+    uint64_t now = platform_time_us();
+    TraceRing *ring = local_ring;
+    if (!ring) return status;
+
+    TraceEvent *e = &ring->events[ring->count & (TRACE_RING_SIZE - 1)];
+    e->start = ring->pending;
+    e->end = now;
+    e->channel = channel;
+    e->op = op;
+    e->bytes = bytes;
+    e->status = status;
+    // publish the event before the count
+    platform_barrier();
+    ring->count++;
+    return status;
+}
+
+FT_STATUS trace_dump(const char *path){
+    FILE *file = fopen(path, "w");
+    if (!file) return FT_IO_ERROR;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = 1;
+    long threads = ring_count < TRACE_MAX_THREADS ? ring_count : TRACE_MAX_THREADS;
+    for (long t = 0; t < threads; t++){
+        TraceRing *ring = rings[t];
+        if (!ring) continue;
+        long count = ring->count;
+        platform_barrier();
+        long oldest = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+        for (long i = oldest; i < count; i++){
+            const TraceEvent *e = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"pid\":1,\"tid\":%u,\"args\":{\"bytes\":%u,\"status\":%d}}",
+                    first ? "" : ",\n", e->op, e->channel, (double)(e->start - origin),
+                    (double)(e->end - e->start), ring->tid, e->bytes, (int)e->status);
+            first = 0;
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0 ? FT_OK : FT_IO_ERROR;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*! @file trace.h
+ *  @brief Optional tracing of every libftd2xx/libMPSSE call made by the drivers.
+ *
+ * Each wrapped call records its start time, channel, operation, byte count,
+ * status and latency into a lock-free ring owned by the calling thread. The
+ * rings are written out as Chrome `trace_event` JSON, which opens in
+ * `chrome://tracing` or Perfetto.
+ *
+ * @details
+ * Tracing is compiled in only when `AMPLINK_TRACE` is defined, see the CMake
+ * option of the same name. Without it @ref TRACE_CALL expands to the plain call
+ * and no tracing code is built.
+ *
+ * **Example usage:**
+ * @code
+ * RETURN_IF_ERROR(TRACE_CALL("SPI", numBytes, SPI_Write, ftHandle, tx_buff, numBytes, &bytesTransferred, options));
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+
+//! Events kept per thread, older events are overwritten, must be a power of 2
+#define TRACE_RING_SIZE   0x10000
+//! Maximum number of threads that can record events
+#define TRACE_MAX_THREADS 16
+
+#ifdef AMPLINK_TRACE
+
+/*!
+ * @brief Calls a driver library function and records the call.
+ *
+ * @param channel Channel name string, e.g. "SPI"
+ * @param bytes Number of bytes transferred by the call
+ * @param fn Library function, its name is used as the operation
+ * @param ... Arguments of fn
+ * @return The FT_STATUS returned by fn
+ */
+#define TRACE_CALL(channel, bytes, fn, ...) \
+    (trace_begin(), trace_end((channel), #fn, (uint32_t)(bytes), fn(__VA_ARGS__)))
+
+/*!
+ * @brief Starts the trace clock. Must be called before any traced call.
+ */
+void trace_init(void);
+
+/*!
+ * @brief Marks the start of a traced call on the calling thread.
+ *
+ * @note Used by @ref TRACE_CALL, not intended to be called directly.
+ */
+void trace_begin(void);
+
+/*!
+ * @brief Records a traced call that started at the last @ref trace_begin.
+ *
+ * @note Used by @ref TRACE_CALL, not intended to be called directly.
+ *
+ * @param[in] channel Channel name string
+ * @param[in] op Operation name string
+ * @param[in] bytes Bytes transferred
+ * @param[in] status Status returned by the call
+ * @return FT_STATUS status, unchanged
+ */
+FT_STATUS trace_end(const char *channel, const char *op, uint32_t bytes, FT_STATUS status);
+
+/*!
+ * @brief Writes all recorded events as Chrome trace_event JSON.
+ *
+ * Call once traced threads are idle, e.g. after all jobs completed.
+ *
+ * @param[in] path Output file path
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file could not be written
+ */
+FT_STATUS trace_dump(const char *path);
+
+#else
+
+#define TRACE_CALL(channel, bytes, fn, ...) fn(__VA_ARGS__)
+
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+#include "usb_tuning.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "trace.h"
+#include "platform.h"
+
+#define USB_TUNING_LINE_LEN 128
+
+// 255 ms is what the drivers set on their own, the small values flush short replies sooner
+static const uint8_t latencies[] = {1, 2, 4, 8, 16, 255};
+// multiples of 64 from a single packet to the largest transfer the driver accepts
+static const uint32_t sizes[] = {512, 4096, 16384, 65536};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+
+static double tuning_median(double *samples, int count){
+    // insertion sort, a handful of samples only
+    for (int i = 1; i < count; i++){
+        double v = samples[i];
+        int j = i - 1;
+        for (; j >= 0 && samples[j] > v; j--)
+            samples[j + 1] = samples[j];
+        samples[j + 1] = v;
+    }
+    return samples[count / 2];
+}
+
+// applies a candidate and times the probe, -1 if any repetition failed
+static double tuning_measure(FT_HANDLE ftHandle, const UsbSettings *candidate, usb_tuning_probe_t probe, void *ctx){
+    double samples[USB_TUNING_REPS];
+    if (usb_tuning_apply(ftHandle, candidate) != FT_OK)
+        return -1;
+    // the first transaction after a change may still wait on the old latency timer
+    if (probe(ctx) != FT_OK)
+        return -1;
+    for (int i = 0; i < USB_TUNING_REPS; i++){
+        uint64_t start = platform_time_us();
+        if (probe(ctx) != FT_OK)
+            return -1;
+        samples[i] = platform_elapsed_ms(start) * 1000.0;
+    }
+    return tuning_median(samples, USB_TUNING_REPS);
+}
+
+static void tuning_try(FT_HANDLE ftHandle, UsbSettings candidate, usb_tuning_probe_t probe, void *ctx, UsbSettings *best){
+    candidate.us = tuning_measure(ftHandle, &candidate, probe, ctx);
+    if (candidate.us >= 0 && (best->latency_ms == 0 || candidate.us < best->us))
+        *best = candidate;
+}
+
+
+FT_STATUS usb_tuning_apply(FT_HANDLE ftHandle, const UsbSettings *settings){
+    if (settings->latency_ms == 0)
+        return FT_OK;
+    RETURN_IF_ERROR(TRACE_CALL("USB", 0, FT_SetLatencyTimer, ftHandle, settings->latency_ms));
+    return TRACE_CALL("USB", 0, FT_SetUSBParameters, ftHandle, settings->in_size, settings->out_size);
+}
+
+FT_STATUS usb_tuning_sweep(FT_HANDLE ftHandle, usb_tuning_probe_t probe, void *ctx, UsbSettings *best){
+    memset(best, 0, sizeof(*best));
+    for (size_t i = 0; i < COUNT_OF(latencies); i++){
+        for (size_t j = 0; j < COUNT_OF(sizes); j++)
+            tuning_try(ftHandle, (UsbSettings){latencies[i], sizes[j], sizes[j], 0}, probe, ctx, best);
+    }
+    if (best->latency_ms == 0)
+        return FT_OTHER_ERROR;
+
+    // host to device transfers hardly interact with the latency timer, sweep them on their own
+    UsbSettings pair = *best;
+    for (size_t j = 0; j < COUNT_OF(sizes); j++){
+        if (sizes[j] != pair.out_size)
+            tuning_try(ftHandle, (UsbSettings){pair.latency_ms, pair.in_size, sizes[j], 0}, probe, ctx, best);
+    }
+    return usb_tuning_apply(ftHandle, best);
+}
+
+FT_STATUS usb_tuning_load(const char *path, const char *serial, const char *channel, UsbSettings *settings){
+    char line[USB_TUNING_LINE_LEN];
+    FILE *file = fopen(path, "r");
+    if (!file) return FT_IO_ERROR;
+
+    FT_STATUS ftStatus = FT_IO_ERROR;
+    while (fgets(line, sizeof(line), file)){
+        char lineSerial[32], lineChannel[16];
+        unsigned latency, in_size, out_size;
+        double us;
+        if (sscanf(line, "%31s %15s %u %u %u %lf", lineSerial, lineChannel, &latency, &in_size, &out_size, &us) != 6)
+            continue;
+        if (strcmp(lineSerial, serial) != 0 || strcmp(lineChannel, channel) != 0)
+            continue;
+        if (latency == 0 || latency > 255 || in_size % 64 || out_size % 64 || !in_size || !out_size)
+            continue;
+        *settings = (UsbSettings){(uint8_t)latency, in_size, out_size, us};
+        ftStatus = FT_OK;
+    }
+    fclose(file);
+    return ftStatus;
+}
+
+// copies the other entries to a temporary file so readers never see a partial cache
+FT_STATUS usb_tuning_save(const char *path, const char *serial, const char *channel, const UsbSettings *settings){
+    char tmp_path[USB_TUNING_LINE_LEN];
+    char line[USB_TUNING_LINE_LEN];
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+        return FT_INVALID_PARAMETER;
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return FT_IO_ERROR;
+
+    FILE *in = fopen(path, "r");
+    if (in){
+        while (fgets(line, sizeof(line), in)){
+            char lineSerial[32], lineChannel[16];
+            if (sscanf(line, "%31s %15s", lineSerial, lineChannel) == 2
+                && strcmp(lineSerial, serial) == 0 && strcmp(lineChannel, channel) == 0)
+                continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s %s %u %u %u %.1f\n", serial, channel, settings->latency_ms, settings->in_size, settings->out_size, settings->us);
+
+    int ok = fclose(out) == 0;
+    if (ok){
+        remove(path);
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok){
+        remove(tmp_path);
+        return FT_IO_ERROR;
+    }
+    return FT_OK;
+}
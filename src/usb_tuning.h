@@ -0,0 +1,104 @@
+/*! @file usb_tuning.h
+ *  @brief Sweeps the FTDI latency timer and USB transfer sizes of a channel.
+ *
+ * The latency timer decides how long the FT4232H holds a short reply before
+ * sending it to the host, and the USB transfer sizes how much the driver
+ * moves per bulk request. The best values depend on the host controller, hub
+ * and cable of a fixture, so they are measured there: every candidate is
+ * applied and a representative transaction of the channel is timed.
+ *
+ * @details
+ * The latency timer and the IN transfer size are swept together, the OUT
+ * transfer size after them with the best pair applied. A candidate only
+ * counts when every repetition succeeds, its score is the median time.
+ *
+ * Results are cached per AmPLink serial number in a text file, one line per
+ * channel: `<serial> <channel> <latency_ms> <in_size> <out_size> <us>`.
+ *
+ * **Example usage:**
+ * @code
+ * UsbSettings spi;
+ * if (usb_tuning_load(USB_TUNING_DEFAULT_FILE, serial, "spi", &spi) != FT_OK){
+ *     usb_tuning_sweep(handle, spi_status_read, NULL, &spi);
+ *     usb_tuning_save(USB_TUNING_DEFAULT_FILE, serial, "spi", &spi);
+ * }
+ * usb_tuning_apply(handle, &spi);
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#ifndef USB_TUNING_H
+#define USB_TUNING_H
+
+#include <stdint.h>
+#include "ftd2xx.h"
+
+//! Default file of the tuning cache
+#define USB_TUNING_DEFAULT_FILE "amplink_usb.txt"
+//! Timed repetitions of the representative transaction per candidate
+#define USB_TUNING_REPS 8
+
+/*!
+ * @struct UsbSettings
+ * @brief USB settings of one channel
+ */
+typedef struct {
+    uint8_t latency_ms; /*!< Latency timer, 0 if the channel was not tuned and keeps its driver defaults */
+    uint32_t in_size;   /*!< USB IN transfer size in bytes */
+    uint32_t out_size;  /*!< USB OUT transfer size in bytes */
+    double us;          /*!< Median time of the representative transaction with these settings */
+} UsbSettings;
+
+/*!
+ * @brief One representative transaction of a channel, timed by the sweep.
+ *
+ * @param[in] ctx Context given to @ref usb_tuning_sweep
+ * @return FT_STATUS FT_OK if the transaction succeeded
+ */
+typedef FT_STATUS (*usb_tuning_probe_t)(void *ctx);
+
+/*!
+ * @brief Applies settings to an open channel. Does nothing for untuned settings.
+ *
+ * @param[in] ftHandle Channel handle, a libMPSSE handle is accepted as well
+ * @param[in] settings Settings to apply
+ * @return FT_STATUS Status of the operation
+ */
+FT_STATUS usb_tuning_apply(FT_HANDLE ftHandle, const UsbSettings *settings);
+
+/*!
+ * @brief Finds the fastest stable settings of a channel and leaves them applied.
+ *
+ * @param[in] ftHandle Channel handle
+ * @param[in] probe Representative transaction of the channel
+ * @param[in] ctx Passed to probe
+ * @param[out] best Fastest stable settings
+ * @return FT_STATUS FT_OK, FT_OTHER_ERROR if no candidate was stable, otherwise the failed USB call
+ */
+FT_STATUS usb_tuning_sweep(FT_HANDLE ftHandle, usb_tuning_probe_t probe, void *ctx, UsbSettings *best);
+
+/*!
+ * @brief Looks up the cached settings of a channel.
+ *
+ * @param[in] path Cache file
+ * @param[in] serial AmPLink serial number
+ * @param[in] channel Channel name, e.g. "spi"
+ * @param[out] settings Cached settings
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file or entry does not exist
+ */
+FT_STATUS usb_tuning_load(const char *path, const char *serial, const char *channel, UsbSettings *settings);
+
+/*!
+ * @brief Stores the settings of a channel, replacing its previous entry.
+ *
+ * @param[in] path Cache file
+ * @param[in] serial AmPLink serial number
+ * @param[in] channel Channel name, e.g. "spi"
+ * @param[in] settings Settings to store
+ * @return FT_STATUS FT_OK, FT_IO_ERROR if the file could not be written
+ */
+FT_STATUS usb_tuning_save(const char *path, const char *serial, const char *channel, const UsbSettings *settings);
+
+#endif
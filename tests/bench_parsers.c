@@ -0,0 +1,125 @@
+/*! @file bench_parsers.c
+ *  @brief Times the Intel HEX, S-record and binary parsers on a generated image.
+ *
+ * Writes the same image as an Intel HEX file with 32 byte records, an S37
+ * file with 32 byte records and a raw binary, then parses each file a
+ * number of times and prints the best time and throughput of every parser.
+ * Not run by ctest, start it by hand from the build directory:
+ *
+ * @code
+ * ./bench_parsers [image size in KB] [runs]
+ * @endcode
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fileparser.h"
+#include "platform.h"
+
+#define BENCH_HEX    "bench_parsers.hex"
+#define BENCH_SREC   "bench_parsers.s37"
+#define BENCH_BINARY "bench_parsers.bin"
+#define BENCH_RECORD 32
+
+static uint8_t pattern(uint32_t addr){
+    return (uint8_t)(addr * 31u + (addr >> 8));
+}
+
+static FT_STATUS count_cb(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    (void)addr;
+    (void)data;
+    *(uint32_t *)ctx += len;
+    return FT_OK;
+}
+
+static int write_files(uint32_t size){
+    FILE *hex = fopen(BENCH_HEX, "w");
+    FILE *srec = fopen(BENCH_SREC, "w");
+    FILE *bin = fopen(BENCH_BINARY, "wb");
+    if (!hex || !srec || !bin){
+        if (hex) fclose(hex);
+        if (srec) fclose(srec);
+        if (bin) fclose(bin);
+        return -1;
+    }
+
+    uint32_t records = 0;
+    for (uint32_t addr = 0; addr < size; addr += BENCH_RECORD){
+        uint8_t data[BENCH_RECORD];
+        for (uint32_t i = 0; i < BENCH_RECORD; i++)
+            data[i] = pattern(addr + i);
+        fwrite(data, 1, BENCH_RECORD, bin);
+
+        if ((addr & 0xFFFF) == 0){
+            uint8_t sum = (uint8_t)(2 + 4 + (addr >> 24) + (addr >> 16));
+            fprintf(hex, ":02000004%04X%02X\n", addr >> 16, (uint8_t)(0x100 - sum));
+        }
+        uint8_t hex_sum = (uint8_t)(BENCH_RECORD + (addr >> 8) + addr);
+        uint8_t srec_sum = (uint8_t)(BENCH_RECORD + 5 + (addr >> 24) + (addr >> 16) + (addr >> 8) + addr);
+        fprintf(hex, ":%02X%04X00", BENCH_RECORD, addr & 0xFFFF);
+        fprintf(srec, "S3%02X%08X", BENCH_RECORD + 5, addr);
+        for (uint32_t i = 0; i < BENCH_RECORD; i++){
+            fprintf(hex, "%02X", data[i]);
+            fprintf(srec, "%02X", data[i]);
+            hex_sum += data[i];
+            srec_sum += data[i];
+        }
+        fprintf(hex, "%02X\n", (uint8_t)(0x100 - hex_sum));
+        fprintf(srec, "%02X\n", (uint8_t)~srec_sum);
+        records++;
+    }
+    fprintf(hex, ":00000001FF\n");
+    fprintf(srec, "S70500000000FA\n");
+    fclose(hex);
+    fclose(srec);
+    fclose(bin);
+    return (int)records;
+}
+
+static void bench(const char *name, const char *path, int runs, uint32_t size){
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < runs; run++){
+        uint32_t bytes = 0;
+        uint64_t start = platform_time_us();
+        FT_STATUS ftStatus;
+        if (path == BENCH_HEX)
+            ftStatus = fileparser_stream_intel_hex_ctx(path, count_cb, &bytes);
+        else if (path == BENCH_SREC)
+            ftStatus = fileparser_stream_srec_ctx(path, count_cb, &bytes);
+        else
+            ftStatus = fileparser_stream_binary_ctx(path, 0, count_cb, &bytes);
+        uint64_t us = platform_time_us() - start;
+        if (ftStatus != FT_OK || bytes != size){
+            printf("%-10s failed, status %d, %u of %u bytes\n", name, (int)ftStatus, bytes, size);
+            return;
+        }
+        if (us < best) best = us;
+    }
+    printf("%-10s %8.2f ms  %8.1f MB/s\n", name, best / 1000.0, best ? size / (double)best : 0.0);
+}
+
+int main(int argc, char **argv){
+    uint32_t size = (argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 4096) * 1024;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    if (size == 0 || runs < 1){
+        printf("usage: %s [image size in KB] [runs]\n", argv[0]);
+        return 2;
+    }
+    if (write_files(size) < 0){
+        printf("could not write the benchmark files\n");
+        return 1;
+    }
+
+    printf("%u KB image, best of %d runs\n", size / 1024, runs);
+    bench("Intel HEX", BENCH_HEX, runs, size);
+    bench("S-record", BENCH_SREC, runs, size);
+    bench("binary", BENCH_BINARY, runs, size);
+
+    remove(BENCH_HEX);
+    remove(BENCH_SREC);
+    remove(BENCH_BINARY);
+    return 0;
+}
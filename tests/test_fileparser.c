@@ -0,0 +1,181 @@
+/*! @file test_fileparser.c
+ *  @brief Runs the file parsers over one corpus file and over mutations of it.
+ *
+ * The parser is picked by the extension: .hex for Intel HEX, .s19, .s28,
+ * .s37 or .srec for S-records and .bin for raw binary. Files named ok_*
+ * must parse, files named bad_* must be rejected with FT_INVALID_PARAMETER.
+ *
+ * @details
+ * Every file is then mutated a fixed number of times with a seeded
+ * generator, flipping, inserting, deleting and truncating characters, and
+ * parsed again. A mutation may be accepted or rejected, but must never
+ * crash, deliver an empty record or return another status.
+ * Intel HEX text is also fed in chunks of random size, which must give the
+ * same result as feeding it at once.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fileparser.h"
+
+#define TEST_MUTATIONS 2000
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)){ printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+typedef enum { PARSER_HEX, PARSER_SREC, PARSER_BINARY } parser_t;
+
+// what a parse delivered, compared between whole and chunked feeding
+typedef struct {
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t sum;
+} Delivered;
+
+static uint32_t rng_state = 0x2545F491u;
+
+static uint32_t rng(void){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static FT_STATUS deliver_cb(void *ctx, uint32_t addr, const uint8_t *data, uint8_t len){
+    Delivered *d = (Delivered *)ctx;
+    CHECK(len > 0);
+    d->records++;
+    d->bytes += len;
+    for (uint8_t i = 0; i < len; i++)
+        d->sum = d->sum * 31u + data[i] + addr;
+    return FT_OK;
+}
+
+static int ends_with(const char *s, const char *ext){
+    size_t n = strlen(s), m = strlen(ext);
+    return n >= m && strcmp(s + n - m, ext) == 0;
+}
+
+static char *read_all(const char *path, size_t *len){
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    char *buf = malloc(1 << 16);
+    *len = buf ? fread(buf, 1, (1 << 16) - 1, file) : 0;
+    fclose(file);
+    return buf;
+}
+
+static FT_STATUS parse_file(parser_t parser, const char *path, Delivered *d){
+    memset(d, 0, sizeof(*d));
+    switch (parser){
+        case PARSER_HEX:    return fileparser_stream_intel_hex_ctx(path, deliver_cb, d);
+        case PARSER_SREC:   return fileparser_stream_srec_ctx(path, deliver_cb, d);
+        default:            return fileparser_stream_binary_ctx(path, 0, deliver_cb, d);
+    }
+}
+
+static FT_STATUS parse_hex_chunked(const char *text, size_t len, Delivered *d){
+    HexParser p;
+    memset(d, 0, sizeof(*d));
+    fileparser_hex_init(&p, NULL, deliver_cb, d);
+    FT_STATUS ftStatus = FT_OK;
+    for (size_t pos = 0; ftStatus == FT_OK && pos < len; ){
+        size_t n = 1 + rng() % 7;
+        if (n > len - pos) n = len - pos;
+        ftStatus = fileparser_hex_feed(&p, text + pos, n);
+        pos += n;
+    }
+    ftStatus = fileparser_hex_finish(&p);
+    fileparser_hex_free(&p);
+    return ftStatus;
+}
+
+static size_t mutate(char *buf, size_t len, size_t cap){
+    static const char pool[] = ":S0123456789ABCDEFabcdefG \r\n\t";
+    int edits = 1 + (int)(rng() % 4);
+    for (int e = 0; e < edits && len > 0; e++){
+        size_t pos = rng() % len;
+        switch (rng() % 4){
+            case 0:
+                buf[pos] = pool[rng() % (sizeof(pool) - 1)];
+                break;
+            case 1:
+                if (len < cap){
+                    memmove(buf + pos + 1, buf + pos, len - pos);
+                    buf[pos] = pool[rng() % (sizeof(pool) - 1)];
+                    len++;
+                }
+                break;
+            case 2:
+                memmove(buf + pos, buf + pos + 1, len - pos - 1);
+                len--;
+                break;
+            default:
+                len = pos;
+                break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv){
+    if (argc != 2){
+        printf("usage: %s <corpus file>\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    int expect_ok = strncmp(name, "ok_", 3) == 0;
+    parser_t parser = ends_with(name, ".hex") ? PARSER_HEX : ends_with(name, ".bin") ? PARSER_BINARY : PARSER_SREC;
+
+    Delivered whole, chunked;
+    FT_STATUS ftStatus = parse_file(parser, path, &whole);
+    printf("%s: status %d, %u records, %u bytes\n", name, (int)ftStatus, whole.records, whole.bytes);
+    CHECK(expect_ok ? ftStatus == FT_OK : ftStatus == FT_INVALID_PARAMETER);
+
+    size_t len;
+    char *text = read_all(path, &len);
+    CHECK(text != NULL);
+    if (!text) return 1;
+
+    if (parser == PARSER_HEX){
+        CHECK(parse_hex_chunked(text, len, &chunked) == ftStatus);
+        CHECK(memcmp(&whole, &chunked, sizeof(whole)) == 0 || ftStatus != FT_OK);
+    }
+
+    // named after the corpus file, so the tests can run in parallel
+    char mutant_path[256];
+    snprintf(mutant_path, sizeof(mutant_path), "%s.mutant", name);
+    char *mutant = malloc(1 << 16);
+    CHECK(mutant != NULL);
+    for (int i = 0; mutant && i < TEST_MUTATIONS; i++){
+        memcpy(mutant, text, len);
+        size_t mutant_len = mutate(mutant, len, (1 << 16) - 1);
+        FILE *file = fopen(mutant_path, "wb");
+        if (!file){
+            CHECK(file != NULL);
+            break;
+        }
+        fwrite(mutant, 1, mutant_len, file);
+        fclose(file);
+
+        ftStatus = parse_file(parser, mutant_path, &whole);
+        CHECK(ftStatus == FT_OK || ftStatus == FT_INVALID_PARAMETER);
+        if (parser == PARSER_HEX){
+            CHECK(parse_hex_chunked(mutant, mutant_len, &chunked) == ftStatus);
+            CHECK(memcmp(&whole, &chunked, sizeof(whole)) == 0 || ftStatus != FT_OK);
+        }
+    }
+    remove(mutant_path);
+    free(mutant);
+    free(text);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures != 0;
+}
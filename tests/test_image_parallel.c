@@ -0,0 +1,136 @@
+/*! @file test_image_parallel.c
+ *  @brief Loads a multi-megabyte Intel HEX file through the parallel loader and checks the image.
+ *
+ * Writes a HEX file of two segments, the second starting off a page
+ * boundary, large enough for @ref image_parallel_worthwhile, then loads it
+ * with @ref image_load and with @ref image_load_intel_hex_parallel directly
+ * and checks the data, segments, page bitmap and page CRCs of both.
+ *
+ * The parallel loader is only taken with more than one processor. Where
+ * the linker supports it, the build wraps @ref platform_cpu_count so the
+ * path is taken on a single processor machine as well.
+ *
+ * @date 2026-10-19
+ * @author Deven Marrero
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "image.h"
+#include "image_parallel.h"
+
+#define TEST_FILE      "test_image_parallel.hex"
+#define TEST_RECORD    32
+#define SEG_A_ADDR     0x000000u
+#define SEG_A_LEN      0x200000u
+#define SEG_B_ADDR     0x300010u
+#define SEG_B_LEN      0x0FFFF0u
+
+static int failures;
+
+#ifdef TEST_WRAP_CPU_COUNT
+int __wrap_platform_cpu_count(void){
+    return 4;
+}
+#endif
+
+#define CHECK(cond) do { if (!(cond)){ printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static uint8_t pattern(uint32_t addr){
+    return (uint8_t)(addr * 31u + (addr >> 8));
+}
+
+static void put_record(FILE *file, uint8_t type, uint16_t addr, const uint8_t *data, uint8_t len){
+    uint8_t sum = (uint8_t)(len + (addr >> 8) + addr + type);
+    fprintf(file, ":%02X%04X%02X", len, addr, type);
+    for (uint8_t i = 0; i < len; i++){
+        fprintf(file, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(file, "%02X\n", (uint8_t)(0x100 - sum));
+}
+
+static void put_segment(FILE *file, uint32_t addr, uint32_t len){
+    uint32_t end = addr + len;
+    uint32_t upper = 0xFFFFFFFFu;
+    while (addr < end){
+        uint8_t data[TEST_RECORD];
+        uint32_t chunk = TEST_RECORD - (addr % TEST_RECORD);
+        if (chunk > end - addr) chunk = end - addr;
+        if ((addr >> 16) != upper){
+            upper = addr >> 16;
+            uint8_t ext[2] = {(uint8_t)(upper >> 8), (uint8_t)upper};
+            put_record(file, 0x04, 0, ext, 2);
+        }
+        for (uint32_t i = 0; i < chunk; i++)
+            data[i] = pattern(addr + i);
+        put_record(file, 0x00, (uint16_t)addr, data, (uint8_t)chunk);
+        addr += chunk;
+    }
+}
+
+static int in_segment(uint32_t addr){
+    return (addr >= SEG_A_ADDR && addr < SEG_A_ADDR + SEG_A_LEN) || (addr >= SEG_B_ADDR && addr < SEG_B_ADDR + SEG_B_LEN);
+}
+
+static void check_image(const char *name, const Image *img){
+    printf("checking %s\n", name);
+    CHECK(img->used == NULL);
+    CHECK(img->size == SEG_B_ADDR + SEG_B_LEN);
+    CHECK(img->page_count == img->size / IMAGE_PAGE_SIZE);
+    CHECK(img->data_bytes == SEG_A_LEN + SEG_B_LEN);
+    CHECK(img->segment_count == 2);
+    if (img->segment_count == 2){
+        CHECK(img->segments[0].addr == SEG_A_ADDR && img->segments[0].len == SEG_A_LEN);
+        CHECK(img->segments[1].addr == SEG_B_ADDR && img->segments[1].len == SEG_B_LEN);
+    }
+
+    uint32_t bad = 0;
+    for (uint32_t addr = 0; addr < img->size; addr++){
+        uint8_t want = in_segment(addr) ? pattern(addr) : 0xFF;
+        if (img->data[addr] != want && bad++ == 0)
+            printf("first data mismatch at 0x%06X: 0x%02X, want 0x%02X\n", addr, img->data[addr], want);
+    }
+    CHECK(bad == 0);
+
+    uint32_t bad_pages = 0;
+    for (uint32_t page = 0; page < img->page_count; page++){
+        uint32_t addr = page * IMAGE_PAGE_SIZE;
+        int used = in_segment(addr) || in_segment(addr + IMAGE_PAGE_SIZE - 1);
+        if (image_page_used(img, page) != used
+            || img->page_crc[page] != image_crc32(img->data + addr, IMAGE_PAGE_SIZE))
+            bad_pages++;
+    }
+    CHECK(bad_pages == 0);
+}
+
+int main(void){
+    FILE *file = fopen(TEST_FILE, "w");
+    if (!file){
+        printf("could not write '%s'\n", TEST_FILE);
+        return 1;
+    }
+    put_segment(file, SEG_A_ADDR, SEG_A_LEN);
+    put_segment(file, SEG_B_ADDR, SEG_B_LEN);
+    fprintf(file, ":00000001FF\n");
+    fclose(file);
+
+    if (!image_parallel_worthwhile(TEST_FILE))
+        printf("single processor, image_load takes the sequential path\n");
+
+    Image img;
+    FT_STATUS ftStatus = image_load(&img, TEST_FILE);
+    CHECK(ftStatus == FT_OK);
+    if (ftStatus == FT_OK) check_image("image_load", &img);
+    image_free(&img);
+
+    image_init(&img);
+    ftStatus = image_load_intel_hex_parallel(&img, TEST_FILE);
+    CHECK(ftStatus == FT_OK);
+    if (ftStatus == FT_OK) check_image("image_load_intel_hex_parallel", &img);
+    image_free(&img);
+
+    remove(TEST_FILE);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures != 0;
+}